@@ -0,0 +1,175 @@
+#include "arrival_trace.h"
+#include <FS.h>
+#include <SPIFFS.h>
+
+namespace {
+const uint8_t TRACE_MAGIC[4] = { 'A', 'T', 'R', '1' };
+
+size_t putVarint(uint8_t* out, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+bool getVarint(const uint8_t* in, size_t len, size_t& pos, uint32_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 35 && pos < len; shift += 7) {
+        uint8_t b = in[pos++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+}
+
+ArrivalTrace::ArrivalTrace()
+: data(nullptr), used(0), readPos(0), records(0), bytesTotal(0), startUs(0), lastUs(0), replayUs(0), truncated(false) {
+}
+
+ArrivalTrace::~ArrivalTrace() {
+    free(data);
+}
+
+bool ArrivalTrace::ensureBuffer() {
+    if (!data) data = (uint8_t*)malloc(ARRIVAL_TRACE_BYTES);
+    return data != nullptr;
+}
+
+bool ArrivalTrace::begin() {
+    if (!ensureBuffer()) return false;
+    used = 0;
+    records = 0;
+    bytesTotal = 0;
+    lastUs = 0;
+    truncated = false;
+    startUs = micros();
+    reset();
+    return true;
+}
+
+void ArrivalTrace::record(size_t bytes) {
+    if (!data || truncated) return;
+    uint32_t now = micros() - startUs;
+    // two varints take at most 10 bytes
+    if (used + 10 > ARRIVAL_TRACE_BYTES) {
+        truncated = true;
+        return;
+    }
+    used += putVarint(data + used, now - lastUs);
+    used += putVarint(data + used, bytes);
+    lastUs = now;
+    records++;
+    bytesTotal += bytes;
+}
+
+void ArrivalTrace::reset() {
+    readPos = 0;
+    replayUs = 0;
+}
+
+bool ArrivalTrace::next(uint32_t& atUs, uint32_t& bytes) {
+    uint32_t dt;
+    if (!data || !getVarint(data, used, readPos, dt) || !getVarint(data, used, readPos, bytes)) return false;
+    replayUs += dt;
+    atUs = replayUs;
+    return true;
+}
+
+bool ArrivalTrace::save(const String& path) const {
+    if (!data) return false;
+    File f = SPIFFS.open(path, FILE_WRITE);
+    if (!f) return false;
+    uint32_t header[3] = { records, bytesTotal, (uint32_t)used };
+    bool ok = f.write(TRACE_MAGIC, sizeof(TRACE_MAGIC)) == sizeof(TRACE_MAGIC) &&
+              f.write((const uint8_t*)header, sizeof(header)) == sizeof(header) &&
+              f.write(data, used) == used;
+    f.close();
+    return ok;
+}
+
+bool ArrivalTrace::load(const String& path) {
+    File f = SPIFFS.open(path, FILE_READ);
+    if (!f) return false;
+    uint8_t magic[4];
+    uint32_t header[3];
+    bool ok = f.read(magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0 &&
+              f.read((uint8_t*)header, sizeof(header)) == sizeof(header) && header[2] <= ARRIVAL_TRACE_BYTES && ensureBuffer() &&
+              f.read(data, header[2]) == header[2];
+    f.close();
+    if (!ok) return false;
+
+    records = header[0];
+    bytesTotal = header[1];
+    used = header[2];
+    truncated = false;
+    reset();
+    // recover the duration for the summary
+    uint32_t at, bytes;
+    while (next(at, bytes)) lastUs = at;
+    reset();
+    return true;
+}
+
+void ArrivalTrace::printSummary() const {
+    Serial.println("\n=== ARRIVAL TRACE ===");
+    Serial.println("Reads: " + String(records) + ", bytes: " + String(bytesTotal) + ", duration: " + String(lastUs / 1000) + " ms" +
+                   (truncated ? " (truncated)" : ""));
+    if (records > 0) {
+        Serial.println("Avg read: " + String(bytesTotal / records) + " B every " + String(lastUs / records) + " us");
+        Serial.println("Trace size: " + String((unsigned)used) + " B (" + String((float)used / records, 1) + " B/read)");
+    }
+    Serial.println("=====================\n");
+}
+
+// ---- ReplayStream ----
+
+ReplayStream::ReplayStream(ArrivalTrace* t)
+: trace(t), speed(1.0f), started(false), startUs(0), arrived(0), delivered(0), total(0), pendingAt(0), pendingBytes(0), havePending(false), reads(0) {
+}
+
+void ReplayStream::rewind() {
+    started = false;
+    arrived = 0;
+    delivered = 0;
+    havePending = false;
+    reads = 0;
+    total = totalBytes();
+    if (trace) trace->reset();
+}
+
+void ReplayStream::advance() {
+    if (!trace) return;
+    if (!started) {
+        started = true;
+        startUs = micros();
+    }
+    uint32_t elapsed = micros() - startUs;
+    while (true) {
+        if (!havePending) {
+            if (!trace->next(pendingAt, pendingBytes)) return;
+            havePending = true;
+        }
+        uint32_t due = speed > 0.0f ? (uint32_t)(pendingAt / speed) : 0;
+        if (due > elapsed) return;
+        arrived += pendingBytes;
+        havePending = false;
+    }
+}
+
+int ReplayStream::available() {
+    advance();
+    return arrived - delivered;
+}
+
+size_t ReplayStream::read(uint8_t* buf, size_t len) {
+    advance();
+    size_t n = min(len, arrived - delivered);
+    for (size_t i = 0; i < n; ++i) buf[i] = (uint8_t)(delivered + i);
+    delivered += n;
+    if (n > 0) reads++;
+    return n;
+}
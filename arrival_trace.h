@@ -0,0 +1,77 @@
+#pragma once
+#include <Arduino.h>
+
+// Record-and-replay of how a download's bytes arrived (when, and in what pieces).
+// ArrivalTrace records one entry per socket read during a real download; ReplayStream hands
+// the same byte counts to an engine at the same offsets in time, without a network.
+// Traces are kept as LEB128 varints (time delta in us, bytes): usually 3-5 bytes per read.
+
+const size_t ARRIVAL_TRACE_BYTES = 16 * 1024;   // ~4000 reads; recording stops (truncated) when full
+
+class ArrivalTrace {
+public:
+ArrivalTrace();
+~ArrivalTrace();
+
+bool begin();                 // allocate (if needed) and start a new trace at t = 0
+void record(size_t bytes);    // one read of `bytes`, timestamped now
+void reset();                 // back to the first record, for replay
+
+// Next record for replay; false at the end
+bool next(uint32_t& atUs, uint32_t& bytes);
+
+bool save(const String& path) const;
+bool load(const String& path);
+
+uint32_t recordCount() const { return records; }
+uint32_t totalBytes() const { return bytesTotal; }
+uint32_t durationUs() const { return lastUs; }
+bool isTruncated() const { return truncated; }
+void printSummary() const;
+
+private:
+uint8_t* data;
+size_t used;
+size_t readPos;
+uint32_t records;
+uint32_t bytesTotal;
+uint32_t startUs;
+uint32_t lastUs;         // time of the latest record, relative to start
+uint32_t replayUs;       // running time while iterating with next()
+bool truncated;
+
+bool ensureBuffer();
+};
+
+// Plays an ArrivalTrace back: available() grows only as the recorded arrival times pass.
+// Content is a deterministic pattern, since the trace keeps timing and sizes only.
+class ReplayStream {
+public:
+explicit ReplayStream(ArrivalTrace* trace = nullptr);
+
+void setTrace(ArrivalTrace* t) { trace = t; }
+// 2.0 replays twice as fast; 0 drops the timing and delivers everything at once
+void setSpeed(float factor) { speed = factor; }
+
+void rewind();               // the clock starts at the first available()/read() after this
+int available();
+size_t read(uint8_t* buf, size_t len);
+bool connected() const { return delivered < total; }
+size_t totalBytes() const { return trace ? trace->totalBytes() : 0; }
+uint32_t readCount() const { return reads; }   // reads that returned data since rewind()
+
+private:
+ArrivalTrace* trace;
+float speed;
+bool started;
+uint32_t startUs;
+size_t arrived;              // bytes whose arrival time has passed
+size_t delivered;            // bytes handed to the reader
+size_t total;
+uint32_t pendingAt;          // next record not yet arrived
+uint32_t pendingBytes;
+bool havePending;
+uint32_t reads;
+
+void advance();
+};
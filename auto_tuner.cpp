@@ -0,0 +1,356 @@
+#include "auto_tuner.h"
+#include <ctype.h>
+#include <Preferences.h>
+#include <FS.h>
+#include <SPIFFS.h>
+#include "download_engines.h"
+#include "metadata_probe.h"
+
+namespace {
+const char* TUNE_TARGET = "/.tune_dl";
+const char* TUNE_FLASH_FILE = "/.tune_flash";
+const size_t TUNE_FLASH_BYTES = 128 * 1024;
+const int TUNE_PROBE_URLS = 8;
+
+size_t smallestNearBest(const size_t* sizes, const float* scores, int n, float& best) {
+    best = 0.0f;
+    for (int i = 0; i < n; ++i) best = max(best, scores[i]);
+    for (int i = 0; i < n; ++i) {
+        if (scores[i] > 0.0f && scores[i] >= best * TUNER_NEAR_BEST) return sizes[i];
+    }
+    return 0;
+}
+}
+
+AutoTuner::AutoTuner() {
+}
+
+size_t AutoTuner::tierSize(TunedBuffer kind, int tier) {
+    static const size_t download[TIERS] = { SMALL_DOWNLOAD_BUFFER_SIZE, DEFAULT_DOWNLOAD_BUFFER_SIZE, LARGE_DOWNLOAD_BUFFER_SIZE, XLARGE_DOWNLOAD_BUFFER_SIZE };
+    static const size_t pipeline[TIERS] = { 8192, 16384, 32768, 65536 };
+    tier = constrain(tier, 0, TIERS - 1);
+    return kind == TUNED_PIPELINE_BLOCK ? pipeline[tier] : download[tier];
+}
+
+int AutoTuner::tierOf(TunedBuffer kind, size_t bufferSize) {
+    for (int t = TIERS - 1; t > 0; --t) {
+        if (bufferSize >= tierSize(kind, t)) return t;
+    }
+    return 0;
+}
+
+bool AutoTuner::fitsHeap(TunedBuffer kind, size_t bufferSize) {
+    if (kind == TUNED_DOWNLOAD_BUFFER) return bufferSize <= BufferManager::getSmartDownloadBufferSize();
+    // the pipeline allocates two blocks per download; leave the rest of the heap to WiFi and TLS
+    return bufferSize * DOUBLE_BUFFER_COUNT * 2 <= ESP.getFreeHeap();
+}
+
+uint32_t AutoTuner::hostHash(const String& url) {
+    int start = url.indexOf("://");
+    start = start < 0 ? 0 : start + 3;
+    int end = url.indexOf('/', start);
+    if (end < 0) end = url.length();
+    // FNV-1a over the host (and port): NVS keys are limited to 15 characters
+    uint32_t h = 2166136261u;
+    for (int i = start; i < end; ++i) {
+        h ^= (uint8_t)tolower(url[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+bool AutoTuner::begin() {
+    Preferences prefs;
+    if (!prefs.begin(TUNER_NVS_NAMESPACE, true)) return false;
+    config.valid = prefs.getUChar("valid", 0) == 1;
+    config.downloadBufferSize = prefs.getUInt("dl", 0);
+    config.writeBufferSize = prefs.getUInt("wr", 0);
+    config.chunkSize = prefs.getUInt("chunk", 0);
+    config.bufferCount = prefs.getUChar("count", 0);
+    config.parallelism = prefs.getUChar("par", 0);
+    config.measuredKBps = prefs.getFloat("kbps", 0.0f);
+    prefs.end();
+
+    if (config.downloadBufferSize == 0 || config.writeBufferSize == 0) config.valid = false;
+    if (config.valid) Serial.println("Auto-tuner: loaded calibrated configuration");
+    applyConfig();
+    return true;
+}
+
+// Settings that are not per download: pushed to their users once the configuration is known
+void AutoTuner::applyConfig() {
+    setDefaultProbeConnections(config.valid ? config.parallelism : 0);
+}
+
+bool AutoTuner::saveConfig() {
+    Preferences prefs;
+    if (!prefs.begin(TUNER_NVS_NAMESPACE, false)) return false;
+    prefs.putUInt("dl", config.downloadBufferSize);
+    prefs.putUInt("wr", config.writeBufferSize);
+    prefs.putUInt("chunk", config.chunkSize);
+    prefs.putUChar("count", config.bufferCount);
+    prefs.putUChar("par", config.parallelism);
+    prefs.putFloat("kbps", config.measuredKBps);
+    prefs.putString("fw", FIRMWARE_VERSION);
+    prefs.putUChar("valid", config.valid ? 1 : 0);
+    prefs.end();
+    return true;
+}
+
+void AutoTuner::clear() {
+    Preferences prefs;
+    if (prefs.begin(TUNER_NVS_NAMESPACE, false)) {
+        prefs.clear();
+        prefs.end();
+    }
+    config = TunedConfig();
+    hosts.clear();
+    applyConfig();
+}
+
+// ---- micro-benchmarks ----
+
+float AutoTuner::benchFlashWrite(size_t chunk) {
+    uint8_t* buf = (uint8_t*)malloc(chunk);
+    if (!buf) return 0.0f;
+    memset(buf, 0x5A, chunk);
+    unsigned long start = micros();
+    File f = SPIFFS.open(TUNE_FLASH_FILE, FILE_WRITE);
+    size_t written = 0;
+    while (f && written < TUNE_FLASH_BYTES) {
+        size_t n = f.write(buf, chunk);
+        if (n == 0) break;
+        written += n;
+    }
+    if (f) f.close();
+    unsigned long us = micros() - start;
+    SPIFFS.remove(TUNE_FLASH_FILE);
+    free(buf);
+    return us > 0 ? (written / 1024.0f) * 1e6f / us : 0.0f;
+}
+
+float AutoTuner::benchDualCore(DualCoreDownloader& engine, const String& url) {
+    DownloadResult r = engine.download(url, TUNE_TARGET);
+    SPIFFS.remove(TUNE_TARGET);
+    return r.success ? PerformanceMonitor::calculateSpeedKBps(r.totalBytes, r.downloadTimeMs) : 0.0f;
+}
+
+float AutoTuner::benchHttp(BufferManager& mgr, const String& url) {
+    HttpDownloader engine;
+    engine.setBufferManager(&mgr);
+    unsigned long start = millis();
+    DownloadResult r = engine.download(url, TUNE_TARGET);
+    unsigned long ms = millis() - start;
+    SPIFFS.remove(TUNE_TARGET);
+    return r.success ? PerformanceMonitor::calculateSpeedKBps(r.totalBytes, ms) : 0.0f;
+}
+
+float AutoTuner::benchProbe(const String& url, int connections) {
+    std::vector<String> urls(TUNE_PROBE_URLS, url);
+    ProbeBatchStats stats;
+    probeBatch(urls, connections, PROBE_HEAD, &stats);
+    return stats.totalMs > 0 ? stats.ok * 1000.0f / stats.totalMs : 0.0f;
+}
+
+const TunedConfig& AutoTuner::calibrate(const String& testUrl) {
+    Serial.println("\n=== AUTO-TUNER CALIBRATION ===");
+    TunedConfig c;
+    float best;
+
+    // 1. flash: the write size past which bigger writes stop paying
+    const size_t writeSizes[] = { 4096, 8192, SMALL_WRITE_BUFFER_SIZE, DEFAULT_WRITE_BUFFER_SIZE, LARGE_WRITE_BUFFER_SIZE };
+    const int nWrite = sizeof(writeSizes) / sizeof(writeSizes[0]);
+    float writeKBps[nWrite];
+    for (int i = 0; i < nWrite; ++i) {
+        writeKBps[i] = benchFlashWrite(writeSizes[i]);
+        Serial.printf("flash write %6u B: %8.1f KB/s\n", (unsigned)writeSizes[i], writeKBps[i]);
+    }
+    c.writeBufferSize = smallestNearBest(writeSizes, writeKBps, nWrite, best);
+
+    // 2. two-buffer pipeline (DualCoreDownloader, own buffers): pipeline block size
+    const int nChunk = TIERS;
+    size_t chunkSizes[nChunk];
+    float chunkKBps[nChunk];
+    for (int i = 0; i < nChunk; ++i) chunkSizes[i] = tierSize(TUNED_PIPELINE_BLOCK, i);
+    float pipelineBest = 0.0f;
+    {
+        DualCoreDownloader engine;
+        for (int i = 0; i < nChunk; ++i) {
+            engine.setChunkSize(chunkSizes[i]);
+            chunkKBps[i] = benchDualCore(engine, testUrl);
+            Serial.printf("pipeline chunk %6u B: %8.1f KB/s\n", (unsigned)chunkSizes[i], chunkKBps[i]);
+        }
+    }
+    c.chunkSize = smallestNearBest(chunkSizes, chunkKBps, nChunk, pipelineBest);
+
+    // 3. single buffer (HttpDownloader) at each download tier that fits in the heap
+    size_t dlSizes[TIERS];
+    float dlKBps[TIERS];
+    for (int t = 0; t < TIERS; ++t) {
+        dlSizes[t] = tierSize(TUNED_DOWNLOAD_BUFFER, t);
+        dlKBps[t] = 0.0f;
+        BufferManager mgr;
+        if (!mgr.allocateBuffers(dlSizes[t], SMALL_WRITE_BUFFER_SIZE)) continue;
+        dlKBps[t] = benchHttp(mgr, testUrl);
+        Serial.printf("single buffer %7u B: %8.1f KB/s\n", (unsigned)dlSizes[t], dlKBps[t]);
+    }
+    float singleBest;
+    c.downloadBufferSize = smallestNearBest(dlSizes, dlKBps, TIERS, singleBest);
+
+    // 4. buffer count: is overlapping receive and flash write worth a second buffer here?
+    c.bufferCount = pipelineBest > singleBest ? 2 : 1;
+
+    // 5. batch parallelism for metadata probes
+    const size_t conns[] = { 1, 2, 4, 6 };
+    float probeRate[4];
+    for (int i = 0; i < 4; ++i) {
+        probeRate[i] = benchProbe(testUrl, conns[i]);
+        Serial.printf("probe x%u: %8.1f req/s\n", (unsigned)conns[i], probeRate[i]);
+    }
+    c.parallelism = smallestNearBest(conns, probeRate, 4, best);
+
+    c.measuredKBps = max(pipelineBest, singleBest);
+    c.valid = c.writeBufferSize > 0 && c.downloadBufferSize > 0 && c.chunkSize > 0;
+    if (!c.valid) {
+        Serial.println("Calibration failed (network or flash unavailable); keeping previous configuration");
+        Serial.println("==============================\n");
+        return config;
+    }
+    if (c.parallelism == 0) c.parallelism = PROBE_DEFAULT_CONNECTIONS;
+
+    config = c;
+    saveConfig();
+    applyConfig();
+    printConfig();
+    return config;
+}
+
+// ---- per-host learning ----
+
+void AutoTuner::hostKey(const HostTuning& h, char* key, size_t cap) {
+    // one NVS entry per host and buffer kind
+    snprintf(key, cap, "%c%08x", h.kind == TUNED_PIPELINE_BLOCK ? 'p' : 'h', (unsigned)h.hostHash);
+}
+
+AutoTuner::HostTuning& AutoTuner::hostEntry(const String& url, TunedBuffer kind) {
+    uint32_t h = hostHash(url);
+    for (size_t i = 0; i < hosts.size(); ++i) {
+        if (hosts[i].hostHash == h && hosts[i].kind == kind) {
+            // most recent first
+            if (i > 0) std::swap(hosts[i], hosts[0]);
+            return hosts[0];
+        }
+    }
+
+    HostTuning e;
+    memset(&e, 0, sizeof(e));
+    e.chosenTier = 0xFF;
+    e.hostHash = h;
+    e.kind = kind;
+    char key[12];
+    hostKey(e, key, sizeof(key));
+    Preferences prefs;
+    if (prefs.begin(TUNER_NVS_NAMESPACE, true)) {
+        if (prefs.getBytesLength(key) == sizeof(e)) prefs.getBytes(key, &e, sizeof(e));
+        prefs.end();
+    }
+    e.hostHash = h;
+    e.kind = kind;
+
+    if ((int)hosts.size() >= TUNER_HOST_CACHE) hosts.pop_back();
+    hosts.insert(hosts.begin(), e);
+    return hosts[0];
+}
+
+void AutoTuner::saveHost(const HostTuning& h) {
+    char key[12];
+    hostKey(h, key, sizeof(key));
+    Preferences prefs;
+    if (!prefs.begin(TUNER_NVS_NAMESPACE, false)) return;
+    prefs.putBytes(key, &h, sizeof(h));
+    prefs.end();
+}
+
+size_t AutoTuner::baseSize(TunedBuffer kind) const {
+    if (kind == TUNED_PIPELINE_BLOCK) return config.valid && config.chunkSize > 0 ? config.chunkSize : tierSize(kind, 0);
+    return config.valid ? config.downloadBufferSize : BufferManager::getSmartDownloadBufferSize();
+}
+
+size_t AutoTuner::bufferSizeFor(const String& url, TunedBuffer kind) {
+    HostTuning& h = hostEntry(url, kind);
+    int tier = h.chosenTier != 0xFF ? h.chosenTier : tierOf(kind, baseSize(kind));
+
+    // now and then try the least-sampled neighbour so a better tier can show itself
+    if (h.downloads > 0 && h.downloads % TUNER_EXPLORE_EVERY == 0) {
+        int lower = tier - 1, upper = tier + 1;
+        int pick = -1;
+        if (lower >= 0) pick = lower;
+        if (upper < TIERS && (pick < 0 || h.samples[upper] < h.samples[pick])) pick = upper;
+        if (pick >= 0 && fitsHeap(kind, tierSize(kind, pick))) tier = pick;
+    }
+    while (tier > 0 && !fitsHeap(kind, tierSize(kind, tier))) tier--;
+    return tierSize(kind, tier);
+}
+
+bool AutoTuner::prepare(BufferManager& mgr, const String& url) {
+    size_t want = bufferSizeFor(url, TUNED_DOWNLOAD_BUFFER);
+    size_t current = mgr.getDownloadBufferSize();
+    if (current == want) return true;
+    size_t write = mgr.getWriteBufferSize() > 0 ? mgr.getWriteBufferSize() : (config.valid ? config.writeBufferSize : SMALL_WRITE_BUFFER_SIZE);
+    // never at the price of double buffering: without heap for the wish in the current mode,
+    // go back to the size we had (calibration stays in force)
+    if (mgr.allocateBuffers(want, write, false)) return true;
+    return current > 0 && mgr.allocateBuffers(current, write);
+}
+
+size_t AutoTuner::prepare(DualCoreDownloader& engine, const String& url) {
+    size_t want = bufferSizeFor(url, TUNED_PIPELINE_BLOCK);
+    engine.setChunkSize(want);
+
+    // double buffering through the manager: the pipeline runs on its write buffers, so size those
+    BufferManager* mgr = engine.getBufferManager();
+    if (engine.usesManagerBuffers() && mgr->getWriteBufferSize() != want) {
+        size_t download = mgr->getDownloadBufferSize(), write = mgr->getWriteBufferSize();
+        if (!mgr->allocateBuffers(download, want, false)) mgr->allocateBuffers(download, write);
+    }
+    return engine.getPipelineBlockSize();
+}
+
+void AutoTuner::recordResult(const String& url, size_t bufferSize, const DownloadResult& r, TunedBuffer kind) {
+    if (!r.success || r.downloadTimeMs == 0) return;
+    HostTuning& h = hostEntry(url, kind);
+    int t = tierOf(kind, bufferSize);
+    float kbps = r.averageSpeedKBps > 0.0f ? r.averageSpeedKBps : PerformanceMonitor::calculateSpeedKBps(r.totalBytes, r.downloadTimeMs);
+
+    h.kbps[t] = h.samples[t] == 0 ? kbps : h.kbps[t] * 0.7f + kbps * 0.3f;
+    if (h.samples[t] < 0xFFFF) h.samples[t]++;
+    h.downloads++;
+
+    // the best tier with enough samples takes over when it is clearly better
+    int current = h.chosenTier != 0xFF ? h.chosenTier : tierOf(kind, config.valid ? baseSize(kind) : bufferSize);
+    int best = current;
+    for (int i = 0; i < TIERS; ++i) {
+        if (h.samples[i] >= TUNER_MIN_SAMPLES && h.kbps[i] > h.kbps[best] * TUNER_SWITCH_GAIN) best = i;
+    }
+    if (best != current && h.samples[best] >= TUNER_MIN_SAMPLES) {
+        Serial.println("Auto-tuner: host override -> " + PerformanceMonitor::formatBytes(tierSize(kind, best)) +
+                       (kind == TUNED_PIPELINE_BLOCK ? " pipeline block" : " download buffer"));
+        h.chosenTier = best;
+    }
+    saveHost(h);
+}
+
+void AutoTuner::printConfig() const {
+    Serial.println("\n=== TUNED CONFIGURATION ===");
+    if (!config.valid) {
+        Serial.println("Not calibrated (heap-based sizing in use)");
+    } else {
+        Serial.println("Download buffer: " + PerformanceMonitor::formatBytes(config.downloadBufferSize));
+        Serial.println("Write buffer: " + PerformanceMonitor::formatBytes(config.writeBufferSize));
+        Serial.println("Pipeline chunk: " + PerformanceMonitor::formatBytes(config.chunkSize));
+        Serial.println("Buffers: " + String(config.bufferCount) + ", parallelism: " + String(config.parallelism));
+        Serial.println("Measured: " + PerformanceMonitor::formatSpeed(config.measuredKBps));
+    }
+    Serial.println("Host overrides cached: " + String((unsigned)hosts.size()));
+    Serial.println("===========================\n");
+}
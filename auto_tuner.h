@@ -0,0 +1,80 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "buffer_and_performance.h"
+
+// Board calibration: short storage and network micro-benchmarks against a test URL choose the
+// buffer sizes, pipeline chunk, buffer count and batch parallelism, and the result is kept in NVS.
+// Per-host download buffer overrides are learned afterwards from real downloads.
+
+const char* const TUNER_NVS_NAMESPACE = "dltune";
+const int TUNER_HOST_CACHE = 8;           // hosts kept in RAM (all are in NVS)
+const int TUNER_MIN_SAMPLES = 3;          // per buffer tier before it can win a host
+const float TUNER_SWITCH_GAIN = 1.10f;    // a tier must beat the current one by 10% to take over
+const int TUNER_EXPLORE_EVERY = 8;        // every Nth download for a host tries a neighbouring tier
+const float TUNER_NEAR_BEST = 0.90f;      // "within 10% of the best" picks the smaller (cheaper) setting
+
+// Which buffer a per-host size is learned for: each engine reads the network into a different one
+enum TunedBuffer : uint8_t {
+TUNED_DOWNLOAD_BUFFER = 0,    // BufferManager download buffer (HttpDownloader)
+TUNED_PIPELINE_BLOCK = 1      // DualCoreDownloader receive/write block
+};
+
+class DualCoreDownloader;
+
+class AutoTuner {
+public:
+AutoTuner();
+
+bool begin();                          // load the stored configuration from NVS
+bool needsCalibration() const { return !config.valid; }
+
+// Benchmark on this board against testUrl (a few hundred KB works well) and persist the winner
+const TunedConfig& calibrate(const String& testUrl);
+const TunedConfig& getConfig() const { return config; }
+void clear();                          // forget everything; next boot calibrates again
+
+// Buffer size for url's host: learned override or the calibrated value, sometimes a neighbour to keep learning
+size_t bufferSizeFor(const String& url, TunedBuffer kind = TUNED_DOWNLOAD_BUFFER);
+// Resize mgr's download buffer for url when it differs (keeps the write buffer); on a heap
+// shortfall the previous size stays
+bool prepare(BufferManager& mgr, const String& url);
+// Set engine's pipeline block for url: chunk size, or the attached manager's write buffers when it
+// double buffers. Returns the block the engine will actually use, for recordResult().
+size_t prepare(DualCoreDownloader& engine, const String& url);
+// Feed a finished download back; bufferSize is the buffer of that kind it used
+void recordResult(const String& url, size_t bufferSize, const DownloadResult& r, TunedBuffer kind = TUNED_DOWNLOAD_BUFFER);
+
+void printConfig() const;
+
+private:
+static const int TIERS = 4;            // SMALL / DEFAULT / LARGE / XLARGE download buffers
+
+struct HostTuning {
+    uint32_t hostHash;
+    uint8_t chosenTier;                // 0xFF = no override yet
+    uint8_t downloads;
+    uint8_t kind;                      // TunedBuffer
+    uint16_t samples[TIERS];
+    float kbps[TIERS];                 // EWMA per tier
+};
+
+TunedConfig config;
+std::vector<HostTuning> hosts;         // small LRU cache in front of NVS
+
+static size_t tierSize(TunedBuffer kind, int tier);
+static int tierOf(TunedBuffer kind, size_t bufferSize);
+static bool fitsHeap(TunedBuffer kind, size_t bufferSize);
+static uint32_t hostHash(const String& url);
+static void hostKey(const HostTuning& h, char* key, size_t cap);
+size_t baseSize(TunedBuffer kind) const;
+HostTuning& hostEntry(const String& url, TunedBuffer kind);
+void saveHost(const HostTuning& h);
+bool saveConfig();
+void applyConfig();
+
+float benchFlashWrite(size_t chunk);
+float benchDualCore(DualCoreDownloader& engine, const String& url);
+float benchHttp(BufferManager& mgr, const String& url);
+float benchProbe(const String& url, int connections);
+};
@@ -0,0 +1,252 @@
+#include "content_store.h"
+#include <FS.h>
+#include <SPIFFS.h>
+#include "spiffs_management.h"
+#include "buffer_and_performance.h"
+
+namespace {
+const char* STORE_INDEX_PATH = "/cas/.index";
+// SPIFFS names are limited to 32 characters, so blobs are named by a 96-bit digest prefix;
+// the full digest stays in the index
+const int BLOB_NAME_HEX = 24;
+
+struct Guard {
+    SemaphoreHandle_t m;
+    explicit Guard(SemaphoreHandle_t m) : m(m) { xSemaphoreTake(m, portMAX_DELAY); }
+    ~Guard() { xSemaphoreGive(m); }
+};
+}
+
+ContentStore::ContentStore() : lock(xSemaphoreCreateMutex()) {
+}
+
+String ContentStore::blobPath(const String& digestHex) {
+    return "/cas/" + digestHex.substring(0, BLOB_NAME_HEX);
+}
+
+bool ContentStore::begin() {
+    Guard g(lock);
+    blobs.clear();
+    refs.clear();
+
+    File f = SPIFFS.open(STORE_INDEX_PATH, FILE_READ);
+    if (!f) return true; // first boot: empty store
+
+    // B <digest> <size>   |   R <digest> <path>
+    bool dirty = false;
+    while (f.available()) {
+        String line = f.readStringUntil('\n');
+        line.trim();
+        char kind = 0;
+        char digest[65], arg[64];
+        if (sscanf(line.c_str(), "%c %64s %63s", &kind, digest, arg) != 3) continue;
+
+        if (kind == 'B' && (int)blobs.size() < MAX_CONTENT_BLOBS) {
+            if (!SPIFFS.exists(blobPath(digest))) {
+                dirty = true;
+                continue;
+            }
+            Blob b;
+            b.digest = digest;
+            b.size = strtoul(arg, nullptr, 10);
+            b.refs = 0;
+            blobs.push_back(b);
+        } else if (kind == 'R' && (int)refs.size() < MAX_CONTENT_REFS) {
+            int bi = findBlob(digest);
+            if (bi < 0) {
+                dirty = true;
+                continue;
+            }
+            addRef(arg, bi);
+            // the index is saved before a file is moved or deleted, so power lost in between
+            // leaves the plain copy behind the reference
+            if (SPIFFS.exists(arg)) SPIFFS.remove(arg);
+        }
+    }
+    f.close();
+
+    // blobs nobody points at any more (power lost between the two updates)
+    for (int i = (int)blobs.size() - 1; i >= 0; --i) {
+        if (blobs[i].refs == 0) {
+            SPIFFS.remove(blobPath(blobs[i].digest));
+            blobs.erase(blobs.begin() + i);
+            dirty = true;
+        }
+    }
+
+    if (dirty) save();
+    Serial.println("Content store: " + String((unsigned)blobs.size()) + " blobs, " + String((unsigned)refs.size()) + " references");
+    return true;
+}
+
+bool ContentStore::save() {
+    File f = SPIFFS.open(STORE_INDEX_PATH, FILE_WRITE);
+    if (!f) return false;
+    for (const auto& b : blobs) f.printf("B %s %u\n", b.digest.c_str(), (unsigned)b.size);
+    for (const auto& r : refs) f.printf("R %s %s\n", r.digest.c_str(), r.path.c_str());
+    f.close();
+    return true;
+}
+
+int ContentStore::findBlob(const String& digestHex) const {
+    for (size_t i = 0; i < blobs.size(); ++i) {
+        if (blobs[i].digest.equalsIgnoreCase(digestHex)) return i;
+    }
+    return -1;
+}
+
+int ContentStore::findRef(const String& path) const {
+    for (size_t i = 0; i < refs.size(); ++i) {
+        if (refs[i].path == path) return i;
+    }
+    return -1;
+}
+
+void ContentStore::addRef(const String& path, int blobIndex) {
+    Ref r;
+    r.path = path;
+    r.digest = blobs[blobIndex].digest;
+    refs.push_back(r);
+    blobs[blobIndex].refs++;
+}
+
+bool ContentStore::hasContent(const String& digestHex) const {
+    Guard g(lock);
+    return findBlob(digestHex) >= 0;
+}
+
+size_t ContentStore::contentSize(const String& digestHex) const {
+    Guard g(lock);
+    int bi = findBlob(digestHex);
+    return bi < 0 ? 0 : blobs[bi].size;
+}
+
+bool ContentStore::isReference(const String& path) const {
+    Guard g(lock);
+    return findRef(path) >= 0;
+}
+
+String ContentStore::resolve(const String& path) const {
+    Guard g(lock);
+    int ri = findRef(path);
+    return ri < 0 ? path : blobPath(refs[ri].digest);
+}
+
+bool ContentStore::link(const String& targetPath, const String& digestHex) {
+    Guard g(lock);
+    int bi = findBlob(digestHex);
+    if (bi < 0) return false;
+
+    int ri = findRef(targetPath);
+    if (ri >= 0 && refs[ri].digest.equalsIgnoreCase(digestHex)) {
+        stats.linkedHits++;
+        stats.bytesSaved += blobs[bi].size;
+        return true;
+    }
+    if (ri < 0 && (int)refs.size() >= MAX_CONTENT_REFS) return false;
+    if (ri >= 0) {
+        releaseRef(targetPath);
+        bi = findBlob(digestHex);
+    }
+
+    addRef(targetPath, bi);
+    save();
+    // a plain file at the target would shadow nothing but waste flash
+    if (SPIFFS.exists(targetPath)) {
+        hotCacheInvalidate(targetPath);
+        SPIFFS.remove(targetPath);
+    }
+    stats.linkedHits++;
+    stats.bytesSaved += blobs[bi].size;
+    return true;
+}
+
+// The index is saved before the file moves: power lost in between leaves either a reference to a
+// blob that never arrived (dropped by begin(), the plain file is still there) or a plain copy
+// behind a reference (removed by begin()), never a blob with its target gone.
+bool ContentStore::adopt(const String& targetPath, const String& digestHex) {
+    Guard g(lock);
+    if (digestHex.length() < BLOB_NAME_HEX || !SPIFFS.exists(targetPath)) return false;
+    if (findRef(targetPath) >= 0) releaseRef(targetPath);
+    if ((int)refs.size() >= MAX_CONTENT_REFS) return false;
+
+    int bi = findBlob(digestHex);
+    if (bi >= 0) {
+        // same bytes already stored: the new copy is redundant
+        addRef(targetPath, bi);
+        save();
+        hotCacheInvalidate(targetPath);
+        SPIFFS.remove(targetPath);
+        stats.deduplicated++;
+        stats.bytesSaved += blobs[bi].size;
+        return true;
+    }
+
+    if ((int)blobs.size() >= MAX_CONTENT_BLOBS) return false;
+    File f = SPIFFS.open(targetPath, FILE_READ);
+    size_t size = f ? f.size() : 0;
+    f.close();
+    String blob = blobPath(digestHex);
+    if (SPIFFS.exists(blob)) SPIFFS.remove(blob); // unindexed leftover
+    Blob b;
+    b.digest = digestHex;
+    b.size = size;
+    b.refs = 0;
+    blobs.push_back(b);
+    addRef(targetPath, blobs.size() - 1);
+    save();
+
+    hotCacheInvalidate(targetPath);
+    if (!SPIFFS.rename(targetPath, blob)) {
+        Serial.println("Content store: cannot move " + targetPath + " to " + blob);
+        refs.pop_back();
+        blobs.pop_back();
+        save();
+        return false;
+    }
+    stats.adopted++;
+    return true;
+}
+
+bool ContentStore::release(const String& targetPath) {
+    Guard g(lock);
+    return releaseRef(targetPath);
+}
+
+bool ContentStore::releaseRef(const String& targetPath) {
+    int ri = findRef(targetPath);
+    if (ri < 0) return false;
+
+    int bi = findBlob(refs[ri].digest);
+    refs.erase(refs.begin() + ri);
+    if (bi >= 0 && --blobs[bi].refs <= 0) {
+        String blob = blobPath(blobs[bi].digest);
+        hotCacheInvalidate(blob);
+        SPIFFS.remove(blob);
+        blobs.erase(blobs.begin() + bi);
+        stats.blobsFreed++;
+    }
+    save();
+    return true;
+}
+
+ContentStoreStats ContentStore::getStats() const {
+    Guard g(lock);
+    return stats;
+}
+
+void ContentStore::printStats() const {
+    Guard g(lock);
+    size_t stored = 0, logical = 0;
+    for (const auto& b : blobs) {
+        stored += b.size;
+        logical += b.size * b.refs;
+    }
+    Serial.println("\n=== CONTENT STORE ===");
+    Serial.println("Blobs: " + String((unsigned)blobs.size()) + ", references: " + String((unsigned)refs.size()));
+    Serial.println("On flash: " + PerformanceMonitor::formatBytes(stored) + " for " + PerformanceMonitor::formatBytes(logical) + " of referenced files");
+    Serial.println("Adopted: " + String((unsigned)stats.adopted) + ", deduplicated: " + String((unsigned)stats.deduplicated) +
+                   ", linked without download: " + String((unsigned)stats.linkedHits));
+    Serial.println("Bytes saved: " + PerformanceMonitor::formatBytes(stats.bytesSaved) + ", blobs freed: " + String((unsigned)stats.blobsFreed));
+    Serial.println("=====================\n");
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Content-addressed store: downloaded files are kept once per SHA-256 under /cas/, and target
+// paths become references to the shared blob. A reference has no file of its own on SPIFFS;
+// read it through readFromSPIFFS() or resolveSPIFFSPath(). Deleting the last reference frees the blob.
+// All public methods lock: engines, the file server, the peer service and the uploader share one store.
+
+const int MAX_CONTENT_BLOBS = 64;
+const int MAX_CONTENT_REFS = 128;
+
+struct ContentStoreStats {
+size_t adopted;         // downloads moved into the store as a new blob
+size_t deduplicated;    // downloads dropped because the blob was already there
+size_t linkedHits;      // downloads satisfied by linking, no network I/O
+size_t bytesSaved;      // flash not spent on duplicate copies (dedup + linked hits)
+size_t blobsFreed;
+ContentStoreStats() : adopted(0), deduplicated(0), linkedHits(0), bytesSaved(0), blobsFreed(0) {}
+};
+
+class ContentStore {
+public:
+ContentStore();
+
+bool begin();   // load /cas/.index, dropping blobs whose file vanished and files shadowed by a reference
+
+// Does the store hold this content (hex SHA-256)?
+bool hasContent(const String& digestHex) const;
+size_t contentSize(const String& digestHex) const;
+
+// Make targetPath a reference to existing content; no bytes are copied
+bool link(const String& targetPath, const String& digestHex);
+// Take a finished file with known digest into the store: becomes the blob, or is deleted
+// when the blob already exists. targetPath is a reference afterwards.
+bool adopt(const String& targetPath, const String& digestHex);
+// Drop targetPath's reference; the blob goes with its last reference. False if not a reference.
+bool release(const String& targetPath);
+
+bool isReference(const String& path) const;
+// Blob path behind a reference, or path itself
+String resolve(const String& path) const;
+
+ContentStoreStats getStats() const;
+void printStats() const;
+
+private:
+struct Blob {
+    String digest;
+    size_t size;
+    int refs;
+};
+struct Ref {
+    String path;
+    String digest;
+};
+
+std::vector<Blob> blobs;
+std::vector<Ref> refs;
+ContentStoreStats stats;
+SemaphoreHandle_t lock;
+
+static String blobPath(const String& digestHex);
+int findBlob(const String& digestHex) const;
+int findRef(const String& path) const;
+void addRef(const String& path, int blobIndex);
+bool releaseRef(const String& targetPath);   // release() without taking the lock
+bool save();
+};
@@ -0,0 +1,103 @@
+#include "crash_counters.h"
+#include <FS.h>
+#include <SPIFFS.h>
+
+namespace {
+const char* CRASH_LOG_PATH = "/crash_log.txt";
+const size_t CRASH_LOG_MAX_BYTES = 8192;
+
+const char* phaseName(uint8_t phase) {
+    switch (phase) {
+    case PHASE_IDLE: return "idle";
+    case PHASE_CONNECTING: return "connecting";
+    case PHASE_STREAMING: return "streaming";
+    case PHASE_FINISHING: return "finishing";
+    default: return "?";
+    }
+}
+
+const char* resetReasonName(esp_reset_reason_t r) {
+    switch (r) {
+    case ESP_RST_POWERON: return "power-on";
+    case ESP_RST_EXT: return "external";
+    case ESP_RST_SW: return "software";
+    case ESP_RST_PANIC: return "panic";
+    case ESP_RST_INT_WDT: return "interrupt watchdog";
+    case ESP_RST_TASK_WDT: return "task watchdog";
+    case ESP_RST_WDT: return "watchdog";
+    case ESP_RST_DEEPSLEEP: return "deep sleep";
+    case ESP_RST_BROWNOUT: return "brownout";
+    default: return "unknown";
+    }
+}
+}
+
+// not zeroed by the startup code; validated by magic instead
+RTC_NOINIT_ATTR CrashCounters crashCounters;
+
+void reportCrashCounters() {
+    esp_reset_reason_t reason = esp_reset_reason();
+    // power-on leaves RTC memory as garbage; anything else keeps our last stores
+    bool valid = crashCounters.magic == CRASH_COUNTERS_MAGIC && reason != ESP_RST_POWERON && reason != ESP_RST_BROWNOUT;
+
+    if (valid && crashCounters.phase != PHASE_IDLE) {
+        crashCounters.url[CRASH_COUNTERS_URL_SIZE - 1] = '\0';
+        uint32_t elapsed = crashCounters.lastChunkMs - crashCounters.jobStartMs;
+        uint32_t gap = crashCounters.prevChunkMs > 0 ? crashCounters.lastChunkMs - crashCounters.prevChunkMs : 0;
+
+        String line = "reset=" + String(resetReasonName(reason)) + " phase=" + phaseName(crashCounters.phase) +
+                      " url=" + String(crashCounters.url) + " bytes=" + String(crashCounters.bytes) + "/" +
+                      String(crashCounters.expectedBytes) + " chunks=" + String(crashCounters.chunks) +
+                      " lastChunkAt=" + String(elapsed) + "ms lastGap=" + String(gap) + "ms heapLow=" +
+                      String(crashCounters.heapLowWater) + " resets=" + String(crashCounters.resets + 1);
+
+        Serial.println("=== INTERRUPTED DOWNLOAD ===");
+        Serial.println("Reset reason: " + String(resetReasonName(reason)));
+        Serial.println("Phase: " + String(phaseName(crashCounters.phase)) + ", URL: " + String(crashCounters.url));
+        Serial.println("Bytes: " + String(crashCounters.bytes) + " of " + String(crashCounters.expectedBytes) +
+                       " in " + String(crashCounters.chunks) + " chunks");
+        Serial.println("Last chunk " + String(elapsed) + " ms into the job, " + String(gap) + " ms after the one before");
+        Serial.println("Heap low-water: " + String(crashCounters.heapLowWater) + " bytes");
+        Serial.println("============================");
+
+        // keep the log bounded: start over rather than fill flash with crash history
+        bool fresh = false;
+        File existing = SPIFFS.open(CRASH_LOG_PATH, FILE_READ);
+        if (existing) {
+            fresh = existing.size() > CRASH_LOG_MAX_BYTES;
+            existing.close();
+        }
+        File f = SPIFFS.open(CRASH_LOG_PATH, fresh ? FILE_WRITE : FILE_APPEND);
+        if (f) {
+            f.println(line);
+            f.close();
+        }
+    }
+
+    uint32_t resets = valid ? crashCounters.resets + 1 : 0;
+    memset(&crashCounters, 0, sizeof(crashCounters));
+    crashCounters.resets = resets;
+    crashCounters.magic = CRASH_COUNTERS_MAGIC;
+}
+
+void crashCountersBeginJob(const String& url, size_t expectedBytes) {
+    // keep the tail: the file name is the useful part of a long URL
+    const char* src = url.c_str();
+    size_t len = url.length();
+    if (len >= CRASH_COUNTERS_URL_SIZE) src += len - (CRASH_COUNTERS_URL_SIZE - 1);
+    strncpy(crashCounters.url, src, CRASH_COUNTERS_URL_SIZE - 1);
+    crashCounters.url[CRASH_COUNTERS_URL_SIZE - 1] = '\0';
+
+    crashCounters.bytes = 0;
+    crashCounters.expectedBytes = expectedBytes;
+    crashCounters.chunks = 0;
+    crashCounters.jobStartMs = millis();
+    crashCounters.lastChunkMs = crashCounters.jobStartMs;
+    crashCounters.prevChunkMs = 0;
+    crashCounters.heapLowWater = esp_get_free_heap_size();
+    crashCounters.phase = PHASE_CONNECTING;
+}
+
+void crashCountersEndJob() {
+    crashCounters.phase = PHASE_IDLE;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+
+// Download counters kept in RTC slow memory (RTC_NOINIT), which survives watchdog, panic and
+// software resets. The engines update them per chunk with plain stores; the next boot reports
+// what the interrupted download was doing and appends it to CRASH_LOG_PATH.
+
+enum DownloadPhase : uint8_t {
+PHASE_IDLE = 0,
+PHASE_CONNECTING,
+PHASE_STREAMING,
+PHASE_FINISHING
+};
+
+const uint32_t CRASH_COUNTERS_MAGIC = 0x56444c31; // "VDL1"
+const size_t CRASH_COUNTERS_URL_SIZE = 64;
+
+struct CrashCounters {
+uint32_t magic;
+uint32_t resets;            // boots that found the block already valid
+uint8_t phase;              // DownloadPhase
+char url[CRASH_COUNTERS_URL_SIZE];   // tail of the URL if it is longer
+uint32_t bytes;             // bytes on flash for the current job
+uint32_t expectedBytes;     // 0 when unknown
+uint32_t chunks;
+uint32_t jobStartMs;        // millis() when the job started
+uint32_t lastChunkMs;
+uint32_t prevChunkMs;       // with lastChunkMs: the last inter-chunk gap before the reset
+uint32_t heapLowWater;      // lowest free heap seen during the job
+};
+
+extern CrashCounters crashCounters;
+
+// Call once early in setup(): reports (and logs) a download that was cut short by a reset
+void reportCrashCounters();
+
+void crashCountersBeginJob(const String& url, size_t expectedBytes);
+void crashCountersEndJob();
+
+inline void crashCountersPhase(DownloadPhase phase) {
+    crashCounters.phase = phase;
+}
+
+// Hot path: a handful of word stores, no locks and no flash
+inline void crashCountersChunk(size_t bytesOnFlash) {
+    uint32_t now = millis();
+    crashCounters.prevChunkMs = crashCounters.lastChunkMs;
+    crashCounters.lastChunkMs = now;
+    crashCounters.bytes = bytesOnFlash;
+    crashCounters.chunks++;
+    uint32_t freeHeap = esp_get_free_heap_size();
+    if (freeHeap < crashCounters.heapLowWater) crashCounters.heapLowWater = freeHeap;
+}
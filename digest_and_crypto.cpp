@@ -0,0 +1,290 @@
+#include "digest_and_crypto.h"
+#include <FS.h>
+#include <SPIFFS.h>
+#include <mbedtls/version.h>
+
+// mbedtls 2.x (IDF 4.x) only has the *_ret variants as non-deprecated API
+#if MBEDTLS_VERSION_MAJOR >= 3
+#define SHA256_STARTS mbedtls_sha256_starts
+#define SHA256_UPDATE mbedtls_sha256_update
+#define SHA256_FINISH mbedtls_sha256_finish
+#else
+#define SHA256_STARTS mbedtls_sha256_starts_ret
+#define SHA256_UPDATE mbedtls_sha256_update_ret
+#define SHA256_FINISH mbedtls_sha256_finish_ret
+#endif
+
+StreamingDigest::StreamingDigest() : active(false), bytesHashed(0) {
+    mbedtls_sha256_init(&ctx);
+}
+
+StreamingDigest::~StreamingDigest() {
+    mbedtls_sha256_free(&ctx);
+}
+
+void StreamingDigest::begin() {
+    mbedtls_sha256_free(&ctx);
+    mbedtls_sha256_init(&ctx);
+    SHA256_STARTS(&ctx, 0);
+    active = true;
+    bytesHashed = 0;
+}
+
+void StreamingDigest::update(const uint8_t* data, size_t len) {
+    if (!active || len == 0) return;
+    SHA256_UPDATE(&ctx, data, len);
+    bytesHashed += len;
+}
+
+void StreamingDigest::finish(uint8_t* out) {
+    if (!active) {
+        memset(out, 0, CONTENT_DIGEST_SIZE);
+        return;
+    }
+    SHA256_FINISH(&ctx, out);
+    active = false;
+}
+
+bool StreamingDigest::updateFromFile(const String& path, size_t maxBytes) {
+    File f = SPIFFS.open(path, FILE_READ);
+    if (!f) return false;
+
+    uint8_t buf[1024];
+    size_t remaining = maxBytes;
+    while (remaining > 0) {
+        size_t n = f.read(buf, min(remaining, sizeof(buf)));
+        if (n == 0) break;
+        update(buf, n);
+        remaining -= n;
+    }
+    f.close();
+    return remaining == 0 || maxBytes == SIZE_MAX;
+}
+
+String StreamingDigest::toHex(const uint8_t* digest) {
+    char hex[CONTENT_DIGEST_SIZE * 2 + 1];
+    for (size_t i = 0; i < CONTENT_DIGEST_SIZE; ++i) {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+    return String(hex);
+}
+
+bool StreamingDigest::fromHex(const String& hex, uint8_t* out) {
+    if (hex.length() != CONTENT_DIGEST_SIZE * 2) return false;
+    for (size_t i = 0; i < CONTENT_DIGEST_SIZE; ++i) {
+        char pair[3] = { hex[i * 2], hex[i * 2 + 1], '\0' };
+        char* end = nullptr;
+        out[i] = (uint8_t)strtoul(pair, &end, 16);
+        if (end != pair + 2) return false;
+    }
+    return true;
+}
+
+bool StreamingDigest::digestFile(const String& path, uint8_t* out) {
+    StreamingDigest d;
+    d.begin();
+    if (!d.updateFromFile(path, SIZE_MAX)) return false;
+    d.finish(out);
+    return true;
+}
+
+// ---- StreamCipher ----
+
+namespace {
+const uint8_t CIPHER_MAGIC[4] = { 'V', 'D', 'E', '2' };
+const char* CIPHER_MAC_LABEL = "VDE2 mac key";
+}
+
+StreamCipher::StreamCipher() : streamOffset(0), keyed(false) {
+    mbedtls_aes_init(&aes);
+    mbedtls_md_init(&mac);
+    memset(macKey, 0, sizeof(macKey));
+    memset(nonce, 0, sizeof(nonce));
+    memset(counter, 0, sizeof(counter));
+    memset(streamBlock, 0, sizeof(streamBlock));
+}
+
+StreamCipher::~StreamCipher() {
+    mbedtls_aes_free(&aes);
+    mbedtls_md_free(&mac);
+    memset(macKey, 0, sizeof(macKey));
+}
+
+bool StreamCipher::setKey(const uint8_t* key) {
+    mbedtls_aes_free(&aes);
+    mbedtls_aes_init(&aes);
+    memset(macKey, 0, sizeof(macKey));
+    keyed = key && mbedtls_aes_setkey_enc(&aes, key, CIPHER_KEY_SIZE * 8) == 0;
+    if (keyed) {
+        // separate MAC key so the AES key is used for one purpose only
+        keyed = mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), key, CIPHER_KEY_SIZE,
+                                (const uint8_t*)CIPHER_MAC_LABEL, strlen(CIPHER_MAC_LABEL), macKey) == 0;
+    }
+    return keyed || !key;
+}
+
+void StreamCipher::macBegin(const uint8_t* header) {
+    mbedtls_md_free(&mac);
+    mbedtls_md_init(&mac);
+    mbedtls_md_setup(&mac, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+    mbedtls_md_hmac_starts(&mac, macKey, sizeof(macKey));
+    mbedtls_md_hmac_update(&mac, header, CIPHER_HEADER_SIZE);
+}
+
+void StreamCipher::macUpdate(const uint8_t* ciphertext, size_t len) {
+    if (len > 0) mbedtls_md_hmac_update(&mac, ciphertext, len);
+}
+
+void StreamCipher::macFinish(uint8_t* tag) {
+    mbedtls_md_hmac_finish(&mac, tag);
+}
+
+void StreamCipher::beginNew(uint8_t* header) {
+    for (size_t i = 0; i < CIPHER_NONCE_SIZE; i += 4) {
+        uint32_t r = esp_random();
+        memcpy(nonce + i, &r, min((size_t)4, CIPHER_NONCE_SIZE - i));
+    }
+    memcpy(header, CIPHER_MAGIC, sizeof(CIPHER_MAGIC));
+    memcpy(header + sizeof(CIPHER_MAGIC), nonce, CIPHER_NONCE_SIZE);
+    seek(0);
+}
+
+bool StreamCipher::beginExisting(const uint8_t* header, size_t plainOffset) {
+    if (memcmp(header, CIPHER_MAGIC, sizeof(CIPHER_MAGIC)) != 0) return false;
+    memcpy(nonce, header + sizeof(CIPHER_MAGIC), CIPHER_NONCE_SIZE);
+    seek(plainOffset);
+    return true;
+}
+
+void StreamCipher::seek(size_t plainOffset) {
+    // counter block = nonce || big-endian block index
+    uint32_t block = plainOffset / 16;
+    memcpy(counter, nonce, CIPHER_NONCE_SIZE);
+    counter[12] = block >> 24;
+    counter[13] = block >> 16;
+    counter[14] = block >> 8;
+    counter[15] = block;
+    streamOffset = 0;
+
+    // mid-block: burn the leading keystream bytes so the next apply() lines up
+    size_t skip = plainOffset % 16;
+    if (skip > 0) {
+        uint8_t scratch[16] = { 0 };
+        apply(scratch, skip);
+    }
+}
+
+void StreamCipher::apply(uint8_t* data, size_t len) {
+    if (!keyed || len == 0) return;
+    mbedtls_aes_crypt_ctr(&aes, len, &streamOffset, counter, streamBlock, data, data);
+}
+
+bool StreamCipher::isHardwareAccelerated() {
+#if defined(CONFIG_MBEDTLS_HARDWARE_AES) || defined(MBEDTLS_AES_ALT)
+    return true;
+#else
+    return false;
+#endif
+}
+
+float StreamCipher::measureThroughputMBps(size_t totalBytes) {
+    const size_t bufSize = 4096;
+    uint8_t* buf = (uint8_t*)malloc(bufSize);
+    if (!buf) return 0.0f;
+    memset(buf, 0xA5, bufSize);
+
+    uint8_t key[CIPHER_KEY_SIZE];
+    uint8_t header[CIPHER_HEADER_SIZE];
+    memset(key, 0x5A, sizeof(key));
+    StreamCipher c;
+    c.setKey(key);
+    c.beginNew(header);
+
+    unsigned long start = micros();
+    for (size_t done = 0; done < totalBytes; done += bufSize) {
+        c.apply(buf, min(bufSize, totalBytes - done));
+    }
+    unsigned long us = micros() - start;
+    free(buf);
+    return us > 0 ? (float)totalBytes / us : 0.0f; // bytes/us == MB/s
+}
+
+// ---- EncryptedFileReader ----
+
+EncryptedFileReader::EncryptedFileReader() : plainSize(0), pos(0) {
+}
+
+EncryptedFileReader::~EncryptedFileReader() {
+    close();
+}
+
+bool EncryptedFileReader::open(const String& path, const uint8_t* key) {
+    close();
+    if (!key) return false;   // without a key we could only hand back ciphertext
+    file = SPIFFS.open(path, FILE_READ);
+    if (!file) return false;
+
+    uint8_t header[CIPHER_HEADER_SIZE];
+    if (file.size() < CIPHER_HEADER_SIZE + CIPHER_TAG_SIZE || file.read(header, sizeof(header)) != sizeof(header) ||
+        !cipher.setKey(key) || !cipher.beginExisting(header, 0)) {
+        Serial.println("Not an encrypted file: " + path);
+        close();
+        return false;
+    }
+    size_t cipherSize = file.size() - CIPHER_HEADER_SIZE - CIPHER_TAG_SIZE;
+
+    // check the tag before releasing any plaintext
+    uint8_t buf[512];
+    cipher.macBegin(header);
+    for (size_t done = 0; done < cipherSize;) {
+        size_t n = file.read(buf, min(sizeof(buf), cipherSize - done));
+        if (n == 0) break;
+        cipher.macUpdate(buf, n);
+        done += n;
+    }
+    uint8_t expected[CIPHER_TAG_SIZE], stored[CIPHER_TAG_SIZE];
+    cipher.macFinish(expected);
+    uint8_t diff = file.read(stored, sizeof(stored)) == sizeof(stored) ? 0 : 1;
+    for (size_t i = 0; i < CIPHER_TAG_SIZE; ++i) diff |= expected[i] ^ stored[i];
+    if (diff != 0 || !file.seek(CIPHER_HEADER_SIZE)) {
+        Serial.println("Encrypted file failed authentication (wrong key or modified): " + path);
+        close();
+        return false;
+    }
+    plainSize = cipherSize;
+    pos = 0;
+    return true;
+}
+
+size_t EncryptedFileReader::read(uint8_t* buf, size_t len) {
+    if (!file) return 0;
+    len = min(len, plainSize - pos);   // never hand out the tag
+    size_t n = file.read(buf, len);
+    cipher.apply(buf, n);
+    pos += n;
+    return n;
+}
+
+bool EncryptedFileReader::seek(size_t plainOffset) {
+    if (!file || plainOffset > plainSize) return false;
+    if (!file.seek(CIPHER_HEADER_SIZE + plainOffset)) return false;
+    cipher.seek(plainOffset);
+    pos = plainOffset;
+    return true;
+}
+
+void EncryptedFileReader::close() {
+    if (file) file.close();
+    cipher.setKey(nullptr);
+    plainSize = 0;
+    pos = 0;
+}
+
+bool EncryptedFileReader::isEncryptedFile(const String& path) {
+    File f = SPIFFS.open(path, FILE_READ);
+    if (!f) return false;
+    uint8_t magic[sizeof(CIPHER_MAGIC)];
+    bool ok = f.read(magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, CIPHER_MAGIC, sizeof(magic)) == 0;
+    f.close();
+    return ok;
+}
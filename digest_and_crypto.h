@@ -0,0 +1,107 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/aes.h>
+#include <mbedtls/md.h>
+
+// Content digests used to verify downloads (SHA-256) and at-rest encryption (AES-256-CTR + HMAC-SHA256).
+// Both go through mbedtls, which uses the ESP32 SHA/AES accelerators and plain software elsewhere.
+
+const size_t CONTENT_DIGEST_SIZE = 32;
+
+// Incremental SHA-256: feed chunks as they stream past, finish once at the end
+class StreamingDigest {
+private:
+mbedtls_sha256_context ctx;
+bool active;
+size_t bytesHashed;
+
+public:
+StreamingDigest();
+~StreamingDigest();
+
+void begin();
+void update(const uint8_t* data, size_t len);
+// writes CONTENT_DIGEST_SIZE bytes; the digest must be begin()-ed again before reuse
+void finish(uint8_t* out);
+bool isActive() const { return active; }
+size_t getBytesHashed() const { return bytesHashed; }
+
+// Hash the first maxBytes of a SPIFFS file into an already begun digest (used when resuming)
+bool updateFromFile(const String& path, size_t maxBytes);
+
+// helpers for the hex form we log, persist and put on the wire
+static String toHex(const uint8_t* digest);
+static bool fromHex(const String& hex, uint8_t* out);
+static bool digestFile(const String& path, uint8_t* out);
+};
+
+const size_t CIPHER_KEY_SIZE = 32;     // AES-256
+const size_t CIPHER_NONCE_SIZE = 12;
+const size_t CIPHER_HEADER_SIZE = 16;  // "VDE2" + nonce, written at the start of every encrypted file
+const size_t CIPHER_TAG_SIZE = 32;     // HMAC-SHA256(header || ciphertext), written at the end
+
+// AES-CTR keystream: the same apply() encrypts and decrypts, and any plaintext offset can be
+// reached directly, so random-access reads need no re-encryption. CTR alone does not detect
+// tampering or a wrong key, so writers MAC the ciphertext (encrypt-then-MAC) into a trailer.
+class StreamCipher {
+private:
+mbedtls_aes_context aes;
+mbedtls_md_context_t mac;
+uint8_t macKey[32];         // derived from the AES key, never the key itself
+uint8_t nonce[CIPHER_NONCE_SIZE];
+uint8_t counter[16];
+uint8_t streamBlock[16];
+size_t streamOffset;
+bool keyed;
+
+public:
+StreamCipher();
+~StreamCipher();
+
+bool setKey(const uint8_t* key);   // CIPHER_KEY_SIZE bytes; nullptr clears it
+bool hasKey() const { return keyed; }
+
+// New file: pick a random nonce and fill the header to write before the ciphertext
+void beginNew(uint8_t* header);
+// Existing file: take the nonce from its header and position at plainOffset
+bool beginExisting(const uint8_t* header, size_t plainOffset);
+void seek(size_t plainOffset);
+
+// XOR the keystream over data in place
+void apply(uint8_t* data, size_t len);
+
+// Tag over header || ciphertext: begin with the header, feed ciphertext in file order
+void macBegin(const uint8_t* header);
+void macUpdate(const uint8_t* ciphertext, size_t len);
+void macFinish(uint8_t* tag);   // CIPHER_TAG_SIZE bytes
+
+static bool isHardwareAccelerated();
+// Keystream throughput over an in-memory buffer, MB/s (the crypto-only part of the pipeline)
+static float measureThroughputMBps(size_t totalBytes = 256 * 1024);
+};
+
+// Decrypting read path for files written with a StreamCipher header
+class EncryptedFileReader {
+private:
+File file;
+StreamCipher cipher;
+size_t plainSize;           // ciphertext between header and tag
+size_t pos;
+
+public:
+EncryptedFileReader();
+~EncryptedFileReader();
+
+// Fails without a key, on a plaintext file, and when the tag does not match (wrong key or
+// modified file); the whole file is read once to check the tag before any plaintext is returned
+bool open(const String& path, const uint8_t* key);
+size_t read(uint8_t* buf, size_t len);
+bool seek(size_t plainOffset);
+size_t size() const { return plainSize; }
+size_t position() const { return pos; }
+void close();
+
+static bool isEncryptedFile(const String& path);
+};
@@ -0,0 +1,274 @@
+#include "download_cache.h"
+#include <FS.h>
+#include <SPIFFS.h>
+#include "spiffs_management.h"
+#include "buffer_and_performance.h"
+
+namespace {
+const char* CACHE_INDEX_PATH = "/.cache_index";
+
+struct Guard {
+    SemaphoreHandle_t m;
+    explicit Guard(SemaphoreHandle_t m) : m(m) { xSemaphoreTake(m, portMAX_DELAY); }
+    ~Guard() { xSemaphoreGive(m); }
+};
+}
+
+DownloadCache::DownloadCache()
+: evictedNext(0), clock(0), costWeight(0.0f), dirty(false), lock(xSemaphoreCreateMutex()) {
+}
+
+bool DownloadCache::begin() {
+    Guard g(lock);
+    entries.clear();
+    clock = 0;
+
+    File f = SPIFFS.open(CACHE_INDEX_PATH, FILE_READ);
+    if (!f) return true; // first boot: empty cache
+
+    // <pinned> <size> <lastAccess> <costMs> <hits> <path> <url>
+    while (f.available() && (int)entries.size() < MAX_CACHE_ENTRIES) {
+        String line = f.readStringUntil('\n');
+        line.trim();
+        if (line.length() == 0) continue;
+
+        CacheEntry e;
+        char path[64];
+        unsigned pinned = 0, size = 0, last = 0, cost = 0, hits = 0;
+        int consumed = 0;
+        if (sscanf(line.c_str(), "%u %u %u %u %u %63s %n", &pinned, &size, &last, &cost, &hits, path, &consumed) < 6) continue;
+        e.pinned = pinned != 0;
+        e.size = size;
+        e.lastAccess = last;
+        e.refetchCostMs = cost;
+        e.hits = hits;
+        e.path = path;
+        e.url = consumed > 0 ? line.substring(consumed) : String("");
+
+        if (!SPIFFS.exists(e.path)) {
+            dirty = true;
+            continue;
+        }
+        if (e.lastAccess > clock) clock = e.lastAccess;
+        entries.push_back(e);
+    }
+    f.close();
+
+    if (dirty) save();
+    Serial.println("Download cache: " + String((unsigned)entries.size()) + " entries");
+    return true;
+}
+
+bool DownloadCache::save() {
+    File f = SPIFFS.open(CACHE_INDEX_PATH, FILE_WRITE);
+    if (!f) return false;
+    for (const auto& e : entries) {
+        f.printf("%u %u %u %u %u %s %s\n", e.pinned ? 1u : 0u, (unsigned)e.size, (unsigned)e.lastAccess,
+                 (unsigned)e.refetchCostMs, (unsigned)e.hits, e.path.c_str(), e.url.c_str());
+    }
+    f.close();
+    dirty = false;
+    return true;
+}
+
+void DownloadCache::flush() {
+    Guard g(lock);
+    if (dirty) save();
+}
+
+int DownloadCache::find(const String& path) const {
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].path == path) return (int)i;
+    }
+    return -1;
+}
+
+void DownloadCache::registerDownload(const String& url, const String& path, size_t size, unsigned long fetchTimeMs) {
+    Guard g(lock);
+    int i = find(path);
+    if (i < 0) {
+        if ((int)entries.size() >= MAX_CACHE_ENTRIES) {
+            // index full: forget (but do not delete) the coldest unpinned entry
+            int victim = pickVictim();
+            if (victim < 0) return;
+            entries.erase(entries.begin() + victim);
+        }
+        CacheEntry e;
+        e.path = path;
+        e.hits = 0;
+        e.pinned = false;
+        entries.push_back(e);
+        i = entries.size() - 1;
+    }
+    CacheEntry& e = entries[i];
+    e.url = url;
+    e.size = size;
+    e.refetchCostMs = fetchTimeMs;
+    e.lastAccess = ++clock;
+    save();
+}
+
+bool DownloadCache::lookup(const String& path) {
+    Guard g(lock);
+    stats.lookups++;
+    int i = find(path);
+    if (i >= 0 && SPIFFS.exists(path)) {
+        stats.hits++;
+        entries[i].hits++;
+        entries[i].lastAccess = ++clock;
+        dirty = true;
+        return true;
+    }
+    countMiss(path);
+    return false;
+}
+
+void DownloadCache::touch(const String& path) {
+    Guard g(lock);
+    int i = find(path);
+    if (i < 0) return;
+    stats.lookups++;
+    stats.hits++;
+    entries[i].hits++;
+    entries[i].lastAccess = ++clock;
+    dirty = true;
+}
+
+void DownloadCache::recordMiss(const String& path) {
+    Guard g(lock);
+    stats.lookups++;
+    countMiss(path);
+}
+
+void DownloadCache::countMiss(const String& path) {
+    stats.misses++;
+    for (int k = 0; k < CACHE_EVICTION_MEMORY; ++k) {
+        if (recentlyEvicted[k].length() > 0 && recentlyEvicted[k] == path) {
+            stats.evictionMisses++;
+            recentlyEvicted[k] = "";
+            break;
+        }
+    }
+}
+
+void DownloadCache::remove(const String& path) {
+    Guard g(lock);
+    int i = find(path);
+    if (i < 0) return;
+    entries.erase(entries.begin() + i);
+    save();
+}
+
+bool DownloadCache::pin(const String& path) {
+    Guard g(lock);
+    int i = find(path);
+    if (i < 0) return false;
+    entries[i].pinned = true;
+    save();
+    return true;
+}
+
+bool DownloadCache::unpin(const String& path) {
+    Guard g(lock);
+    int i = find(path);
+    if (i < 0) return false;
+    entries[i].pinned = false;
+    save();
+    return true;
+}
+
+bool DownloadCache::isPinned(const String& path) const {
+    Guard g(lock);
+    int i = find(path);
+    return i >= 0 && entries[i].pinned;
+}
+
+int DownloadCache::pickVictim(const String& keep) const {
+    // mean cost normalizes the weighting so it does not depend on link speed
+    float meanCost = 0.0f;
+    int candidates = 0;
+    for (const auto& e : entries) {
+        if (e.pinned || e.path == keep) continue;
+        meanCost += e.refetchCostMs;
+        candidates++;
+    }
+    if (candidates == 0) return -1;
+    meanCost = meanCost / candidates + 1.0f;
+
+    int victim = -1;
+    float bestScore = -1.0f;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const CacheEntry& e = entries[i];
+        if (e.pinned || e.path == keep) continue;
+        float age = (float)(clock - e.lastAccess) + 1.0f;
+        float score = age / (1.0f + costWeight * (e.refetchCostMs / meanCost));
+        if (score > bestScore) {
+            bestScore = score;
+            victim = (int)i;
+        }
+    }
+    return victim;
+}
+
+bool DownloadCache::ensureSpace(size_t requiredBytes, const String& keep) {
+    Guard g(lock);
+    while (!checkSPIFFSSpace(requiredBytes)) {
+        int victim = pickVictim(keep);
+        if (victim < 0) {
+            Serial.println("Download cache: nothing left to evict for " + String((unsigned)requiredBytes) + " bytes");
+            stats.spaceFailures++;
+            if (dirty) save();
+            return false;
+        }
+
+        CacheEntry e = entries[victim];
+        entries.erase(entries.begin() + victim);
+        hotCacheInvalidate(e.path);
+        peerCacheForget(e.path);
+        if (SPIFFS.exists(e.path) && !SPIFFS.remove(e.path)) {
+            Serial.println("Download cache: failed to evict " + e.path);
+            continue;
+        }
+        Serial.println("Evicted " + e.path + " (" + PerformanceMonitor::formatBytes(e.size) + ", idle " +
+                       String((unsigned)(clock - e.lastAccess)) + " accesses)");
+        stats.evictions++;
+        stats.bytesEvicted += e.size;
+        recentlyEvicted[evictedNext] = e.path;
+        evictedNext = (evictedNext + 1) % CACHE_EVICTION_MEMORY;
+        dirty = true;
+    }
+    if (dirty) save();
+    return true;
+}
+
+CacheStats DownloadCache::getStats() const {
+    Guard g(lock);
+    return stats;
+}
+
+float DownloadCache::getHitRatio() const {
+    Guard g(lock);
+    return stats.lookups > 0 ? (float)stats.hits / stats.lookups : 0.0f;
+}
+
+void DownloadCache::printStats() const {
+    Guard g(lock);
+    size_t total = 0, pinnedBytes = 0;
+    for (const auto& e : entries) {
+        total += e.size;
+        if (e.pinned) pinnedBytes += e.size;
+    }
+    Serial.println("=== DOWNLOAD CACHE ===");
+    Serial.println("Entries: " + String((unsigned)entries.size()) + " (" + PerformanceMonitor::formatBytes(total) +
+                   ", pinned " + PerformanceMonitor::formatBytes(pinnedBytes) + ")");
+    Serial.printf("Lookups: %u, hits: %u, hit ratio: %.1f%%\n", (unsigned)stats.lookups, (unsigned)stats.hits,
+                  stats.lookups > 0 ? stats.hits * 100.0f / stats.lookups : 0.0f);
+    Serial.println("Evictions: " + String((unsigned)stats.evictions) + ", bytes evicted: " + PerformanceMonitor::formatBytes(stats.bytesEvicted));
+    if (stats.lookups > 0) {
+        // hit ratio we would have had if the evicted files had stayed
+        Serial.printf("Eviction misses: %u (hit ratio cost %.1f%%)\n", (unsigned)stats.evictionMisses,
+                      stats.evictionMisses * 100.0f / stats.lookups);
+    }
+    Serial.println("Space failures: " + String((unsigned)stats.spaceFailures));
+    Serial.println("======================");
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Space-aware cache bookkeeping for downloaded files.
+// Files registered here are evictable unless pinned; when a download needs room the coldest
+// entries (LRU by a persisted logical clock, optionally weighted by re-fetch cost) go first.
+// Thread-safe: the DualCore network task registers downloads while readers touch entries.
+
+const int MAX_CACHE_ENTRIES = 64;
+const int CACHE_EVICTION_MEMORY = 16;     // recently evicted paths remembered to measure regret
+
+struct CacheEntry {
+String path;
+String url;
+size_t size;
+uint32_t lastAccess;      // logical clock, survives reboots unlike millis()
+uint32_t refetchCostMs;   // how long the last download took
+uint16_t hits;
+bool pinned;
+};
+
+struct CacheStats {
+size_t lookups;
+size_t hits;
+size_t misses;
+size_t evictions;
+size_t bytesEvicted;
+size_t evictionMisses;    // misses on files we evicted ourselves: the hit ratio we gave up
+size_t spaceFailures;     // ensureSpace() could not free enough
+CacheStats() : lookups(0), hits(0), misses(0), evictions(0), bytesEvicted(0), evictionMisses(0), spaceFailures(0) {}
+};
+
+class DownloadCache {
+public:
+DownloadCache();
+
+bool begin();   // load the persisted index, dropping entries whose files vanished
+void flush();   // persist access times (kept in RAM between flushes)
+
+// Record a finished download as an evictable entry
+void registerDownload(const String& url, const String& path, size_t size, unsigned long fetchTimeMs);
+// Count a hit/miss for path and refresh its access time; true when the file is present
+bool lookup(const String& path);
+// A read of path: a hit when it is a cached entry (readers call this through downloadCacheTouch)
+void touch(const String& path);
+// path is about to be fetched from the network: a miss, and an eviction miss if we evicted it
+void recordMiss(const String& path);
+void remove(const String& path);
+
+// Required files are never evicted
+bool pin(const String& path);
+bool unpin(const String& path);
+bool isPinned(const String& path) const;
+
+// Evict cold entries until SPIFFS can take requiredBytes; false if even that is not enough.
+// keep is never evicted (the file being resumed).
+bool ensureSpace(size_t requiredBytes, const String& keep = "");
+
+// 0 = pure LRU; higher values protect files that were expensive to fetch
+void setCostWeighting(float weight) { costWeight = weight; }
+
+CacheStats getStats() const;
+float getHitRatio() const;
+void printStats() const;
+
+private:
+std::vector<CacheEntry> entries;
+String recentlyEvicted[CACHE_EVICTION_MEMORY];
+int evictedNext;
+uint32_t clock;
+float costWeight;
+bool dirty;
+CacheStats stats;
+SemaphoreHandle_t lock;
+
+int find(const String& path) const;
+int pickVictim(const String& keep = "") const;
+void countMiss(const String& path);
+bool save();
+};
@@ -1,439 +1,921 @@
-#include "download_engines.h"
-#include <FS.h>
-#include <SPIFFS.h>
-#include <HTTPClient.h>
-#include <WiFi.h>
-#include <WiFiClient.h>
-#include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
-#include <freertos/semphr.h>
-
-HttpDownloader::HttpDownloader()
-: cancelled(false), bufMgr(nullptr), perf(nullptr), maxRetries(2) {
-// little human note: default retries are conservative
-}
-
-HttpDownloader::~HttpDownloader() {
-// nothing special
-}
-
-void HttpDownloader::cancel() {
-cancelled = true;
-}
-
-// tiny helper to write data to SPIFFS
-bool HttpDownloader::writeChunkToFile(const String& path, const uint8_t* data, size_t len, bool append) {
-// some people prefer to open/close per chunk to be safe on embedded FS
-File f;
-if (append) f = SPIFFS.open(path, FILE_APPEND);
-else f = SPIFFS.open(path, FILE_WRITE);
-
-if (!f) {
-    Serial.println("Failed to open file: " + path);
-    return false;
-}
-
-size_t written = f.write(data, len);
-f.close();
-
-if (written != len) {
-    Serial.println("Partial write: wrote " + String(written) + " of " + String(len) + " bytes");
-    return false;
-}
-return true;
-
-
-}
-
-DownloadResult HttpDownloader::download(const String& url, const String& targetPath) {
-DownloadResult result;
-result.success = false;
-
-if (!SPIFFS.begin(true)) {
-    result.errorMessage = "SPIFFS not mounted";
-    Serial.println("SPIFFS not mounted, aborting download");
-    return result;
-}
-
-// prefer to allocate local buffers only if provided manager is available
-size_t bufSize = DEFAULT_DOWNLOAD_BUFFER_SIZE;
-if (bufMgr && bufMgr->getDownloadBufferSize() > 0) bufSize = bufMgr->getDownloadBufferSize();
-
-// small local buffer if nothing else provided
-uint8_t* localBuf = nullptr;
-if (!bufMgr) {
-    localBuf = (uint8_t*)malloc(bufSize);
-    if (!localBuf) {
-        result.errorMessage = "Failed to allocate temp buffer";
-        Serial.println("Failed to allocate local temp buffer");
-        return result;
-    }
-}
-
-HTTPClient http;
-int tries = 0;
-
-while (tries <= maxRetries && !cancelled) {
-    tries++;
-    http.begin(url);
-    // we keep it minimal; user can add headers externally if needed
-    int code = http.GET();
-    if (code != HTTP_CODE_OK) {
-        Serial.println("HTTP error code: " + String(code) + ", try " + String(tries));
-        http.end();
-        if (tries > maxRetries) {
-            result.httpStatusCode = code;
-            result.errorMessage = "HTTP GET failed: " + String(code);
-            break;
-        } else {
-            delay(300); // small backoff
-            continue;
-        }
-    }
-
-    // got a good response; stream it
-    WiFiClient* stream = http.getStreamPtr();
-    size_t total = http.getSize();
-    size_t downloaded = 0;
-
-    // initialize performance monitor if present
-    if (perf) {
-        perf->startMonitoring();
-        perf->startConnectionTimer();
-    }
-
-    // create/truncate file first
-    File out = SPIFFS.open(targetPath, FILE_WRITE);
-    if (!out) {
-        Serial.println("Failed to open output file: " + targetPath);
-        result.errorMessage = "Failed to open output file";
-        http.end();
-        break;
-    }
-    out.close(); // we'll append as we get chunks
-
-    // stream loop
-    while (http.connected() && (total > 0 ? downloaded < total : stream->available()) && !cancelled) {
-        size_t toRead = bufSize;
-        if (total > 0) {
-            // don't read past end
-            if (toRead > (total - downloaded)) toRead = total - downloaded;
-        }
-
-        int available = stream->available();
-        if (available == 0) {
-            // no data available yet; give a tiny sleep
-            delay(5);
-            continue;
-        }
-
-        int readBytes = stream->readBytes((char*)(localBuf ? localBuf : bufMgr->getActiveDownloadBuffer()), toRead);
-        if (readBytes <= 0) {
-            // nothing read; break out if connection closed
-            break;
-        }
-
-        // write to file
-        bool ok = writeChunkToFile(targetPath, localBuf ? localBuf : bufMgr->getActiveDownloadBuffer(), readBytes, true);
-        if (!ok) {
-            result.errorMessage = "Write failed";
-            break;
-        }
-
-        downloaded += readBytes;
-
-        if (perf) {
-            perf->updateProgress(downloaded);
-        }
-    } // end stream loop
-
-    // wrap up
-    if (perf) {
-        perf->stopEnhancedMonitoring();
-        perf->stopMonitoring();
-    }
-
-    result.fileSize = total;
-    result.totalBytes = downloaded;
-    result.httpStatusCode = code;
-    result.success = (downloaded > 0 && !cancelled);
-    if (localBuf) {
-        free(localBuf);
-        localBuf = nullptr;
-    }
-
-    http.end();
-    break; // we either succeeded or had an error; break out of retry loop
-} // end retry loop
-
-if (cancelled) {
-    result.errorMessage = "Cancelled by user";
-    result.success = false;
-}
-
-return result;
-
-
-}
-
-// ---- ResumeDownloader ----
-
-ResumeDownloader::ResumeDownloader() : HttpDownloader() {
-// nothing fancy
-}
-
-ResumeDownloader::~ResumeDownloader() {}
-
-long ResumeDownloader::probeRemoteSize(const String& url) {
-HTTPClient http;
-http.begin(url);
-int code = http.sendRequest("HEAD");
-long size = -1;
-if (code == HTTP_CODE_OK || code == HTTP_CODE_MOVED_PERMANENTLY || code == HTTP_CODE_FOUND) {
-size = http.getSize();
-}
-http.end();
-return size;
-}
-
-bool ResumeDownloader::appendToExistingFile(const String& path, const uint8_t* data, size_t len) {
-// this duplicates HttpDownloader::writeChunkToFile but it's fine — humans duplicate sometimes
-File f = SPIFFS.open(path, FILE_APPEND);
-if (!f) return false;
-size_t w = f.write(data, len);
-f.close();
-return w == len;
-}
-
-DownloadResult ResumeDownloader::download(const String& url, const String& targetPath) {
-// simple resume logic:
-// 1. probe remote size
-// 2. check local file size
-// 3. start HTTP with Range header if needed
-DownloadResult res;
-res.success = false;
-
-long remoteSize = probeRemoteSize(url);
-size_t localSize = 0;
-
-if (SPIFFS.exists(targetPath)) {
-    File f = SPIFFS.open(targetPath, FILE_READ);
-    if (f) {
-        localSize = f.size();
-        f.close();
-    }
-}
-
-if (remoteSize > 0 && localSize >= (size_t)remoteSize) {
-    res.success = true;
-    res.fileSize = remoteSize;
-    res.totalBytes = localSize;
-    res.errorMessage = "Already complete";
-    Serial.println("File already downloaded, skipping");
-    return res;
-}
-
-// otherwise fall back to parent implementation but try resume via headers
-// for simplicity we'll just call the parent download (no range) — real resume would add Range header
-// leaving a commented-out idea for later:
-// // setRangeHeader(localSize)
-res = HttpDownloader::download(url, targetPath);
-return res;
-}
-
-// ===============================================
-// DualCoreDownloader Implementation
-// ===============================================
-
-DualCoreDownloader::DualCoreDownloader() 
-: bufMgr(nullptr), perf(nullptr), chunkSize(8192), cancelled(false) {
-    // Initialize with sensible defaults
-}
-
-DualCoreDownloader::~DualCoreDownloader() {
-    cancel();
-}
-
-DownloadResult DualCoreDownloader::download(const String& url, const String& targetPath) {
-    DownloadResult result;
-    result.success = false;
-    result.totalBytes = 0;
-    cancelled = false;
-
-    Serial.println("Starting dual-core download with FreeRTOS tasks");
-    
-    // Create semaphore for task coordination
-    SemaphoreHandle_t completionSemaphore = xSemaphoreCreateBinary();
-    if (!completionSemaphore) {
-        result.errorMessage = "Failed to create completion semaphore";
-        return result;
-    }
-
-    // Create task structure
-    DownloadTask task = {
-        .url = url,
-        .targetPath = targetPath,
-        .downloader = this,
-        .result = &result,
-        .completionSemaphore = completionSemaphore
-    };
-
-    // Start performance monitoring
-    if (perf) {
-        perf->startMonitoring();
-    }
-
-    // Create FreeRTOS task on Core 0 (dedicated to download processing)
-    TaskHandle_t downloadTaskHandle = nullptr;
-    BaseType_t taskResult = xTaskCreatePinnedToCore(
-        downloadTaskCore0,      // Task function
-        "DownloadCore0",        // Name
-        8192,                   // Stack size
-        &task,                  // Parameters
-        2,                      // Priority
-        &downloadTaskHandle,    // Task handle
-        0                       // Core 0
-    );
-
-    if (taskResult != pdPASS) {
-        result.errorMessage = "Failed to create download task on Core 0";
-        vSemaphoreDelete(completionSemaphore);
-        return result;
-    }
-
-    // Wait for completion with timeout (30 seconds)
-    if (xSemaphoreTake(completionSemaphore, pdMS_TO_TICKS(30000)) == pdTRUE) {
-        Serial.println("Dual-core download completed successfully");
-    } else {
-        result.success = false;
-        result.errorMessage = "Download timeout after 30 seconds";
-        cancel();
-    }
-
-    // Clean up
-    vSemaphoreDelete(completionSemaphore);
-    
-    // Finish performance monitoring
-    if (perf && result.success) {
-        perf->stopMonitoring();
-    }
-
-    return result;
-}
-
-void DualCoreDownloader::cancel() {
-    cancelled = true;
-}
-
-void DualCoreDownloader::downloadTaskCore0(void* parameter) {
-    DownloadTask* task = static_cast<DownloadTask*>(parameter);
-    DualCoreDownloader* downloader = task->downloader;
-    
-    Serial.println("Download task running on Core 0");
-    
-    // Perform the actual download using the existing HttpDownloader logic
-    bool success = downloader->performActualDownload(task->url, task->targetPath, task->result, downloader->perf);
-    
-    task->result->success = success;
-    
-    // Signal completion
-    xSemaphoreGive(task->completionSemaphore);
-    
-    // Delete task
-    vTaskDelete(nullptr);
-}
-
-void DualCoreDownloader::downloadTaskCore1(void* parameter) {
-    // Reserved for future parallel processing features
-    // Could be used for simultaneous file processing, compression, etc.
-    vTaskDelete(nullptr);
-}
-
-void DualCoreDownloader::coordinatorTask(void* parameter) {
-    // Reserved for coordinating multiple parallel downloads
-    vTaskDelete(nullptr);
-}
-
-bool DualCoreDownloader::performActualDownload(const String& url, const String& targetPath, DownloadResult* result, PerformanceMonitor* perfMonitor) {
-    // Use existing HttpDownloader logic but with FreeRTOS task context
-    HTTPClient http;
-    http.begin(url);
-    
-    int httpCode = http.GET();
-    if (httpCode != HTTP_CODE_OK) {
-        result->errorMessage = "HTTP error: " + String(httpCode);
-        http.end();
-        return false;
-    }
-
-    int contentLength = http.getSize();
-    if (contentLength <= 0) {
-        result->errorMessage = "Unknown content length";
-        http.end();
-        return false;
-    }
-
-    // Open file for writing
-    File file = SPIFFS.open(targetPath, FILE_WRITE);
-    if (!file) {
-        result->errorMessage = "Cannot open file for writing: " + targetPath;
-        http.end();
-        return false;
-    }
-
-    WiFiClient* stream = http.getStreamPtr();
-    size_t totalBytes = 0;
-    uint8_t buffer[1024];
-    size_t originalContentLength = contentLength;
-
-    // Download in chunks with FreeRTOS yielding and progress updates
-    while (http.connected() && (contentLength > 0 || contentLength == -1)) {
-        if (cancelled) {
-            result->errorMessage = "Download cancelled";
-            file.close();
-            http.end();
-            return false;
-        }
-
-        size_t bytesAvailable = stream->available();
-        if (bytesAvailable > 0) {
-            size_t bytesToRead = min(bytesAvailable, sizeof(buffer));
-            size_t bytesRead = stream->readBytes(buffer, bytesToRead);
-            
-            if (file.write(buffer, bytesRead) != bytesRead) {
-                result->errorMessage = "File write error";
-                file.close();
-                http.end();
-                return false;
-            }
-            
-            totalBytes += bytesRead;
-            
-            // Update performance monitoring with progress
-            if (perfMonitor) {
-                if (originalContentLength > 0) {
-                    perfMonitor->updateProgress(totalBytes, originalContentLength);
-                } else {
-                    perfMonitor->updateProgress(totalBytes);
-                }
-            }
-            
-            if (contentLength > 0) {
-                contentLength -= bytesRead;
-            }
-        } else {
-            // Yield to other tasks
-            vTaskDelay(pdMS_TO_TICKS(1));
-        }
-    }
-
-    file.close();
-    http.end();
-    
-    result->totalBytes = totalBytes;
-    result->success = true;
-    
-    Serial.println("Core 0 download completed: " + String(totalBytes) + " bytes");
-    
-    return true;
-}
\ No newline at end of file
+#include "download_engines.h"
+#include "peer_cache.h"
+#include "download_cache.h"
+#include "content_store.h"
+#include "spiffs_management.h"
+#include "crash_counters.h"
+#include "hot_path_timer.h"
+#include <FS.h>
+#include <SPIFFS.h>
+#include <HTTPClient.h>
+#include <WiFi.h>
+#include <WiFiClient.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+// Room for `bytes` more on SPIFFS, evicting cold cache entries when a cache is attached.
+// Overwriting targetPath frees its current size, so that counts as available.
+static bool reserveSpace(DownloadCache* cache, const String& targetPath, size_t bytes, bool overwrite) {
+size_t existing = 0;
+if (overwrite && SPIFFS.exists(targetPath)) {
+    File f = SPIFFS.open(targetPath, FILE_READ);
+    if (f) {
+        existing = f.size();
+        f.close();
+    }
+}
+size_t needed = bytes > existing ? bytes - existing : 0;
+if (checkSPIFFSSpace(needed)) return true;
+return cache && cache->ensureSpace(needed, targetPath);
+}
+
+HttpDownloader::HttpDownloader()
+: cancelled(false), pauseRequested(false), bufMgr(nullptr), perf(nullptr), peerCache(nullptr), downloadCache(nullptr), contentStore(nullptr), arrivalTrace(nullptr), replay(nullptr), computeDigest(false), hasExpectedDigest(false),
+mirrorsStreamed(false), progressInterval(DEFAULT_PROGRESS_INTERVAL), maxRetries(2) {
+// little human note: default retries are conservative
+}
+
+HttpDownloader::~HttpDownloader() {
+// nothing special
+}
+
+void HttpDownloader::cancel() {
+cancelled = true;
+}
+
+void HttpDownloader::setExpectedDigest(const String& hex) {
+hasExpectedDigest = StreamingDigest::fromHex(hex, expectedDigest);
+if (!hasExpectedDigest && hex.length() > 0) Serial.println("Ignoring malformed expected digest: " + hex);
+}
+
+// tiny helper to write data to SPIFFS
+bool HttpDownloader::writeChunkToFile(const String& path, const uint8_t* data, size_t len, bool append) {
+HOT_TIMER("engine.http.write");
+// some people prefer to open/close per chunk to be safe on embedded FS
+File f = openSPIFFSForWrite(path, append);
+
+if (!f) {
+    Serial.println("Failed to open file: " + path);
+    return false;
+}
+
+size_t written = f.write(data, len);
+f.close();
+hotCacheWrite(path, data, written, append);
+
+if (written != len) {
+    Serial.println("Partial write: wrote " + String(written) + " of " + String(len) + " bytes");
+    return false;
+}
+return true;
+
+
+}
+
+DownloadResult HttpDownloader::download(const String& url, const String& targetPath) {
+return downloadFrom(url, targetPath, 0);
+}
+
+DownloadResult HttpDownloader::downloadFrom(const String& url, const String& targetPath, size_t startOffset) {
+DownloadResult result;
+result.success = false;
+cancelled = false;
+mirrorsStreamed = false;
+
+if (pauseRequested) {
+    // preempted before we even connected
+    pauseRequested = false;
+    result.paused = true;
+    result.totalBytes = startOffset;
+    result.errorMessage = "Paused";
+    return result;
+}
+
+// the manifest digest names content we already hold: nothing to fetch (a replay always streams)
+if (!replay && startOffset == 0 && linkFromContentStore(targetPath, result)) return result;
+// from here the bytes come over the network (peer or origin): a cache miss
+if (downloadCache && !replay && startOffset == 0) downloadCache->recordMiss(targetPath);
+
+bool hashing = digestEnabled();
+if (hashing) digest.begin();
+
+// A LAN peer may already hold this content; only worth asking for whole files, and only when a
+// manifest digest says which bytes are right (a peer's own advert cannot vouch for itself).
+// Replayed bodies are test data: they never touch peers, the store or the download cache.
+PeerFetchResult peer;
+if (peerCache && !replay && startOffset == 0 && hasExpectedDigest) {
+    peer = peerCache->fetch(url, targetPath, expectedDigest, digest);
+    result.peerBytes = peer.bytesWritten;
+    if (peer.complete) {
+        result.success = true;
+        result.fileSize = peer.bytesWritten;
+        result.totalBytes = peer.bytesWritten;
+        result.httpStatusCode = 200;
+        if (finishDigest(url, targetPath, peer.expectedDigest, result)) {
+            fanOutToMirrors(targetPath, result);
+            return result;
+        }
+
+        // peer sent bad bytes: throw them away and go to the origin for all of it
+        Serial.println("Peer content failed verification, refetching from origin");
+        peerCache->recordVerifyFailure();
+        hotCacheInvalidate(targetPath);
+        SPIFFS.remove(targetPath);
+        result = DownloadResult();
+        digest.begin();
+    } else if (peer.bytesWritten > 0) {
+        // peer dropped mid-stream: keep what we have and let the origin finish it
+        Serial.println("Peer transfer stopped at " + String(peer.bytesWritten) + " bytes, continuing from origin");
+        startOffset = peer.bytesWritten;
+    }
+} else if (hashing && startOffset > 0) {
+    // resuming: the prefix already on flash is part of the digest
+    if (!digest.updateFromFile(targetPath, startOffset)) {
+        Serial.println("Could not hash existing prefix, restarting from zero");
+        startOffset = 0;
+        digest.begin();
+    }
+}
+
+streamFromOrigin(url, targetPath, startOffset, result);
+result.peerBytes = peer.bytesWritten > 0 ? result.totalBytes - result.originBytes : 0;
+
+if (result.success && hashing) {
+    const uint8_t* expected = hasExpectedDigest ? expectedDigest : (peer.attempted && result.peerBytes > 0 ? peer.expectedDigest : nullptr);
+    if (!finishDigest(url, targetPath, expected, result) && result.peerBytes > 0) {
+        // the peer prefix was bad; one clean pass from the origin
+        peerCache->recordVerifyFailure();
+        hotCacheInvalidate(targetPath);
+        SPIFFS.remove(targetPath);
+        result = DownloadResult();
+        digest.begin();
+        streamFromOrigin(url, targetPath, 0, result);
+        if (result.success) finishDigest(url, targetPath, hasExpectedDigest ? expectedDigest : nullptr, result);
+    }
+}
+std::vector<String> mirrors = mirrorTargets;
+fanOutToMirrors(targetPath, result);
+if (contentStore && !replay && result.success && result.contentDigest.length() > 0) {
+    // keep one copy of these bytes; the target and its mirrors become references
+    if (contentStore->adopt(targetPath, result.contentDigest)) {
+        for (const auto& m : mirrors) contentStore->adopt(m, result.contentDigest);
+        return result;
+    }
+}
+if (downloadCache && !replay && result.success) downloadCache->registerDownload(url, targetPath, result.totalBytes, result.downloadTimeMs);
+return result;
+}
+
+bool HttpDownloader::linkFromContentStore(const String& targetPath, DownloadResult& result) {
+if (!contentStore || !hasExpectedDigest) return false;
+String hex = StreamingDigest::toHex(expectedDigest);
+if (!contentStore->hasContent(hex) || !contentStore->link(targetPath, hex)) return false;
+
+for (const auto& m : mirrorTargets) contentStore->link(m, hex);
+result.extraSinks = mirrorTargets.size();
+mirrorTargets.clear();
+
+result.success = true;
+result.storeHit = true;
+result.httpStatusCode = 200;
+result.fileSize = contentStore->contentSize(hex);
+result.totalBytes = result.fileSize;
+result.contentDigest = hex;
+Serial.println("Content " + hex.substring(0, 16) + "... already stored, linked " + targetPath);
+return true;
+}
+
+void HttpDownloader::fanOutToMirrors(const String& targetPath, DownloadResult& result) {
+if (mirrorTargets.empty()) return;
+if (result.success && !mirrorsStreamed) {
+    // part of the file came from a peer or an earlier session: copy the finished file instead
+    for (const auto& m : mirrorTargets) {
+        if (!copySPIFFSFile(targetPath, m)) {
+            result.success = false;
+            result.errorMessage = "Mirror copy failed: " + m;
+        }
+    }
+}
+result.extraSinks = mirrorTargets.size();
+mirrorTargets.clear(); // mirrors apply to one download only
+}
+
+bool HttpDownloader::finishDigest(const String& url, const String& targetPath, const uint8_t* expected, DownloadResult& result) {
+if (!digest.isActive()) return result.success;
+
+uint8_t actual[CONTENT_DIGEST_SIZE];
+digest.finish(actual);
+result.contentDigest = StreamingDigest::toHex(actual);
+
+if (expected && memcmp(actual, expected, CONTENT_DIGEST_SIZE) != 0) {
+    Serial.println("Digest mismatch for " + targetPath + ": got " + result.contentDigest);
+    result.success = false;
+    result.errorMessage = "Digest mismatch";
+    return false;
+}
+
+// verified (or at least hashed) content can be offered to the rest of the site
+if (peerCache && !replay) peerCache->addLocalContent(url, targetPath, actual, result.totalBytes);
+return true;
+}
+
+void HttpDownloader::streamFromOrigin(const String& url, const String& targetPath, size_t startOffset, DownloadResult& result) {
+result.success = false;
+
+if (!SPIFFS.begin(true)) {
+    result.errorMessage = "SPIFFS not mounted";
+    Serial.println("SPIFFS not mounted, aborting download");
+    return;
+}
+
+// prefer to allocate local buffers only if provided manager is available
+size_t bufSize = DEFAULT_DOWNLOAD_BUFFER_SIZE;
+if (bufMgr && bufMgr->getDownloadBufferSize() > 0) bufSize = bufMgr->getDownloadBufferSize();
+
+// small local buffer if nothing else provided (or another transfer holds the manager's)
+uint8_t* localBuf = nullptr;
+bool leased = bufMgr && bufMgr->leaseDownloadBuffers();
+if (!leased) {
+    localBuf = (uint8_t*)malloc(bufSize);
+    if (!localBuf) {
+        result.errorMessage = "Failed to allocate temp buffer";
+        Serial.println("Failed to allocate local temp buffer");
+        return;
+    }
+}
+
+HTTPClient http;
+int tries = 0;
+crashCountersBeginJob(url, 0);
+
+while (tries <= maxRetries && !cancelled) {
+    tries++;
+    int code;
+    if (replay) {
+        // recorded arrival pattern instead of the network (no ranges: a resume restarts below)
+        replay->rewind();
+        code = HTTP_CODE_OK;
+    } else {
+        http.begin(url);
+        // we keep it minimal; user can add headers externally if needed
+        if (startOffset > 0) http.addHeader("Range", "bytes=" + String(startOffset) + "-");
+        HOT_TIMER("engine.http.get");
+        code = http.GET();
+    }
+    if (code == HTTP_CODE_OK && startOffset > 0) {
+        // server ignored the Range header: start over from byte zero
+        Serial.println("Server does not support ranges, restarting from zero");
+        startOffset = 0;
+        if (digest.isActive()) digest.begin();
+    }
+    if (code != HTTP_CODE_OK && !(code == HTTP_CODE_PARTIAL_CONTENT && startOffset > 0)) {
+        Serial.println("HTTP error code: " + String(code) + ", try " + String(tries));
+        http.end();
+        if (tries > maxRetries) {
+            result.httpStatusCode = code;
+            result.errorMessage = "HTTP GET failed: " + String(code);
+            break;
+        } else {
+            delay(300); // small backoff
+            continue;
+        }
+    }
+
+    // got a good response; stream it
+    WiFiClient* stream = replay ? nullptr : http.getStreamPtr();
+    int sizeHint = replay ? (int)replay->totalBytes() : http.getSize();
+    auto sourceConnected = [&]() { return replay ? replay->connected() : (bool)http.connected(); };
+    auto sourceAvailable = [&]() { return replay ? replay->available() : stream->available(); };
+    size_t total = sizeHint > 0 ? (size_t)sizeHint : 0; // for 206 this is the remaining length
+    size_t downloaded = 0;
+
+    if (total > 0) {
+        size_t copies = 1 + (startOffset == 0 ? mirrorTargets.size() : 0);
+        if (!reserveSpace(downloadCache, targetPath, total * copies, startOffset == 0)) {
+            result.httpStatusCode = code;
+            result.errorMessage = "Insufficient SPIFFS space";
+            http.end();
+            break;
+        }
+    }
+
+    // initialize performance monitor if present
+    if (perf) {
+        perf->startMonitoring();
+        perf->startConnectionTimer();
+    }
+
+    // create/truncate file first (a ranged continuation appends to what is there)
+    File out = openSPIFFSForWrite(targetPath, startOffset > 0);
+    if (!out) {
+        Serial.println("Failed to open output file: " + targetPath);
+        result.errorMessage = "Failed to open output file";
+        http.end();
+        break;
+    }
+    out.close(); // we'll append as we get chunks
+    if (startOffset == 0) hotCacheWrite(targetPath, nullptr, 0, false);
+
+    // mirrors get the same bytes as we stream, but only when we write the whole file here
+    mirrorsStreamed = (startOffset == 0);
+    if (mirrorsStreamed) {
+        for (const auto& m : mirrorTargets) {
+            File mf = openSPIFFSForWrite(m);
+            if (mf) mf.close();
+            hotCacheWrite(m, nullptr, 0, false);
+        }
+    }
+
+    size_t lastProgress = startOffset;
+    crashCounters.expectedBytes = total > 0 ? startOffset + total : 0;
+    crashCounters.bytes = startOffset;
+    crashCountersPhase(PHASE_STREAMING);
+    if (arrivalTrace) arrivalTrace->begin();
+
+    // stream loop
+    while (sourceConnected() && (total > 0 ? downloaded < total : sourceAvailable()) && !cancelled && !pauseRequested) {
+        size_t toRead = bufSize;
+        if (total > 0) {
+            // don't read past end
+            if (toRead > (total - downloaded)) toRead = total - downloaded;
+        }
+
+        int available = sourceAvailable();
+        if (available == 0) {
+            // no data available yet; give a tiny sleep
+            delay(5);
+            continue;
+        }
+        HOT_TIMER("engine.http.chunk");   // one chunk's read, write and bookkeeping
+
+        int readBytes;
+        {
+            HOT_TIMER("engine.http.read");
+            uint8_t* dst = localBuf ? localBuf : bufMgr->getActiveDownloadBuffer();
+            readBytes = replay ? replay->read(dst, toRead) : stream->readBytes(dst, toRead);
+        }
+        if (readBytes <= 0) {
+            // nothing read; break out if connection closed
+            break;
+        }
+
+        // write to file
+        const uint8_t* chunk = localBuf ? localBuf : bufMgr->getActiveDownloadBuffer();
+        bool ok = writeChunkToFile(targetPath, chunk, readBytes, true);
+        if (!ok) {
+            result.errorMessage = "Write failed";
+            break;
+        }
+        digest.update(chunk, readBytes);
+        if (mirrorsStreamed) {
+            for (const auto& m : mirrorTargets) {
+                if (!writeChunkToFile(m, chunk, readBytes, true)) {
+                    result.errorMessage = "Mirror write failed: " + m;
+                    ok = false;
+                }
+            }
+            if (!ok) break;
+        }
+
+        downloaded += readBytes;
+        crashCountersChunk(startOffset + downloaded);
+        if (arrivalTrace) arrivalTrace->record(readBytes);
+
+        if (perf) {
+            perf->updateProgress(downloaded);
+        }
+        if (progressCallback && startOffset + downloaded - lastProgress >= progressInterval) {
+            lastProgress = startOffset + downloaded;
+            progressCallback(lastProgress);
+        }
+    } // end stream loop
+
+    // wrap up
+    if (perf) {
+        perf->stopEnhancedMonitoring();
+        perf->stopMonitoring();
+        perf->applyToResult(result, downloaded);
+    }
+
+    // a pause that raced with the last chunk is just a finished download
+    if (pauseRequested && !(total > 0 && downloaded >= total)) {
+        pauseRequested = false;
+        result.paused = true;
+        result.errorMessage = "Paused";
+    }
+
+    result.fileSize = startOffset + total;
+    result.totalBytes = startOffset + downloaded;
+    result.originBytes = downloaded;
+    result.httpStatusCode = code;
+    result.success = (downloaded > 0 && !cancelled && !result.paused && result.errorMessage.length() == 0);
+
+    http.end();
+    break; // we either succeeded or had an error; break out of retry loop
+} // end retry loop
+
+crashCountersEndJob();
+if (localBuf) {
+    free(localBuf);
+    localBuf = nullptr;
+}
+if (leased) bufMgr->releaseDownloadBuffers();
+
+if (cancelled) {
+    result.errorMessage = "Cancelled by user";
+    result.success = false;
+}
+
+
+}
+
+// ---- ResumeDownloader ----
+
+ResumeDownloader::ResumeDownloader() : HttpDownloader() {
+// nothing fancy
+}
+
+ResumeDownloader::~ResumeDownloader() {}
+
+long ResumeDownloader::probeRemoteSize(const String& url) {
+HTTPClient http;
+http.begin(url);
+int code = http.sendRequest("HEAD");
+long size = -1;
+if (code == HTTP_CODE_OK || code == HTTP_CODE_MOVED_PERMANENTLY || code == HTTP_CODE_FOUND) {
+size = http.getSize();
+}
+http.end();
+return size;
+}
+
+bool ResumeDownloader::appendToExistingFile(const String& path, const uint8_t* data, size_t len) {
+// this duplicates HttpDownloader::writeChunkToFile but it's fine — humans duplicate sometimes
+File f = openSPIFFSForWrite(path, true);
+if (!f) return false;
+size_t w = f.write(data, len);
+f.close();
+hotCacheWrite(path, data, w, true);
+return w == len;
+}
+
+DownloadResult ResumeDownloader::download(const String& url, const String& targetPath) {
+// simple resume logic:
+// 1. probe remote size
+// 2. check local file size
+// 3. start HTTP with Range header if needed
+DownloadResult res;
+res.success = false;
+
+long remoteSize = probeRemoteSize(url);
+size_t localSize = 0;
+
+if (SPIFFS.exists(targetPath)) {
+    File f = SPIFFS.open(targetPath, FILE_READ);
+    if (f) {
+        localSize = f.size();
+        f.close();
+    }
+}
+
+if (remoteSize > 0 && localSize >= (size_t)remoteSize) {
+    res.success = true;
+    res.fileSize = remoteSize;
+    res.totalBytes = localSize;
+    res.errorMessage = "Already complete";
+    Serial.println("File already downloaded, skipping");
+    return res;
+}
+
+// otherwise continue from what we already have with a Range request
+// (downloadFrom restarts from zero if the server ignores the range)
+if (localSize > 0) Serial.println("Resuming " + targetPath + " from " + String(localSize) + " bytes");
+res = downloadFrom(url, targetPath, localSize);
+return res;
+}
+
+// ===============================================
+// DualCoreDownloader Implementation
+// ===============================================
+
+// A buffer handed from the network task to the write stage; len == 0 ends the stream
+struct WriteChunk {
+    int index;
+    size_t len;
+};
+
+struct DualCoreDownloader::WriterStage {
+    String path;
+    File file;
+    uint8_t* buffers[DOUBLE_BUFFER_COUNT];
+    size_t bufferSize;
+    QueueHandle_t emptyQ;   // buffer indices core 0 may fill
+    QueueHandle_t fullQ;    // WriteChunk waiting for core 1
+    SemaphoreHandle_t done;
+    StreamCipher* cipher;   // nullptr = plaintext
+    volatile bool writeError;
+    unsigned long cryptoUs;
+};
+
+DualCoreDownloader::DualCoreDownloader() 
+: bufMgr(nullptr), perf(nullptr), downloadCache(nullptr), arrivalTrace(nullptr), replay(nullptr), chunkSize(8192), cancelled(false) {
+    // Initialize with sensible defaults
+}
+
+DualCoreDownloader::~DualCoreDownloader() {
+    cancel();
+}
+
+DownloadResult DualCoreDownloader::download(const String& url, const String& targetPath) {
+    DownloadResult result;
+    result.success = false;
+    result.totalBytes = 0;
+    cancelled = false;
+
+    Serial.println("Starting dual-core download with FreeRTOS tasks");
+    
+    // Create semaphore for task coordination
+    SemaphoreHandle_t completionSemaphore = xSemaphoreCreateBinary();
+    if (!completionSemaphore) {
+        result.errorMessage = "Failed to create completion semaphore";
+        return result;
+    }
+
+    // Create task structure
+    DownloadTask task = {
+        .url = url,
+        .targetPath = targetPath,
+        .downloader = this,
+        .result = &result,
+        .completionSemaphore = completionSemaphore
+    };
+
+    // Start performance monitoring
+    if (perf) {
+        perf->startMonitoring();
+    }
+
+    // Create FreeRTOS task on Core 0 (dedicated to download processing)
+    TaskHandle_t downloadTaskHandle = nullptr;
+    BaseType_t taskResult = xTaskCreatePinnedToCore(
+        downloadTaskCore0,      // Task function
+        "DownloadCore0",        // Name
+        8192,                   // Stack size
+        &task,                  // Parameters
+        2,                      // Priority
+        &downloadTaskHandle,    // Task handle
+        0                       // Core 0
+    );
+
+    if (taskResult != pdPASS) {
+        result.errorMessage = "Failed to create download task on Core 0";
+        vSemaphoreDelete(completionSemaphore);
+        return result;
+    }
+
+    // Wait for completion with timeout (30 seconds)
+    if (xSemaphoreTake(completionSemaphore, pdMS_TO_TICKS(30000)) == pdTRUE) {
+        Serial.println("Dual-core download completed successfully");
+    } else {
+        result.success = false;
+        result.errorMessage = "Download timeout after 30 seconds";
+        cancel();
+    }
+
+    // Clean up
+    vSemaphoreDelete(completionSemaphore);
+    
+    // Finish performance monitoring
+    if (perf && result.success) {
+        perf->stopMonitoring();
+        perf->applyToResult(result, result.totalBytes);
+    }
+
+    return result;
+}
+
+void DualCoreDownloader::cancel() {
+    cancelled = true;
+}
+
+bool DualCoreDownloader::usesManagerBuffers() const {
+    return bufMgr && bufMgr->isDoubleBufferingEnabled() && bufMgr->getWriteBufferSize() > 0;
+}
+
+size_t DualCoreDownloader::getPipelineBlockSize() const {
+    return usesManagerBuffers() ? bufMgr->getWriteBufferSize() : chunkSize;
+}
+
+void DualCoreDownloader::downloadTaskCore0(void* parameter) {
+    DownloadTask* task = static_cast<DownloadTask*>(parameter);
+    DualCoreDownloader* downloader = task->downloader;
+    
+    Serial.println("Download task running on Core 0");
+    
+    // Perform the actual download using the existing HttpDownloader logic
+    crashCountersBeginJob(task->url, 0);
+    bool success = downloader->performActualDownload(task->url, task->targetPath, task->result, downloader->perf);
+    crashCountersEndJob();
+    
+    task->result->success = success;
+    
+    // Signal completion
+    xSemaphoreGive(task->completionSemaphore);
+    
+    // Delete task
+    vTaskDelete(nullptr);
+}
+
+void DualCoreDownloader::downloadTaskCore1(void* parameter) {
+    WriterStage* w = static_cast<WriterStage*>(parameter);
+
+    while (true) {
+        WriteChunk chunk;
+        xQueueReceive(w->fullQ, &chunk, portMAX_DELAY);
+        if (chunk.len == 0) break;
+
+        // after a failed write keep draining so core 0 never blocks on emptyQ
+        if (!w->writeError) {
+            uint8_t* data = w->buffers[chunk.index];
+            if (w->cipher) {
+                HOT_TIMER("engine.dual.encrypt");
+                unsigned long t = micros();
+                w->cipher->apply(data, chunk.len);
+                w->cipher->macUpdate(data, chunk.len);
+                w->cryptoUs += micros() - t;
+            }
+            size_t written;
+            {
+                HOT_TIMER("engine.dual.write");
+                written = w->file.write(data, chunk.len);
+            }
+            if (written != chunk.len) {
+                w->writeError = true;
+                hotCacheInvalidate(w->path);
+            } else {
+                hotCacheWrite(w->path, data, chunk.len, true);
+            }
+        }
+        xQueueSend(w->emptyQ, &chunk.index, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(w->done);
+    vTaskDelete(nullptr);
+}
+
+void DualCoreDownloader::coordinatorTask(void* parameter) {
+    // Reserved for coordinating multiple parallel downloads
+    vTaskDelete(nullptr);
+}
+
+bool DualCoreDownloader::performActualDownload(const String& url, const String& targetPath, DownloadResult* result, PerformanceMonitor* perfMonitor) {
+    // Use existing HttpDownloader logic but with FreeRTOS task context
+    unsigned long downloadStart = millis();
+    if (downloadCache && !replay) downloadCache->recordMiss(targetPath);
+    HTTPClient http;
+    int httpCode;
+    if (replay) {
+        replay->rewind();
+        httpCode = HTTP_CODE_OK;
+    } else {
+        http.begin(url);
+        HOT_TIMER("engine.dual.get");
+        httpCode = http.GET();
+    }
+    if (httpCode != HTTP_CODE_OK) {
+        result->errorMessage = "HTTP error: " + String(httpCode);
+        http.end();
+        return false;
+    }
+
+    int contentLength = replay ? (int)replay->totalBytes() : http.getSize();
+    if (contentLength <= 0) {
+        result->errorMessage = "Unknown content length";
+        http.end();
+        return false;
+    }
+
+    bool encrypt = cipher.hasKey();
+    size_t cipherOverhead = encrypt ? CIPHER_HEADER_SIZE + CIPHER_TAG_SIZE : 0;   // header + trailing tag
+    if (!reserveSpace(downloadCache, targetPath, contentLength + cipherOverhead, true)) {
+        result->errorMessage = "Insufficient SPIFFS space";
+        http.end();
+        return false;
+    }
+
+    // Core 1 write stage: the manager's write buffers when double buffering is on and no other
+    // transfer holds them, otherwise our own
+    WriterStage w;
+    uint8_t* owned[DOUBLE_BUFFER_COUNT] = { nullptr };
+    bool leased = usesManagerBuffers() && bufMgr->leaseWriteBuffers();
+    if (leased) {
+        w.bufferSize = bufMgr->getWriteBufferSize();
+        for (int i = 0; i < (int)DOUBLE_BUFFER_COUNT; ++i) w.buffers[i] = bufMgr->getWriteBuffer(i);
+    } else {
+        w.bufferSize = chunkSize;
+        for (int i = 0; i < (int)DOUBLE_BUFFER_COUNT; ++i) {
+            owned[i] = (uint8_t*)malloc(chunkSize);
+            w.buffers[i] = owned[i];
+        }
+    }
+    auto releaseBuffers = [&]() {
+        for (int i = 0; i < (int)DOUBLE_BUFFER_COUNT; ++i) {
+            if (owned[i]) free(owned[i]);
+        }
+        if (leased) bufMgr->releaseWriteBuffers();
+    };
+    if (!w.buffers[0] || !w.buffers[1]) {
+        result->errorMessage = "Failed to allocate write buffers";
+        releaseBuffers();
+        http.end();
+        return false;
+    }
+
+    // Open file for writing
+    w.path = targetPath;
+    w.file = openSPIFFSForWrite(targetPath);
+    if (!w.file) {
+        result->errorMessage = "Cannot open file for writing: " + targetPath;
+        releaseBuffers();
+        http.end();
+        return false;
+    }
+    uint8_t header[CIPHER_HEADER_SIZE];
+    if (encrypt) {
+        cipher.beginNew(header);
+        cipher.macBegin(header);
+        w.file.write(header, sizeof(header));
+    }
+    // the cache holds exactly what is on flash (ciphertext when encrypting)
+    hotCacheWrite(targetPath, encrypt ? header : nullptr, encrypt ? CIPHER_HEADER_SIZE : 0, false);
+
+    w.cipher = encrypt ? &cipher : nullptr;
+    w.writeError = false;
+    w.cryptoUs = 0;
+    w.emptyQ = xQueueCreate(DOUBLE_BUFFER_COUNT, sizeof(int));
+    w.fullQ = xQueueCreate(DOUBLE_BUFFER_COUNT + 1, sizeof(WriteChunk));
+    w.done = xSemaphoreCreateBinary();
+    for (int i = 0; i < (int)DOUBLE_BUFFER_COUNT; ++i) xQueueSend(w.emptyQ, &i, 0);
+
+    if (xTaskCreatePinnedToCore(downloadTaskCore1, "WriteCore1", 4096, &w, 2, nullptr, 1) != pdPASS) {
+        result->errorMessage = "Failed to create write task on Core 1";
+        vQueueDelete(w.emptyQ);
+        vQueueDelete(w.fullQ);
+        vSemaphoreDelete(w.done);
+        w.file.close();
+        releaseBuffers();
+        http.end();
+        return false;
+    }
+
+    WiFiClient* stream = replay ? nullptr : http.getStreamPtr();
+    size_t totalBytes = 0;
+    size_t originalContentLength = contentLength;
+    if (arrivalTrace) arrivalTrace->begin();
+    crashCounters.expectedBytes = originalContentLength;
+    crashCountersPhase(PHASE_STREAMING);
+    int current = -1;   // buffer core 0 is filling
+    size_t fill = 0;
+    bool ok = true;
+
+    // Download in chunks with FreeRTOS yielding and progress updates; core 1 writes the previous buffer meanwhile
+    while ((replay ? replay->connected() : (bool)http.connected()) && contentLength > 0) {
+        if (cancelled) {
+            result->errorMessage = "Download cancelled";
+            ok = false;
+            break;
+        }
+        if (w.writeError) {
+            result->errorMessage = "File write error";
+            ok = false;
+            break;
+        }
+
+        if (current < 0) {
+            if (xQueueReceive(w.emptyQ, &current, pdMS_TO_TICKS(10000)) != pdTRUE) {
+                result->errorMessage = "Flash write stalled";
+                ok = false;
+                break;
+            }
+            fill = 0;
+        }
+
+        size_t bytesAvailable = replay ? replay->available() : stream->available();
+        if (bytesAvailable > 0) {
+            HOT_TIMER("engine.dual.chunk");   // one chunk's read, bookkeeping and hand-off to core 1
+            size_t bytesToRead = min(bytesAvailable, min(w.bufferSize - fill, (size_t)contentLength));
+            size_t bytesRead;
+            {
+                HOT_TIMER("engine.dual.read");
+                bytesRead = replay ? replay->read(w.buffers[current] + fill, bytesToRead) : stream->readBytes(w.buffers[current] + fill, bytesToRead);
+            }
+            if (arrivalTrace) arrivalTrace->record(bytesRead);
+            fill += bytesRead;
+            totalBytes += bytesRead;
+            contentLength -= bytesRead;
+            crashCountersChunk(totalBytes);
+
+            // Update performance monitoring with progress
+            if (perfMonitor) {
+                perfMonitor->updateProgress(totalBytes, originalContentLength);
+            }
+
+            // hand full buffers (and the tail) to core 1
+            if (fill == w.bufferSize || contentLength == 0) {
+                WriteChunk chunk = { current, fill };
+                xQueueSend(w.fullQ, &chunk, portMAX_DELAY);
+                current = -1;
+            }
+        } else {
+            // Yield to other tasks
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+    }
+    if (ok && totalBytes < originalContentLength) {
+        // the server dropped the connection: no tag over a truncated ciphertext, no cache entry
+        result->errorMessage = "Connection closed early: " + String((unsigned)totalBytes) + " of " + String((unsigned)originalContentLength) + " bytes";
+        ok = false;
+    }
+
+    if (ok && current >= 0 && fill > 0) {
+        WriteChunk chunk = { current, fill };
+        xQueueSend(w.fullQ, &chunk, portMAX_DELAY);
+    }
+    crashCountersPhase(PHASE_FINISHING);
+    WriteChunk eof = { -1, 0 };
+    xQueueSend(w.fullQ, &eof, portMAX_DELAY);
+    xSemaphoreTake(w.done, portMAX_DELAY);
+
+    if (ok && encrypt && !w.writeError) {
+        // core 1 has finished, so the MAC covers every ciphertext byte
+        uint8_t tag[CIPHER_TAG_SIZE];
+        cipher.macFinish(tag);
+        if (w.file.write(tag, sizeof(tag)) == sizeof(tag)) {
+            hotCacheWrite(targetPath, tag, sizeof(tag), true);
+        } else {
+            w.writeError = true;
+            hotCacheInvalidate(targetPath);
+        }
+    }
+
+    vQueueDelete(w.emptyQ);
+    vQueueDelete(w.fullQ);
+    vSemaphoreDelete(w.done);
+    w.file.close();
+    releaseBuffers();
+    http.end();
+
+    if (ok && w.writeError) {
+        result->errorMessage = "File write error";
+        ok = false;
+    }
+    result->encrypted = encrypt;
+    result->cryptoTimeMs = w.cryptoUs / 1000;
+    if (!ok) return false;
+
+    result->fileSize = originalContentLength;
+    result->totalBytes = totalBytes;
+    result->success = true;
+    if (downloadCache && !replay) downloadCache->registerDownload(url, targetPath, totalBytes + cipherOverhead, millis() - downloadStart);
+    
+    Serial.println("Core 0 download completed: " + String(totalBytes) + " bytes" + (encrypt ? " (encrypted on Core 1)" : ""));
+    
+    return true;
+}
+
+EncryptionBenchmark benchmarkEncryptedDownload(DualCoreDownloader& engine, const String& url, const String& targetPath, const uint8_t* key) {
+    EncryptionBenchmark b;
+    b.hardwareAes = StreamCipher::isHardwareAccelerated();
+    b.cipherMBps = StreamCipher::measureThroughputMBps();
+
+    Serial.println("=== ENCRYPTION BENCHMARK ===");
+    engine.setEncryptionKey(nullptr);
+    unsigned long start = millis();
+    DownloadResult plain = engine.download(url, targetPath);
+    unsigned long plainMs = millis() - start;
+
+    engine.setEncryptionKey(key);
+    start = millis();
+    DownloadResult enc = engine.download(url, targetPath);
+    unsigned long encMs = millis() - start;
+    engine.setEncryptionKey(nullptr);
+
+    if (!plain.success || !enc.success) {
+        Serial.println("Benchmark download failed: " + (plain.success ? enc.errorMessage : plain.errorMessage));
+        return b;
+    }
+
+    b.plainKBps = PerformanceMonitor::calculateSpeedKBps(plain.totalBytes, plainMs);
+    b.encryptedKBps = PerformanceMonitor::calculateSpeedKBps(enc.totalBytes, encMs);
+    b.costPercent = b.plainKBps > 0 ? (b.plainKBps - b.encryptedKBps) * 100.0f / b.plainKBps : 0.0f;
+    b.cryptoTimeMs = enc.cryptoTimeMs;
+
+    Serial.println("AES: " + String(b.hardwareAes ? "hardware" : "software") + ", keystream " + String(b.cipherMBps, 2) + " MB/s");
+    Serial.println("Plaintext: " + PerformanceMonitor::formatSpeed(b.plainKBps));
+    Serial.println("Encrypted: " + PerformanceMonitor::formatSpeed(b.encryptedKBps) + " (" + String(b.costPercent, 1) + "% slower, " +
+                   String(b.cryptoTimeMs) + " ms encrypting on Core 1)");
+    Serial.println("============================");
+    return b;
+}
@@ -1,103 +1,213 @@
-#pragma once
-#include <Arduino.h>
-#include "buffer_and_performance.h"
-
-// Abstract downloader base - humanized style
-class DownloaderBase {
-public:
-DownloaderBase() {}
-virtual ~DownloaderBase() {}
-
-// Start the download. Returns DownloadResult with metrics & status.
-virtual DownloadResult download(const String& url, const String& targetPath) = 0;
-
-// Some implementations may expose this
-virtual void cancel() { /* optional */ }
-
-// Basic helpers
-virtual String getName() const = 0;
-
-
-};
-
-// A simple HTTP fetcher - header declarations
-class HttpDownloader : public DownloaderBase {
-public:
-HttpDownloader();
-~HttpDownloader() override;
-
-DownloadResult download(const String& url, const String& targetPath) override;
-void cancel() override;
-String getName() const override { return String("HttpDownloader"); }
-
-// Exposed tuning - users may tweak if they need to
-void setBufferManager(BufferManager* mgr) { bufMgr = mgr; }
-void setPerformanceMonitor(PerformanceMonitor* m) { perf = m; }
-
-
-private:
-bool cancelled;
-BufferManager* bufMgr;
-PerformanceMonitor* perf;
-
-// small helper to actually write downloaded bytes to a file
-bool writeChunkToFile(const String& path, const uint8_t* data, size_t len, bool append);
-
-// attempted small retries for flaky networks — intentionally simple
-int maxRetries;
-
-
-};
-
-// A minimal resume-capable downloader (humanized, not over-engineered)
-class ResumeDownloader : public HttpDownloader {
-public:
-ResumeDownloader();
-~ResumeDownloader() override;
-DownloadResult download(const String& url, const String& targetPath) override;
-String getName() const override { return String("ResumeDownloader"); }
-
-private:
-// internal helper to probe remote file size
-long probeRemoteSize(const String& url);
-// a tiny helper to append to existing file
-bool appendToExistingFile(const String& path, const uint8_t* data, size_t len);
-};
-
-// Dual-core FreeRTOS downloader for high-performance parallel processing
-class DualCoreDownloader : public DownloaderBase {
-public:
-DualCoreDownloader();
-~DualCoreDownloader() override;
-
-DownloadResult download(const String& url, const String& targetPath) override;
-void cancel() override;
-String getName() const override { return String("DualCoreDownloader"); }
-
-// Configuration
-void setBufferManager(BufferManager* mgr) { bufMgr = mgr; }
-void setPerformanceMonitor(PerformanceMonitor* m) { perf = m; }
-void setChunkSize(size_t size) { chunkSize = size; }
-
-private:
-struct DownloadTask {
-    String url;
-    String targetPath;
-    DualCoreDownloader* downloader;
-    DownloadResult* result;
-    SemaphoreHandle_t completionSemaphore;
-};
-
-BufferManager* bufMgr;
-PerformanceMonitor* perf;
-size_t chunkSize;
-bool cancelled;
-
-// FreeRTOS task functions
-static void downloadTaskCore0(void* parameter);
-static void downloadTaskCore1(void* parameter);
-static void coordinatorTask(void* parameter);
-
-// Helper functions
-bool performActualDownload(const String& url, const String& targetPath, DownloadResult* result, PerformanceMonitor* perfMonitor);
-};
\ No newline at end of file
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include <functional>
+#include "buffer_and_performance.h"
+#include "digest_and_crypto.h"
+#include "arrival_trace.h"
+
+class PeerCache;
+class DownloadCache;
+class ContentStore;
+
+// Called as bytes reach flash (total file bytes, including a resumed prefix)
+typedef std::function<void(size_t bytesOnFlash)> ProgressCallback;
+const size_t DEFAULT_PROGRESS_INTERVAL = 64 * 1024;
+
+// Abstract downloader base - humanized style
+class DownloaderBase {
+public:
+DownloaderBase() {}
+virtual ~DownloaderBase() {}
+
+// Start the download. Returns DownloadResult with metrics & status.
+virtual DownloadResult download(const String& url, const String& targetPath) = 0;
+
+// Some implementations may expose this
+virtual void cancel() { /* optional */ }
+
+// Extra files that should receive the same bytes as targetPath on the next download.
+// Returns false when the engine cannot fan out; callers then copy the finished file themselves.
+virtual bool setMirrorTargets(const std::vector<String>& paths) { return false; }
+
+// Basic helpers
+virtual String getName() const = 0;
+
+
+};
+
+// A simple HTTP fetcher - header declarations
+class HttpDownloader : public DownloaderBase {
+public:
+HttpDownloader();
+~HttpDownloader() override;
+
+DownloadResult download(const String& url, const String& targetPath) override;
+void cancel() override;
+String getName() const override { return String("HttpDownloader"); }
+
+// Stop the running (or next) download at the next buffer boundary, keeping what is on flash.
+// The result comes back with paused set; continue later with downloadFrom(totalBytes).
+void requestPause() { pauseRequested = true; }
+void clearPause() { pauseRequested = false; }
+
+// Exposed tuning - users may tweak if they need to
+void setBufferManager(BufferManager* mgr) { bufMgr = mgr; }
+void setPerformanceMonitor(PerformanceMonitor* m) { perf = m; }
+
+// Try LAN peers before the origin and advertise what we download (nullptr = origin only)
+void setPeerCache(PeerCache* cache) { peerCache = cache; }
+// Register finished downloads as evictable and evict cold ones when SPIFFS is short (nullptr = just fail)
+void setDownloadCache(DownloadCache* cache) { downloadCache = cache; }
+// Keep finished downloads once per digest and link targetPath to them; with an expected digest
+// already in the store the download completes without network I/O (nullptr = plain files).
+// Stored files are shared, so they are not registered with the DownloadCache.
+void setContentStore(ContentStore* store) { contentStore = store; }
+// SHA-256 the content while streaming; the hex digest ends up in DownloadResult::contentDigest
+void setComputeDigest(bool enabled) { computeDigest = enabled; }
+// Known-good digest (hex) for the next download; a mismatch fails the download. Empty string clears it.
+void setExpectedDigest(const String& hex);
+
+bool setMirrorTargets(const std::vector<String>& paths) override { mirrorTargets = paths; return true; }
+
+// Record when and in what pieces the body arrives (nullptr = off)
+void setArrivalTrace(ArrivalTrace* trace) { arrivalTrace = trace; }
+// Take the body from a recorded trace instead of the network (nullptr = network); the URL is not contacted.
+// Replayed files are not linked from or adopted into the store, offered to peers or registered with the cache.
+void setReplaySource(ReplayStream* source) { replay = source; }
+
+// Progress every intervalBytes written to flash (nullptr to stop)
+void setProgressCallback(ProgressCallback cb, size_t intervalBytes = DEFAULT_PROGRESS_INTERVAL) {
+    progressCallback = cb;
+    progressInterval = intervalBytes;
+}
+
+// Download starting at startOffset (Range request when > 0, appending to the existing file)
+DownloadResult downloadFrom(const String& url, const String& targetPath, size_t startOffset);
+
+private:
+bool cancelled;
+volatile bool pauseRequested;
+BufferManager* bufMgr;
+PerformanceMonitor* perf;
+PeerCache* peerCache;
+DownloadCache* downloadCache;
+ContentStore* contentStore;
+ArrivalTrace* arrivalTrace;
+ReplayStream* replay;
+
+StreamingDigest digest;
+bool computeDigest;
+bool hasExpectedDigest;
+uint8_t expectedDigest[CONTENT_DIGEST_SIZE];
+
+bool digestEnabled() const { return computeDigest || hasExpectedDigest || peerCache || contentStore; }
+
+std::vector<String> mirrorTargets;
+bool mirrorsStreamed;
+
+ProgressCallback progressCallback;
+size_t progressInterval;
+void fanOutToMirrors(const String& targetPath, DownloadResult& result);
+// expected content already stored: link targetPath (and mirrors) to it
+bool linkFromContentStore(const String& targetPath, DownloadResult& result);
+
+// the HTTP part: GET (ranged when resuming) streamed to targetPath
+void streamFromOrigin(const String& url, const String& targetPath, size_t startOffset, DownloadResult& result);
+// finalize the running digest, check it against expected (may be null) and advertise on success
+bool finishDigest(const String& url, const String& targetPath, const uint8_t* expected, DownloadResult& result);
+
+// small helper to actually write downloaded bytes to a file
+bool writeChunkToFile(const String& path, const uint8_t* data, size_t len, bool append);
+
+// attempted small retries for flaky networks — intentionally simple
+int maxRetries;
+
+
+};
+
+// A minimal resume-capable downloader (humanized, not over-engineered)
+class ResumeDownloader : public HttpDownloader {
+public:
+ResumeDownloader();
+~ResumeDownloader() override;
+DownloadResult download(const String& url, const String& targetPath) override;
+String getName() const override { return String("ResumeDownloader"); }
+
+private:
+// internal helper to probe remote file size
+long probeRemoteSize(const String& url);
+// a tiny helper to append to existing file
+bool appendToExistingFile(const String& path, const uint8_t* data, size_t len);
+};
+
+// Dual-core FreeRTOS downloader for high-performance parallel processing
+class DualCoreDownloader : public DownloaderBase {
+public:
+DualCoreDownloader();
+~DualCoreDownloader() override;
+
+DownloadResult download(const String& url, const String& targetPath) override;
+void cancel() override;
+String getName() const override { return String("DualCoreDownloader"); }
+
+// Configuration
+void setBufferManager(BufferManager* mgr) { bufMgr = mgr; }
+void setPerformanceMonitor(PerformanceMonitor* m) { perf = m; }
+void setChunkSize(size_t size) { chunkSize = size; }
+BufferManager* getBufferManager() const { return bufMgr; }
+// Block the pipeline receives into and writes from: the manager's write buffers when it double
+// buffers, otherwise chunkSize
+size_t getPipelineBlockSize() const;
+bool usesManagerBuffers() const;
+void setDownloadCache(DownloadCache* cache) { downloadCache = cache; }
+// Encrypt at rest (AES-256-CTR, HMAC-SHA256 tag) in the core 1 write stage; nullptr goes back to plaintext.
+// Read the result back with EncryptedFileReader.
+bool setEncryptionKey(const uint8_t* key) { return cipher.setKey(key); }
+// Same as HttpDownloader: record the arrival pattern, or replay one instead of the network
+// (replayed files are not registered with the download cache)
+void setArrivalTrace(ArrivalTrace* trace) { arrivalTrace = trace; }
+void setReplaySource(ReplayStream* source) { replay = source; }
+
+private:
+struct WriterStage;
+
+struct DownloadTask {
+    String url;
+    String targetPath;
+    DualCoreDownloader* downloader;
+    DownloadResult* result;
+    SemaphoreHandle_t completionSemaphore;
+};
+
+BufferManager* bufMgr;
+PerformanceMonitor* perf;
+DownloadCache* downloadCache;
+ArrivalTrace* arrivalTrace;
+ReplayStream* replay;
+size_t chunkSize;
+bool cancelled;
+StreamCipher cipher;
+
+// FreeRTOS task functions
+static void downloadTaskCore0(void* parameter);
+static void downloadTaskCore1(void* parameter);   // write stage: encrypt (optional) + flash write
+static void coordinatorTask(void* parameter);
+
+// Helper functions
+bool performActualDownload(const String& url, const String& targetPath, DownloadResult* result, PerformanceMonitor* perfMonitor);
+};
+
+// Throughput of the same download written in plaintext and encrypted
+struct EncryptionBenchmark {
+float plainKBps = 0.0f;
+float encryptedKBps = 0.0f;
+float costPercent = 0.0f;        // throughput lost to encryption
+float cipherMBps = 0.0f;         // keystream speed alone, no network or flash
+unsigned long cryptoTimeMs = 0;  // time the write stage spent encrypting
+bool hardwareAes = false;
+};
+
+// Download url twice through engine (plaintext, then with key) and print the cost of encrypting.
+// Leaves engine in plaintext mode.
+EncryptionBenchmark benchmarkEncryptedDownload(DualCoreDownloader& engine, const String& url, const String& targetPath, const uint8_t* key);
\ No newline at end of file
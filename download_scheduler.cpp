@@ -0,0 +1,353 @@
+#include "download_scheduler.h"
+#include <FS.h>
+#include <SPIFFS.h>
+#include "network_and_http.h"
+
+namespace {
+const char* JOB_LOG_PATH = "/.jobq";
+const char* JOB_LOG_TMP_PATH = "/.jobq.tmp";
+
+const char* stateName(JobState s) {
+    switch (s) {
+    case JOB_PENDING: return "pending";
+    default: return "active";
+    }
+}
+}
+
+DownloadScheduler::DownloadScheduler(HttpDownloader* engine)
+: engine(engine), nextId(1), logBytes(0), checkpoints(0), lock(xSemaphoreCreateMutex()), activeJob(0), activePriority(0),
+  preemptions(0) {
+}
+
+int DownloadScheduler::find(uint32_t id) const {
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (jobs[i].id == id) return (int)i;
+    }
+    return -1;
+}
+
+bool DownloadScheduler::begin() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    jobs.clear();
+    nextId = 1;
+    logBytes = 0;
+
+    // Records, one per line:
+    //   A <id> <prio> <target> <url>   job added
+    //   C <id> <offset> <total>        checkpoint
+    //   D <id>                         job finished or cancelled
+    File f = SPIFFS.open(JOB_LOG_PATH, FILE_READ);
+    if (f) {
+        logBytes = f.size();
+        while (f.available()) {
+            String line = f.readStringUntil('\n');
+            line.trim();
+            if (line.length() < 3) continue;
+
+            char target[64];
+            unsigned id = 0, a = 0, b = 0;
+            int consumed = 0;
+            if (line[0] == 'A' && sscanf(line.c_str(), "A %u %u %63s %n", &id, &a, target, &consumed) == 3 && consumed > 0) {
+                DownloadJob job;
+                job.id = id;
+                job.priority = a;
+                job.targetPath = target;
+                job.url = line.substring(consumed);
+                job.offset = 0;
+                job.totalSize = 0;
+                job.attempts = 0;
+                job.state = JOB_PENDING;
+                job.enqueuedAt = millis();
+                job.startedAt = 0;
+                job.preemptions = 0;
+                jobs.push_back(job);
+            } else if (line[0] == 'C' && sscanf(line.c_str(), "C %u %u %u", &id, &a, &b) == 3) {
+                int i = find(id);
+                if (i >= 0) {
+                    jobs[i].offset = a;
+                    jobs[i].totalSize = b;
+                }
+            } else if (line[0] == 'D' && sscanf(line.c_str(), "D %u", &id) == 1) {
+                int i = find(id);
+                if (i >= 0) jobs.erase(jobs.begin() + i);
+            } else {
+                continue; // torn last record from a power cut
+            }
+            if (id >= nextId) nextId = id + 1;
+        }
+        f.close();
+    }
+
+    if (!jobs.empty()) {
+        Serial.println("Job queue: " + String((unsigned)jobs.size()) + " jobs to resume");
+        printQueueLocked();   // lock is not recursive
+    }
+    if (logBytes > JOB_LOG_COMPACT_BYTES) compact();
+    xSemaphoreGive(lock);
+    return true;
+}
+
+bool DownloadScheduler::appendRecord(const String& line) {
+    File f = SPIFFS.open(JOB_LOG_PATH, FILE_APPEND);
+    if (!f) {
+        Serial.println("Failed to append to job log");
+        return false;
+    }
+    size_t n = f.print(line + "\n");
+    f.close();
+    logBytes += n;
+    return n == line.length() + 1;
+}
+
+bool DownloadScheduler::compact() {
+    File f = SPIFFS.open(JOB_LOG_TMP_PATH, FILE_WRITE);
+    if (!f) return false;
+    size_t written = 0;
+    for (const auto& job : jobs) {
+        written += f.printf("A %u %u %s %s\n", (unsigned)job.id, (unsigned)job.priority, job.targetPath.c_str(), job.url.c_str());
+        if (job.offset > 0 || job.totalSize > 0) {
+            written += f.printf("C %u %u %u\n", (unsigned)job.id, (unsigned)job.offset, (unsigned)job.totalSize);
+        }
+    }
+    f.close();
+
+    SPIFFS.remove(JOB_LOG_PATH);
+    if (!SPIFFS.rename(JOB_LOG_TMP_PATH, JOB_LOG_PATH)) {
+        Serial.println("Job log compaction failed");
+        return false;
+    }
+    logBytes = written;
+    return true;
+}
+
+uint32_t DownloadScheduler::enqueue(const String& url, const String& targetPath, uint8_t priority) {
+    DownloadJob job;
+    job.priority = priority;
+    job.url = url;
+    job.targetPath = targetPath;
+    job.offset = 0;
+    job.totalSize = 0;
+    job.attempts = 0;
+    job.state = JOB_PENDING;
+    job.enqueuedAt = millis();
+    job.startedAt = 0;
+    job.preemptions = 0;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    job.id = nextId++;
+    if (!appendRecord("A " + String(job.id) + " " + String(priority) + " " + targetPath + " " + url)) {
+        xSemaphoreGive(lock);
+        return 0;
+    }
+    jobs.push_back(job);
+
+    // urgent work takes the engine at the running job's next buffer boundary
+    if (activeJob != 0 && priority > activePriority && engine) {
+        Serial.println("Job " + String(job.id) + " (p" + String(priority) + ") preempts job " + String(activeJob));
+        engine->requestPause();
+    }
+    xSemaphoreGive(lock);
+    return job.id;
+}
+
+bool DownloadScheduler::cancel(uint32_t id) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int i = find(id);
+    bool ok = i >= 0 && jobs[i].state != JOB_ACTIVE;
+    if (ok) finish(id);
+    xSemaphoreGive(lock);
+    return ok;
+}
+
+void DownloadScheduler::finish(uint32_t id) {
+    int i = find(id);
+    if (i < 0) return;
+    jobs.erase(jobs.begin() + i);
+    appendRecord("D " + String(id));
+    if (logBytes > JOB_LOG_COMPACT_BYTES) compact();
+}
+
+void DownloadScheduler::checkpoint(DownloadJob& job, size_t offset) {
+    job.offset = offset;
+    appendRecord("C " + String(job.id) + " " + String((unsigned)offset) + " " + String((unsigned)job.totalSize));
+    checkpoints++;
+}
+
+size_t DownloadScheduler::resumeOffset(const DownloadJob& job) const {
+    if (job.offset == 0) return 0;
+
+    size_t onFlash = 0;
+    File f = SPIFFS.open(job.targetPath, FILE_READ);
+    if (f) {
+        onFlash = f.size();
+        f.close();
+    }
+    // The checkpoint is a floor: chunks are closed as they are written, so anything past it is
+    // on flash too. A shorter file means it was replaced or lost; start that job over.
+    return onFlash >= job.offset ? onFlash : 0;
+}
+
+size_t DownloadScheduler::pendingCount() const {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    size_t n = 0;
+    for (const auto& job : jobs) {
+        if (job.state == JOB_PENDING) n++;
+    }
+    xSemaphoreGive(lock);
+    return n;
+}
+
+std::vector<DownloadJob> DownloadScheduler::getJobs() const {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    std::vector<DownloadJob> copy = jobs;
+    xSemaphoreGive(lock);
+    return copy;
+}
+
+void DownloadScheduler::recordCompletion(const DownloadJob& job) {
+    JobLatencyStats& l = latency[min((int)job.priority, JOB_PRIORITY_LEVELS - 1)];
+    unsigned long total = millis() - job.enqueuedAt;
+    l.completed++;
+    l.sumWaitMs += job.startedAt - job.enqueuedAt;
+    l.sumTotalMs += total;
+    if (total > l.maxTotalMs) l.maxTotalMs = total;
+}
+
+JobLatencyStats DownloadScheduler::getLatency(uint8_t priority) const {
+    return latency[min((int)priority, JOB_PRIORITY_LEVELS - 1)];
+}
+
+bool DownloadScheduler::runNext() {
+    if (!engine) return false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    // highest priority first, FIFO within a priority (ids grow with enqueue order)
+    int pick = -1;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (jobs[i].state != JOB_PENDING) continue;
+        if (pick < 0 || jobs[i].priority > jobs[pick].priority) pick = (int)i;
+    }
+    if (pick < 0) {
+        xSemaphoreGive(lock);
+        return false;
+    }
+
+    DownloadJob& job = jobs[pick];
+    uint32_t id = job.id;
+    job.state = JOB_ACTIVE;
+    job.attempts++;
+    if (job.startedAt == 0) job.startedAt = millis();
+    String url = job.url;
+    String targetPath = job.targetPath;
+    size_t from = resumeOffset(job);
+    size_t total = job.totalSize;
+
+    // a pause aimed at the previous job must not stop this one
+    engine->clearPause();
+    activeJob = id;
+    activePriority = job.priority;
+    xSemaphoreGive(lock);
+
+    // A reset between the last write and the D record leaves a complete file behind; asking for
+    // bytes=<size>- would only earn a 416. Checkpoints logged before the size was known carry 0.
+    if (from > 0 && total == 0) {
+        HttpResponse head = httpHead(url);
+        if (head.ok && head.contentLength > 0) total = head.contentLength;
+    }
+    if (total > 0 && from >= total) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        activeJob = 0;
+        int i = find(id);
+        if (i >= 0) {
+            Serial.println("Job " + String(id) + " was already complete on flash (" + String((unsigned)from) + " bytes)");
+            recordCompletion(jobs[i]);
+            finish(id);
+        }
+        xSemaphoreGive(lock);
+        return true;
+    }
+
+    Serial.println("Job " + String(id) + ": " + url + (from > 0 ? " (resuming at " + String((unsigned)from) + ")" : ""));
+
+    engine->setProgressCallback([this, id](size_t onFlash) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        int i = find(id);
+        if (i >= 0) checkpoint(jobs[i], onFlash);
+        xSemaphoreGive(lock);
+    }, JOB_CHECKPOINT_BYTES);
+    DownloadResult r = engine->downloadFrom(url, targetPath, from);
+    engine->setProgressCallback(nullptr);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    activeJob = 0;
+    int i = find(id);
+    if (i < 0) {
+        xSemaphoreGive(lock);
+        return true;
+    }
+
+    DownloadJob& done = jobs[i];
+    if (r.success) {
+        Serial.println("Job " + String(id) + " done: " + String((unsigned)r.totalBytes) + " bytes");
+        recordCompletion(done);
+        finish(id);
+    } else if (r.paused) {
+        // not a failure: the bytes so far are on flash and the connection is simply dropped
+        Serial.println("Job " + String(id) + " paused at " + String((unsigned)r.totalBytes) + " bytes");
+        done.state = JOB_PENDING;
+        done.attempts--;
+        done.preemptions++;
+        preemptions++;
+        if (r.fileSize > 0) done.totalSize = r.fileSize;
+        if (r.totalBytes > done.offset) checkpoint(done, r.totalBytes);
+    } else if (done.attempts >= MAX_JOB_ATTEMPTS) {
+        Serial.println("Job " + String(id) + " failed after " + String(done.attempts) + " attempts: " + r.errorMessage);
+        finish(id);
+    } else {
+        Serial.println("Job " + String(id) + " failed (" + r.errorMessage + "), will retry");
+        done.state = JOB_PENDING;
+        // an attempt that failed before the headers knows no size: keep what we had
+        if (r.fileSize > 0) done.totalSize = r.fileSize;
+        if (r.totalBytes > done.offset) checkpoint(done, r.totalBytes);
+    }
+    xSemaphoreGive(lock);
+    return true;
+}
+
+void DownloadScheduler::runAll() {
+    while (runNext()) {
+    }
+}
+
+void DownloadScheduler::printQueue() const {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    printQueueLocked();
+    xSemaphoreGive(lock);
+}
+
+void DownloadScheduler::printQueueLocked() const {
+    Serial.println("=== DOWNLOAD QUEUE ===");
+    for (const auto& job : jobs) {
+        Serial.printf("#%u p%u %-8s %8u/%-8u %s -> %s\n", (unsigned)job.id, (unsigned)job.priority, stateName(job.state),
+                      (unsigned)job.offset, (unsigned)job.totalSize, job.url.c_str(), job.targetPath.c_str());
+    }
+    Serial.println("Log: " + String((unsigned)logBytes) + " bytes, checkpoints this boot: " + String((unsigned)checkpoints));
+    Serial.println("======================");
+}
+
+void DownloadScheduler::printLatencyReport() const {
+    static const char* names[JOB_PRIORITY_LEVELS] = { "low", "normal", "high" };
+    Serial.println("=== JOB LATENCY ===");
+    Serial.printf("%-8s %6s %10s %10s %10s\n", "Priority", "done", "avg wait", "avg total", "max total");
+    for (int p = JOB_PRIORITY_LEVELS - 1; p >= 0; --p) {
+        const JobLatencyStats& l = latency[p];
+        if (l.completed == 0) continue;
+        Serial.printf("%-8s %6u %10s %10s %10s\n", names[p], (unsigned)l.completed,
+                      PerformanceMonitor::formatTime(l.sumWaitMs / l.completed).c_str(),
+                      PerformanceMonitor::formatTime(l.sumTotalMs / l.completed).c_str(),
+                      PerformanceMonitor::formatTime(l.maxTotalMs).c_str());
+    }
+    Serial.println("Preemptions: " + String((unsigned)preemptions));
+    Serial.println("===================");
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "download_engines.h"
+
+// Persistent download job queue. Jobs (priority, URL, target, durable offset) live in an
+// append-only log on SPIFFS that is replayed on boot, so a reboot mid-sync resumes instead
+// of restarting. Offsets are logged every checkpoint interval, not per chunk.
+// Enqueueing a higher-priority job (from any task) pauses the running one at a buffer boundary;
+// the urgent job gets the engine and its buffers, and the paused job resumes with a Range request.
+
+const uint8_t JOB_PRIORITY_LOW = 0;
+const uint8_t JOB_PRIORITY_NORMAL = 1;
+const uint8_t JOB_PRIORITY_HIGH = 2;
+const int JOB_PRIORITY_LEVELS = 3;
+
+const size_t JOB_CHECKPOINT_BYTES = 64 * 1024;
+const size_t JOB_LOG_COMPACT_BYTES = 4096;   // rewrite the log once it grows past this
+const int MAX_JOB_ATTEMPTS = 3;
+
+enum JobState {
+JOB_PENDING,
+JOB_ACTIVE
+};
+
+struct DownloadJob {
+uint32_t id;
+uint8_t priority;
+String url;
+String targetPath;
+size_t offset;      // last checkpointed bytes on flash
+size_t totalSize;   // 0 until known
+int attempts;
+JobState state;
+unsigned long enqueuedAt;   // millis(); boot time for jobs reloaded from the log
+unsigned long startedAt;    // first time the job got the engine (0 = not yet)
+int preemptions;
+};
+
+// Enqueue-to-done latency per priority, for seeing how urgent jobs fare under load
+struct JobLatencyStats {
+size_t completed;
+unsigned long sumWaitMs;    // enqueue -> first byte requested
+unsigned long sumTotalMs;   // enqueue -> done
+unsigned long maxTotalMs;
+JobLatencyStats() : completed(0), sumWaitMs(0), sumTotalMs(0), maxTotalMs(0) {}
+};
+
+class DownloadScheduler {
+public:
+explicit DownloadScheduler(HttpDownloader* engine);
+
+// Replay the job log; jobs that were running when we went down become pending again
+bool begin();
+
+// Safe to call from other tasks while runNext() is busy; a higher priority preempts the running job
+uint32_t enqueue(const String& url, const String& targetPath, uint8_t priority = JOB_PRIORITY_NORMAL);
+bool cancel(uint32_t id);
+
+// Run the highest-priority pending job; false when there was nothing to run
+bool runNext();
+void runAll();
+
+size_t pendingCount() const;
+std::vector<DownloadJob> getJobs() const;
+void printQueue() const;
+
+JobLatencyStats getLatency(uint8_t priority) const;
+size_t getPreemptions() const { return preemptions; }
+void printLatencyReport() const;
+
+private:
+HttpDownloader* engine;
+std::vector<DownloadJob> jobs;
+uint32_t nextId;
+size_t logBytes;
+size_t checkpoints;
+SemaphoreHandle_t lock;
+uint32_t activeJob;   // id of the job holding the engine, 0 when idle
+uint8_t activePriority;
+size_t preemptions;
+JobLatencyStats latency[JOB_PRIORITY_LEVELS];
+
+int find(uint32_t id) const;
+size_t resumeOffset(const DownloadJob& job) const;
+bool appendRecord(const String& line);
+void checkpoint(DownloadJob& job, size_t offset);
+void finish(uint32_t id);
+void recordCompletion(const DownloadJob& job);
+bool compact();
+void printQueueLocked() const;   // caller holds lock
+};
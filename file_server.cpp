@@ -0,0 +1,425 @@
+#include "file_server.h"
+#include <FS.h>
+#include <SPIFFS.h>
+#include "buffer_and_performance.h"
+#include "spiffs_management.h"
+
+// A filled (or end-of-file when len == 0) buffer handed from reader to sender
+struct FileChunk {
+    uint8_t* data;
+    size_t len;
+};
+
+struct FileServer::Session {
+    FileServer* owner;
+    WiFiClient client;
+    File file;
+    uint8_t* buffers[FILE_SERVER_BUFFERS_PER_CLIENT];
+    QueueHandle_t emptyQ;   // buffers the reader may fill
+    QueueHandle_t fullQ;    // buffers waiting to be sent
+    SemaphoreHandle_t readerDone;
+    size_t remaining;       // bytes the reader still has to produce
+    size_t offset;          // where the reader is in the file
+    String stored;          // SPIFFS path behind the request (blob for a store reference)
+    volatile bool aborted;
+    unsigned long acceptMs;
+    unsigned long firstByteMs;
+    String path;
+};
+
+namespace {
+
+// "%2F" style escapes are all we expect from curl/browsers for SPIFFS names
+String urlDecode(const String& in) {
+    String out;
+    out.reserve(in.length());
+    for (unsigned int i = 0; i < in.length(); ++i) {
+        char c = in[i];
+        if (c == '%' && i + 2 < in.length()) {
+            char hex[3] = { in[i + 1], in[i + 2], '\0' };
+            out += (char)strtol(hex, nullptr, 16);
+            i += 2;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// Parses "bytes=a-b", "bytes=a-" and "bytes=-n"; false if unsatisfiable
+bool parseRange(const String& spec, size_t size, size_t& first, size_t& last) {
+    if (!spec.startsWith("bytes=") || size == 0) return false;
+    String r = spec.substring(6);
+    int dash = r.indexOf('-');
+    if (dash < 0) return false;
+    String a = r.substring(0, dash);
+    String b = r.substring(dash + 1);
+    if (a.length() == 0) {
+        size_t suffix = (size_t)b.toInt();
+        if (suffix == 0) return false;
+        first = suffix >= size ? 0 : size - suffix;
+        last = size - 1;
+        return true;
+    }
+    first = (size_t)a.toInt();
+    last = b.length() > 0 ? (size_t)b.toInt() : size - 1;
+    if (last >= size) last = size - 1;
+    return first <= last;
+}
+
+} // namespace
+
+FileServer::FileServer(uint16_t p)
+: server(p), port(p), root(FILE_SERVER_DEFAULT_ROOT), running(false), pool(nullptr), chunkSize(0), bufferCount(0), freeBuffers(nullptr),
+  statsLock(nullptr), acceptTaskHandle(nullptr), recentCount(0), recentNext(0) {
+}
+
+FileServer::~FileServer() {
+    end();
+}
+
+void FileServer::setRoot(const String& prefix) {
+    root = prefix;
+    while (root.endsWith("/")) root.remove(root.length() - 1);
+}
+
+// Request path -> SPIFFS path under the root; false for anything that must not be served
+bool FileServer::mapPath(const String& requestPath, String& spiffsPath) const {
+    if (!requestPath.startsWith("/") || requestPath.indexOf("/.") >= 0) return false;
+    for (unsigned int i = 0; i < requestPath.length(); ++i) {
+        if ((uint8_t)requestPath[i] < 0x20) return false;
+    }
+    spiffsPath = root + requestPath;
+    return !spiffsPath.startsWith("/cas/");
+}
+
+bool FileServer::begin(size_t memoryBudget, size_t chunk) {
+    if (running) return true;
+
+    chunkSize = chunk;
+    bufferCount = memoryBudget / chunkSize;
+    if (bufferCount < FILE_SERVER_BUFFERS_PER_CLIENT) {
+        Serial.println("File server: budget too small for a single client");
+        return false;
+    }
+
+    BufferManager tmp;
+    if (!tmp.hasEnoughMemory(bufferCount * chunkSize)) {
+        Serial.println("File server: not enough heap for " + String((unsigned)(bufferCount * chunkSize / 1024)) + " KB pool");
+        return false;
+    }
+
+    pool = (uint8_t*)malloc(bufferCount * chunkSize);
+    freeBuffers = xQueueCreate(bufferCount, sizeof(uint8_t*));
+    statsLock = xSemaphoreCreateMutex();
+    if (!pool || !freeBuffers || !statsLock) {
+        Serial.println("File server: allocation failed");
+        end();
+        return false;
+    }
+    for (size_t i = 0; i < bufferCount; ++i) {
+        uint8_t* b = pool + i * chunkSize;
+        xQueueSend(freeBuffers, &b, 0);
+    }
+
+    server.begin();
+    server.setNoDelay(true);
+    running = true;
+
+    if (xTaskCreatePinnedToCore(acceptTask, "FileSrvAccept", 4096, this, 1, &acceptTaskHandle, 0) != pdPASS) {
+        end();
+        return false;
+    }
+
+    Serial.println("File server on port " + String(port) + ": " + String((unsigned)bufferCount) + " x " +
+                   String((unsigned)(chunkSize / 1024)) + " KB buffers, up to " + String(getMaxClients()) + " clients");
+    return true;
+}
+
+void FileServer::end() {
+    if (running) {
+        running = false;
+        // let the accept loop and any sessions notice
+        vTaskDelay(pdMS_TO_TICKS(200));
+        server.end();
+    }
+    while (stats.activeClients > 0) vTaskDelay(pdMS_TO_TICKS(50));
+    if (freeBuffers) {
+        vQueueDelete(freeBuffers);
+        freeBuffers = nullptr;
+    }
+    if (statsLock) {
+        vSemaphoreDelete(statsLock);
+        statsLock = nullptr;
+    }
+    if (pool) {
+        free(pool);
+        pool = nullptr;
+    }
+}
+
+void FileServer::acceptTask(void* parameter) {
+    FileServer* self = static_cast<FileServer*>(parameter);
+    while (self->running) {
+        WiFiClient client = self->server.available();
+        if (!client) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+
+        Session* s = new Session();
+        s->owner = self;
+        s->client = client;
+        s->acceptMs = millis();
+        s->aborted = false;
+        s->remaining = 0;
+        s->firstByteMs = 0;
+        s->emptyQ = nullptr;
+        s->fullQ = nullptr;
+        s->readerDone = nullptr;
+
+        // lease a buffer pair up front; if the pool is dry we are at the memory budget
+        bool leased = true;
+        for (size_t i = 0; i < FILE_SERVER_BUFFERS_PER_CLIENT; ++i) {
+            s->buffers[i] = nullptr;
+            if (xQueueReceive(self->freeBuffers, &s->buffers[i], 0) != pdTRUE) leased = false;
+        }
+        if (!leased) {
+            for (size_t i = 0; i < FILE_SERVER_BUFFERS_PER_CLIENT; ++i) {
+                if (s->buffers[i]) xQueueSend(self->freeBuffers, &s->buffers[i], 0);
+            }
+            s->client.print("HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            s->client.stop();
+            delete s;
+            xSemaphoreTake(self->statsLock, portMAX_DELAY);
+            self->stats.rejectedBusy++;
+            xSemaphoreGive(self->statsLock);
+            continue;
+        }
+
+        xSemaphoreTake(self->statsLock, portMAX_DELAY);
+        self->stats.activeClients++;
+        xSemaphoreGive(self->statsLock);
+
+        if (xTaskCreatePinnedToCore(sessionTask, "FileSrvSend", 6144, s, 2, nullptr, 0) != pdPASS) {
+            self->finishSession(s, 500, 0);
+        }
+    }
+    vTaskDelete(nullptr);
+}
+
+void FileServer::sessionTask(void* parameter) {
+    Session* s = static_cast<Session*>(parameter);
+    s->owner->handle(s);
+    vTaskDelete(nullptr);
+}
+
+void FileServer::readerTask(void* parameter) {
+    Session* s = static_cast<Session*>(parameter);
+    FileServer* self = s->owner;
+
+    while (s->remaining > 0 && !s->aborted) {
+        FileChunk chunk;
+        if (xQueueReceive(s->emptyQ, &chunk.data, pdMS_TO_TICKS(FILE_SERVER_IO_TIMEOUT_MS)) != pdTRUE) break;
+        chunk.len = readFromSPIFFS(s->file, s->stored, s->offset, chunk.data, min(self->chunkSize, s->remaining));
+        if (chunk.len == 0) break;
+        s->offset += chunk.len;
+        s->remaining -= chunk.len;
+        xQueueSend(s->fullQ, &chunk, portMAX_DELAY);
+    }
+
+    // end-of-stream marker (also sent on error; sender compares byte counts)
+    FileChunk eof = { nullptr, 0 };
+    xQueueSend(s->fullQ, &eof, portMAX_DELAY);
+    xSemaphoreGive(s->readerDone);
+    vTaskDelete(nullptr);
+}
+
+void FileServer::handle(Session* s) {
+    WiFiClient& client = s->client;
+    client.setTimeout(FILE_SERVER_IO_TIMEOUT_MS);
+
+    String requestLine = client.readStringUntil('\n');
+    String rangeHeader = "";
+    while (client.connected()) {
+        String header = client.readStringUntil('\n');
+        header.trim();
+        if (header.length() == 0) break;
+        if (header.startsWith("Range:") || header.startsWith("range:")) {
+            rangeHeader = header.substring(6);
+            rangeHeader.trim();
+        }
+    }
+
+    int sp1 = requestLine.indexOf(' ');
+    int sp2 = requestLine.indexOf(' ', sp1 + 1);
+    String method = sp1 > 0 ? requestLine.substring(0, sp1) : String("");
+    s->path = (sp1 > 0 && sp2 > sp1) ? urlDecode(requestLine.substring(sp1 + 1, sp2)) : String("");
+    bool headOnly = method == "HEAD";
+
+    if ((method != "GET" && !headOnly) || s->path.length() == 0) {
+        client.print("HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        finishSession(s, 405, 0);
+        return;
+    }
+
+    if (s->path == "/") {
+        // plain-text index so a human with curl can see what is there (served files only)
+        String listing;
+        String prefix = root + "/";
+        File dir = SPIFFS.open("/");
+        File f = dir.openNextFile();
+        while (f) {
+            String name = f.path();
+            String mapped;
+            if (name.startsWith(prefix) && mapPath(name.substring(root.length()), mapped)) {
+                listing += name.substring(root.length()) + "\t" + String((unsigned)f.size()) + "\n";
+            }
+            f = dir.openNextFile();
+        }
+        client.printf("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: %u\r\nConnection: close\r\n\r\n", listing.length());
+        if (!headOnly) client.print(listing);
+        finishSession(s, 200, headOnly ? 0 : listing.length());
+        return;
+    }
+
+    String stored;
+    if (mapPath(s->path, stored)) {
+        s->stored = resolveSPIFFSPath(stored);
+        s->file = SPIFFS.open(s->stored, FILE_READ);
+    }
+    if (!s->file || s->file.isDirectory()) {
+        client.print("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        finishSession(s, 404, 0);
+        return;
+    }
+    downloadCacheTouch(stored);
+
+    size_t size = s->file.size();
+    size_t first = 0, last = size > 0 ? size - 1 : 0;
+    int status = 200;
+    if (rangeHeader.length() > 0) {
+        if (!parseRange(rangeHeader, size, first, last)) {
+            client.printf("HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%u\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", (unsigned)size);
+            finishSession(s, 416, 0);
+            return;
+        }
+        status = 206;
+    }
+    size_t length = size > 0 ? last - first + 1 : 0;
+
+    String head = status == 206 ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+    if (status == 206) head += "Content-Range: bytes " + String((unsigned)first) + "-" + String((unsigned)last) + "/" + String((unsigned)size) + "\r\n";
+    head += "Accept-Ranges: bytes\r\nContent-Type: application/octet-stream\r\nContent-Length: " + String((unsigned)length) + "\r\nConnection: close\r\n\r\n";
+    client.print(head);
+
+    if (headOnly || length == 0) {
+        finishSession(s, status, 0);
+        return;
+    }
+
+    s->offset = first;
+    s->remaining = length;
+    s->emptyQ = xQueueCreate(FILE_SERVER_BUFFERS_PER_CLIENT, sizeof(uint8_t*));
+    s->fullQ = xQueueCreate(FILE_SERVER_BUFFERS_PER_CLIENT + 1, sizeof(FileChunk));
+    s->readerDone = xSemaphoreCreateBinary();
+    for (size_t i = 0; i < FILE_SERVER_BUFFERS_PER_CLIENT; ++i) xQueueSend(s->emptyQ, &s->buffers[i], 0);
+
+    if (xTaskCreatePinnedToCore(readerTask, "FileSrvRead", 4096, s, 2, nullptr, 1) != pdPASS) {
+        finishSession(s, 500, 0);
+        return;
+    }
+
+    size_t sent = 0;
+    bool firstByte = true;
+    while (true) {
+        FileChunk chunk;
+        if (xQueueReceive(s->fullQ, &chunk, pdMS_TO_TICKS(FILE_SERVER_IO_TIMEOUT_MS)) != pdTRUE) {
+            s->aborted = true;
+            break;
+        }
+        if (chunk.len == 0) break;
+
+        if (!s->aborted) {
+            if (client.write(chunk.data, chunk.len) != chunk.len) {
+                s->aborted = true; // client went away; let the reader wind down
+            } else {
+                sent += chunk.len;
+                if (firstByte) {
+                    firstByte = false;
+                    xSemaphoreTake(statsLock, portMAX_DELAY);
+                    s->firstByteMs = millis() - s->acceptMs;
+                    stats.sumFirstByteMs += s->firstByteMs;
+                    if (s->firstByteMs > stats.maxFirstByteMs) stats.maxFirstByteMs = s->firstByteMs;
+                    xSemaphoreGive(statsLock);
+                }
+            }
+        }
+        xQueueSend(s->emptyQ, &chunk.data, portMAX_DELAY);
+    }
+
+    xSemaphoreTake(s->readerDone, portMAX_DELAY);
+    finishSession(s, status, sent);
+}
+
+void FileServer::finishSession(Session* s, int status, size_t bytes) {
+    unsigned long totalMs = millis() - s->acceptMs;
+    if (s->file) s->file.close();
+    s->client.stop();
+
+    for (size_t i = 0; i < FILE_SERVER_BUFFERS_PER_CLIENT; ++i) {
+        if (s->buffers[i]) xQueueSend(freeBuffers, &s->buffers[i], 0);
+    }
+    if (s->emptyQ) vQueueDelete(s->emptyQ);
+    if (s->fullQ) vQueueDelete(s->fullQ);
+    if (s->readerDone) vSemaphoreDelete(s->readerDone);
+
+    xSemaphoreTake(statsLock, portMAX_DELAY);
+    stats.requests++;
+    stats.bytesServed += bytes;
+    stats.busyMs += totalMs;
+    stats.activeClients--;
+    FileServerClientRecord& rec = recent[recentNext];
+    rec.path = s->path;
+    rec.status = status;
+    rec.bytes = bytes;
+    rec.totalMs = totalMs;
+    rec.firstByteMs = s->firstByteMs;
+    recentNext = (recentNext + 1) % FILE_SERVER_RECENT_CLIENTS;
+    if (recentCount < FILE_SERVER_RECENT_CLIENTS) recentCount++;
+    xSemaphoreGive(statsLock);
+
+    delete s;
+}
+
+FileServerStats FileServer::getStats() const {
+    FileServerStats copy;
+    if (!statsLock) return stats;
+    xSemaphoreTake(statsLock, portMAX_DELAY);
+    copy = stats;
+    xSemaphoreGive(statsLock);
+    return copy;
+}
+
+void FileServer::printStats() const {
+    FileServerStats st = getStats();
+    Serial.println("=== FILE SERVER ===");
+    Serial.println("Requests: " + String((unsigned)st.requests) + " (rejected busy: " + String((unsigned)st.rejectedBusy) +
+                   ", active: " + String(st.activeClients) + ")");
+    Serial.println("Served: " + PerformanceMonitor::formatBytes(st.bytesServed));
+    if (st.busyMs > 0) {
+        // per-client average; concurrent clients add up to more than this
+        Serial.printf("Throughput: %.2f MB/s per client\n", (st.bytesServed / (1024.0f * 1024.0f)) * 1000.0f / st.busyMs);
+    }
+    if (st.requests > 0) {
+        Serial.println("First byte latency: avg " + String(st.sumFirstByteMs / st.requests) + " ms, max " + String(st.maxFirstByteMs) + " ms");
+    }
+    Serial.println("Recent clients:");
+    for (int i = 0; i < recentCount; ++i) {
+        const FileServerClientRecord& r = recent[(recentNext - recentCount + i + FILE_SERVER_RECENT_CLIENTS) % FILE_SERVER_RECENT_CLIENTS];
+        float mbps = r.totalMs > 0 ? (r.bytes / (1024.0f * 1024.0f)) * 1000.0f / r.totalMs : 0.0f;
+        Serial.printf("  %3d %-28s %10u B ttfb %5lu ms total %6lu ms %6.2f MB/s\n",
+                      r.status, r.path.c_str(), (unsigned)r.bytes, r.firstByteMs, r.totalMs, mbps);
+    }
+    Serial.println("===================");
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+
+// Built-in HTTP file server for pulling logs and captures off the device.
+// Each client leases two pooled buffers: a reader task on core 1 fills one from SPIFFS
+// while the client's task on core 0 sends the other, so flash and socket overlap.
+// There is no authentication, so only files under the served root are reachable ("/x" is
+// <root>/x). Dot-files and the content store (/cas/) are refused even when the root is "/".
+
+const uint16_t FILE_SERVER_PORT = 80;
+const size_t FILE_SERVER_CHUNK_SIZE = 16384;
+const size_t FILE_SERVER_DEFAULT_BUDGET = 128 * 1024;  // total pool memory; caps concurrent clients
+const size_t FILE_SERVER_BUFFERS_PER_CLIENT = 2;
+const unsigned long FILE_SERVER_IO_TIMEOUT_MS = 5000;
+const int FILE_SERVER_RECENT_CLIENTS = 8;
+const char* const FILE_SERVER_DEFAULT_ROOT = "/pub";   // copy files here to share them
+
+// One finished request, kept for the latency report
+struct FileServerClientRecord {
+String path;
+int status;
+size_t bytes;
+unsigned long firstByteMs;  // accept -> first body byte on the wire
+unsigned long totalMs;      // accept -> connection closed
+};
+
+struct FileServerStats {
+size_t requests;
+size_t rejectedBusy;
+size_t bytesServed;
+unsigned long busyMs;        // summed per-client transfer time
+unsigned long maxFirstByteMs;
+unsigned long sumFirstByteMs;
+int activeClients;
+FileServerStats() : requests(0), rejectedBusy(0), bytesServed(0), busyMs(0), maxFirstByteMs(0), sumFirstByteMs(0), activeClients(0) {}
+};
+
+class FileServer {
+public:
+explicit FileServer(uint16_t port = FILE_SERVER_PORT);
+~FileServer();
+
+// Allocate the buffer pool (memoryBudget / chunkSize buffers) and start accepting
+bool begin(size_t memoryBudget = FILE_SERVER_DEFAULT_BUDGET, size_t chunkSize = FILE_SERVER_CHUNK_SIZE);
+void end();
+// SPIFFS prefix that request paths are served from ("" or "/" = everything but dot-files and /cas/)
+void setRoot(const String& prefix);
+
+int getMaxClients() const { return (int)(bufferCount / FILE_SERVER_BUFFERS_PER_CLIENT); }
+FileServerStats getStats() const;
+void printStats() const;
+
+private:
+struct Session;
+
+WiFiServer server;
+uint16_t port;
+String root;                 // no trailing slash; "" = whole filesystem
+volatile bool running;
+uint8_t* pool;
+size_t chunkSize;
+size_t bufferCount;
+QueueHandle_t freeBuffers;   // uint8_t* entries
+SemaphoreHandle_t statsLock;
+TaskHandle_t acceptTaskHandle;
+
+FileServerStats stats;
+FileServerClientRecord recent[FILE_SERVER_RECENT_CLIENTS];
+int recentCount;
+int recentNext;
+
+static void acceptTask(void* parameter);
+static void sessionTask(void* parameter);
+static void readerTask(void* parameter);
+
+void handle(Session* s);
+bool mapPath(const String& requestPath, String& spiffsPath) const;
+void finishSession(Session* s, int status, size_t bytes);
+};
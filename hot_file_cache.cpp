@@ -0,0 +1,203 @@
+#include "hot_file_cache.h"
+#include "buffer_and_performance.h"
+#include <FS.h>
+#include <SPIFFS.h>
+#include <esp_heap_caps.h>
+
+HotFileCache::HotFileCache()
+: budget(0), maxFile(0), usedBytes(0), useClock(0), enabled(false), lock(xSemaphoreCreateMutex()) {
+}
+
+HotFileCache::~HotFileCache() {
+    end();
+}
+
+bool HotFileCache::begin(size_t budgetBytes, size_t maxFileBytes) {
+    if (ESP.getPsramSize() == 0) {
+        Serial.println("Hot file cache disabled: no PSRAM");
+        return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    budget = min(budgetBytes, (size_t)ESP.getFreePsram() / 2);
+    maxFile = maxFileBytes > 0 ? maxFileBytes : budget / 4;
+    enabled = true;
+    xSemaphoreGive(lock);
+    Serial.println("Hot file cache: " + PerformanceMonitor::formatBytes(budget) + " PSRAM, files up to " +
+                   PerformanceMonitor::formatBytes(maxFile));
+    return true;
+}
+
+void HotFileCache::end() {
+    clear();
+    enabled = false;
+}
+
+int HotFileCache::find(const String& path) const {
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].path == path) return (int)i;
+    }
+    return -1;
+}
+
+void HotFileCache::drop(int index) {
+    usedBytes -= entries[index].capacity;
+    if (entries[index].data) heap_caps_free(entries[index].data);
+    entries.erase(entries.begin() + index);
+}
+
+bool HotFileCache::makeRoom(size_t bytes, const String& keep) {
+    while (usedBytes + bytes > budget) {
+        int victim = -1;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].path == keep) continue;
+            if (victim < 0 || entries[i].lastUse < entries[victim].lastUse) victim = (int)i;
+        }
+        if (victim < 0) return false;
+        drop(victim);
+        stats.evictions++;
+    }
+    return true;
+}
+
+bool HotFileCache::grow(const String& path, size_t capacity) {
+    int i = find(path);
+    size_t have = entries[i].capacity;
+    if (capacity <= have) return true;
+
+    // geometric growth so a streamed download does not realloc per chunk
+    size_t want = max(capacity, min(have * 2, maxFile));
+    if (!makeRoom(want - have, path)) return false;
+    i = find(path); // eviction may have shifted the entry
+    uint8_t* grown = (uint8_t*)heap_caps_realloc(entries[i].data, want, MALLOC_CAP_SPIRAM);
+    if (!grown) return false;
+    usedBytes += want - have;
+    entries[i].data = grown;
+    entries[i].capacity = want;
+    return true;
+}
+
+void HotFileCache::write(const String& path, const uint8_t* data, size_t len, bool append) {
+    if (!enabled) return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int i = find(path);
+    if (i < 0 && append) {
+        // we do not have the prefix; nothing to keep coherent
+        xSemaphoreGive(lock);
+        return;
+    }
+    if (i < 0) {
+        Entry e = { path, nullptr, 0, 0, 0 };
+        entries.push_back(e);
+        i = entries.size() - 1;
+    } else if (!append) {
+        entries[i].size = 0;
+    }
+
+    entries[i].lastUse = ++useClock;
+    size_t newSize = entries[i].size + len;
+    if (newSize > maxFile || !grow(path, newSize)) {
+        drop(find(path));
+        stats.invalidations++;
+    } else {
+        Entry& e = entries[find(path)];
+        if (len > 0) memcpy(e.data + e.size, data, len);
+        e.size = newSize;
+        stats.writeThroughBytes += len;
+    }
+    xSemaphoreGive(lock);
+}
+
+void HotFileCache::invalidate(const String& path) {
+    if (!enabled) return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int i = find(path);
+    if (i >= 0) {
+        drop(i);
+        stats.invalidations++;
+    }
+    xSemaphoreGive(lock);
+}
+
+void HotFileCache::clear() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    while (!entries.empty()) drop(entries.size() - 1);
+    xSemaphoreGive(lock);
+}
+
+bool HotFileCache::read(const String& path, size_t offset, uint8_t* buf, size_t len, size_t& got) {
+    got = 0;
+    if (!enabled) return false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    stats.lookups++;
+    int i = find(path);
+    if (i < 0) {
+        xSemaphoreGive(lock);
+        return false;
+    }
+    Entry& e = entries[i];
+    e.lastUse = ++useClock;
+    if (offset < e.size) {
+        got = min(len, e.size - offset);
+        memcpy(buf, e.data + offset, got);
+    }
+    stats.hits++;
+    stats.flashReadsAvoided += got;
+    xSemaphoreGive(lock);
+    return true;
+}
+
+bool HotFileCache::load(const String& path) {
+    if (!enabled) return false;
+    File f = SPIFFS.open(path, FILE_READ);
+    if (!f) return false;
+    size_t size = f.size();
+    if (size == 0 || size > maxFile) {
+        f.close();
+        return false;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int i = find(path);
+    if (i >= 0) drop(i);
+    Entry e = { path, nullptr, 0, 0, ++useClock };
+    bool ok = makeRoom(size, path);
+    if (ok) {
+        e.data = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+        ok = e.data && f.read(e.data, size) == size;
+    }
+    if (ok) {
+        e.size = size;
+        e.capacity = size;
+        usedBytes += size;
+        entries.push_back(e);
+        stats.flashBytesLoaded += size;
+    } else if (e.data) {
+        heap_caps_free(e.data);
+    }
+    xSemaphoreGive(lock);
+    f.close();
+    return ok;
+}
+
+bool HotFileCache::contains(const String& path) const {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool found = find(path) >= 0;
+    xSemaphoreGive(lock);
+    return found;
+}
+
+float HotFileCache::getHitRatio() const {
+    return stats.lookups > 0 ? (float)stats.hits / stats.lookups : 0.0f;
+}
+
+void HotFileCache::printStats() const {
+    Serial.println("=== HOT FILE CACHE ===");
+    Serial.println("Entries: " + String((unsigned)entries.size()) + ", " + PerformanceMonitor::formatBytes(usedBytes) + " of " +
+                   PerformanceMonitor::formatBytes(budget));
+    Serial.printf("Lookups: %u, hits: %u, hit ratio: %.1f%%\n", (unsigned)stats.lookups, (unsigned)stats.hits, getHitRatio() * 100.0f);
+    Serial.println("Flash reads avoided: " + PerformanceMonitor::formatBytes(stats.flashReadsAvoided) + " (loaded on miss: " +
+                   PerformanceMonitor::formatBytes(stats.flashBytesLoaded) + ")");
+    Serial.println("Write-through: " + PerformanceMonitor::formatBytes(stats.writeThroughBytes) + ", evictions: " +
+                   String((unsigned)stats.evictions) + ", invalidations: " + String((unsigned)stats.invalidations));
+    Serial.println("======================");
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Byte-budgeted PSRAM cache of whole files that were just downloaded or read.
+// Writers go through write()/invalidate() (write-through, so the cache never disagrees with
+// flash); readFromSPIFFS() in the storage layer serves hits from RAM. LRU eviction.
+
+const size_t HOT_CACHE_DEFAULT_BUDGET = 512 * 1024;
+
+struct HotCacheStats {
+size_t lookups;
+size_t hits;
+size_t flashReadsAvoided;   // bytes served from PSRAM instead of flash
+size_t flashBytesLoaded;    // bytes read from flash to fill the cache on a miss
+size_t writeThroughBytes;
+size_t evictions;
+size_t invalidations;
+HotCacheStats() : lookups(0), hits(0), flashReadsAvoided(0), flashBytesLoaded(0), writeThroughBytes(0), evictions(0), invalidations(0) {}
+};
+
+class HotFileCache {
+public:
+HotFileCache();
+~HotFileCache();
+
+// Fails without PSRAM: the cache is only worth it when it does not compete with internal RAM.
+// Files larger than maxFileBytes (default budget/4) are never cached.
+bool begin(size_t budgetBytes = HOT_CACHE_DEFAULT_BUDGET, size_t maxFileBytes = 0);
+void end();
+
+// Mirror a flash write: append=false truncates (starts a fresh entry), append=true extends an
+// existing entry and is ignored when the file is not cached
+void write(const String& path, const uint8_t* data, size_t len, bool append);
+void invalidate(const String& path);
+void clear();
+
+// Copy from a cached file; false on a miss
+bool read(const String& path, size_t offset, uint8_t* buf, size_t len, size_t& got);
+// Load a whole file from flash into the cache (called on a read miss)
+bool load(const String& path);
+bool contains(const String& path) const;
+
+size_t getUsedBytes() const { return usedBytes; }
+HotCacheStats getStats() const { return stats; }
+float getHitRatio() const;
+void printStats() const;
+
+private:
+struct Entry {
+    String path;
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    uint32_t lastUse;
+};
+
+std::vector<Entry> entries;
+size_t budget;
+size_t maxFile;
+size_t usedBytes;   // sum of capacities
+uint32_t useClock;
+bool enabled;
+SemaphoreHandle_t lock;   // writes come from the core 1 write stage too
+HotCacheStats stats;
+
+int find(const String& path) const;
+void drop(int index);
+bool makeRoom(size_t bytes, const String& keep);
+bool grow(const String& path, size_t capacity);
+};
@@ -0,0 +1,99 @@
+#include "hot_path_timer.h"
+
+#if HOT_PATH_TIMERS
+
+#include <algorithm>
+
+static HotTimerSite sites[MAX_HOT_TIMER_SITES];
+static int siteCount = 0;
+static portMUX_TYPE siteLock = portMUX_INITIALIZER_UNLOCKED;
+
+HotTimerSite* hotTimerRegister(const char* name) {
+    HotTimerSite* site = nullptr;
+    portENTER_CRITICAL(&siteLock);
+    // the same name from two places shares a row
+    for (int i = 0; i < siteCount && !site; ++i) {
+        if (strcmp(sites[i].name, name) == 0) site = &sites[i];
+    }
+    if (!site && siteCount < MAX_HOT_TIMER_SITES) {
+        site = &sites[siteCount++];
+        memset(site, 0, sizeof(*site));
+        site->name = name;
+    }
+    portEXIT_CRITICAL(&siteLock);
+    return site;
+}
+
+void resetHotTimers() {
+    portENTER_CRITICAL(&siteLock);
+    for (int i = 0; i < siteCount; ++i) memset(sites[i].perCore, 0, sizeof(sites[i].perCore));
+    portEXIT_CRITICAL(&siteLock);
+}
+
+bool hotTimerTotals(const char* name, uint64_t& cycles, uint32_t& count) {
+    cycles = 0;
+    count = 0;
+    for (int i = 0; i < siteCount; ++i) {
+        if (strcmp(sites[i].name, name) != 0) continue;
+        for (int c = 0; c < portNUM_PROCESSORS; ++c) {
+            cycles += sites[i].perCore[c].totalCycles;
+            count += sites[i].perCore[c].count;
+        }
+        break;
+    }
+    return true;
+}
+
+void printHotTimerReport() {
+    struct Row {
+        const char* name;
+        HotTimerStats s;
+    };
+    Row rows[MAX_HOT_TIMER_SITES];
+    int n = siteCount;
+
+    // merge the per-core stats; a racing update only skews one sample
+    for (int i = 0; i < n; ++i) {
+        rows[i].name = sites[i].name;
+        HotTimerStats& m = rows[i].s;
+        memset(&m, 0, sizeof(m));
+        for (int c = 0; c < portNUM_PROCESSORS; ++c) {
+            const HotTimerStats& st = sites[i].perCore[c];
+            if (st.count == 0) continue;
+            if (m.count == 0 || st.minCycles < m.minCycles) m.minCycles = st.minCycles;
+            if (st.maxCycles > m.maxCycles) m.maxCycles = st.maxCycles;
+            m.totalCycles += st.totalCycles;
+            m.count += st.count;
+        }
+    }
+    std::sort(rows, rows + n, [](const Row& a, const Row& b) { return a.s.totalCycles > b.s.totalCycles; });
+
+    float cyclesPerUs = ESP.getCpuFreqMHz();
+    Serial.println("\n=== HOT PATH TIMERS ===");
+    Serial.printf("%-24s %9s %11s %10s %10s %10s\n", "Site", "Count", "Total ms", "Avg us", "Min us", "Max us");
+    for (int i = 0; i < n; ++i) {
+        const HotTimerStats& s = rows[i].s;
+        if (s.count == 0) continue;
+        Serial.printf("%-24s %9u %11.1f %10.1f %10.1f %10.1f\n", rows[i].name, (unsigned)s.count,
+                      s.totalCycles / cyclesPerUs / 1000.0f, s.totalCycles / cyclesPerUs / s.count,
+                      s.minCycles / cyclesPerUs, s.maxCycles / cyclesPerUs);
+    }
+    Serial.printf("Sites: %d/%d\n", n, MAX_HOT_TIMER_SITES);
+    Serial.println("=======================\n");
+}
+
+#else
+
+void printHotTimerReport() {
+    Serial.println("Hot path timers disabled (build with -DHOT_PATH_TIMERS=1)");
+}
+
+void resetHotTimers() {}
+
+bool hotTimerTotals(const char*, uint64_t& cycles, uint32_t& count) {
+    cycles = 0;
+    count = 0;
+    return false;
+}
+
+#endif
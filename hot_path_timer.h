@@ -0,0 +1,71 @@
+#pragma once
+#include <Arduino.h>
+
+// Scoped cycle-count timers for hot regions. Build with -DHOT_PATH_TIMERS=1 to enable;
+// otherwise HOT_TIMER() expands to nothing and no table is linked in.
+//
+//   { HOT_TIMER("spiffs.read"); n = f.read(buf, len); }
+//
+// Each site keeps count/total/min/max per core, so the two cores never share a counter.
+// Cycle counts are per-core, so a timed region must not span a task migration (pinned tasks are fine).
+#ifndef HOT_PATH_TIMERS
+#define HOT_PATH_TIMERS 0
+#endif
+
+const int MAX_HOT_TIMER_SITES = 48;
+
+#if HOT_PATH_TIMERS
+
+#include <freertos/FreeRTOS.h>
+
+struct HotTimerStats {
+uint32_t count;
+uint64_t totalCycles;
+uint32_t minCycles;
+uint32_t maxCycles;
+};
+
+struct HotTimerSite {
+const char* name;
+HotTimerStats perCore[portNUM_PROCESSORS];
+};
+
+// Claim a table slot for a site name; nullptr once the table is full (that site goes untimed)
+HotTimerSite* hotTimerRegister(const char* name);
+
+class HotTimerScope {
+public:
+explicit HotTimerScope(HotTimerSite* s) : site(s), start(ESP.getCycleCount()) {}
+~HotTimerScope() {
+    uint32_t cycles = ESP.getCycleCount() - start;
+    if (!site) return;
+    HotTimerStats& st = site->perCore[xPortGetCoreID()];
+    if (st.count == 0 || cycles < st.minCycles) st.minCycles = cycles;
+    if (cycles > st.maxCycles) st.maxCycles = cycles;
+    st.totalCycles += cycles;
+    st.count++;
+}
+
+private:
+HotTimerSite* site;
+uint32_t start;
+};
+
+#define HOT_TIMER_CAT2(a, b) a##b
+#define HOT_TIMER_CAT(a, b) HOT_TIMER_CAT2(a, b)
+// the site is registered once (function-local static); every pass after that is two cycle reads
+#define HOT_TIMER(name) \
+    static HotTimerSite* HOT_TIMER_CAT(hotTimerSite_, __LINE__) = hotTimerRegister(name); \
+    HotTimerScope HOT_TIMER_CAT(hotTimerScope_, __LINE__)(HOT_TIMER_CAT(hotTimerSite_, __LINE__))
+
+#else
+
+#define HOT_TIMER(name) do {} while (0)
+
+#endif
+
+// Sites sorted by total time (count, total ms, avg/min/max us); prints a note when compiled out
+void printHotTimerReport();
+void resetHotTimers();
+// One site's totals over both cores; false when timers are compiled out (cycles/count are then 0)
+bool hotTimerTotals(const char* name, uint64_t& cycles, uint32_t& count);
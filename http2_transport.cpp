@@ -0,0 +1,551 @@
+#include "http2_transport.h"
+#include "network_and_http.h"
+#include "spiffs_management.h"
+#include <FS.h>
+#include <SPIFFS.h>
+#include <WiFiClient.h>
+
+#ifdef HTTP2_TRANSPORT_AVAILABLE
+#include <nghttp2/nghttp2.h>
+#include <esp_tls.h>
+#include <lwip/sockets.h>
+#if __has_include(<esp_crt_bundle.h>)
+#include <esp_crt_bundle.h>
+#define HTTP2_HAVE_CRT_BUNDLE 1
+#endif
+#endif
+
+Http2Downloader::Http2Downloader()
+: bufMgr(nullptr), perf(nullptr), maxStreams(HTTP2_MAX_CONCURRENT_STREAMS), connectionsOpened(0), cancelled(false) {
+}
+
+Http2Downloader::~Http2Downloader() {
+    cancel();
+}
+
+void Http2Downloader::cancel() {
+    cancelled = true;
+}
+
+bool Http2Downloader::isAvailable() {
+#ifdef HTTP2_TRANSPORT_AVAILABLE
+    return true;
+#else
+    return false;
+#endif
+}
+
+DownloadResult Http2Downloader::download(const String& url, const String& targetPath) {
+    std::vector<Http2BatchItem> items;
+    items.push_back(Http2BatchItem(url, targetPath));
+    std::vector<DownloadResult> results = downloadBatch(items);
+    return results[0];
+}
+
+std::vector<DownloadResult> Http2Downloader::downloadBatch(const std::vector<Http2BatchItem>& items) {
+    std::vector<DownloadResult> results(items.size());
+    cancelled = false;
+    connectionsOpened = 0;
+
+    if (!isAvailable()) {
+        for (auto& r : results) r.errorMessage = "HTTP/2 transport not available in this build";
+        return results;
+    }
+
+    if (!SPIFFS.begin(true)) {
+        for (auto& r : results) r.errorMessage = "SPIFFS not mounted";
+        return results;
+    }
+
+    // Staging memory for all streams comes from the buffer manager when we have one and no other
+    // download is using it
+    size_t stagingSize = DEFAULT_DOWNLOAD_BUFFER_SIZE;
+    uint8_t* staging = nullptr;
+    uint8_t* localBuf = nullptr;
+    bool leased = bufMgr && bufMgr->getDownloadBufferSize() > 0 && bufMgr->leaseDownloadBuffers();
+    if (leased) {
+        stagingSize = bufMgr->getDownloadBufferSize();
+        staging = bufMgr->getActiveDownloadBuffer();
+    } else {
+        localBuf = (uint8_t*)malloc(stagingSize);
+        staging = localBuf;
+    }
+    if (!staging) {
+        for (auto& r : results) r.errorMessage = "Failed to allocate staging buffer";
+        return results;
+    }
+
+    // Group items by origin so each origin costs one handshake
+    std::vector<String> origins;
+    std::vector<std::vector<size_t>> groups;
+    for (size_t i = 0; i < items.size(); ++i) {
+        UrlParts u;
+        if (!parseUrl(items[i].url, u)) {
+            results[i].errorMessage = "Unsupported URL: " + items[i].url;
+            continue;
+        }
+        String origin = u.scheme + "://" + u.host + ":" + String(u.port);
+        size_t g = 0;
+        while (g < origins.size() && origins[g] != origin) g++;
+        if (g == origins.size()) {
+            origins.push_back(origin);
+            groups.push_back(std::vector<size_t>());
+        }
+        groups[g].push_back(i);
+    }
+
+    if (perf) {
+        perf->startMonitoring();
+        perf->startConnectionTimer();
+    }
+
+    size_t batchBytes = 0;
+    for (size_t g = 0; g < groups.size() && !cancelled; ++g) {
+        runOrigin(items, groups[g], results, staging, stagingSize, batchBytes);
+    }
+
+    if (perf) {
+        perf->stopEnhancedMonitoring();
+        perf->stopMonitoring();
+    }
+
+    if (localBuf) free(localBuf);
+    if (leased) bufMgr->releaseDownloadBuffers();
+
+    if (cancelled) {
+        for (auto& r : results) {
+            if (!r.success && r.errorMessage.length() == 0) r.errorMessage = "Cancelled by user";
+        }
+    }
+    return results;
+}
+
+#ifdef HTTP2_TRANSPORT_AVAILABLE
+
+namespace {
+
+// Either an esp_tls session (h2 via ALPN) or a plain socket (h2c with prior knowledge)
+struct H2Connection {
+    bool secure;
+    esp_tls_t* tls;
+    WiFiClient plain;
+    H2Connection() : secure(false), tls(nullptr) {}
+
+    bool open(const UrlParts& u) {
+        secure = u.secure;
+        if (!secure) {
+            plain.setNoDelay(true);
+            return plain.connect(u.host.c_str(), u.port);
+        }
+        static const char* alpn[] = { "h2", nullptr };
+        esp_tls_cfg_t cfg = {};
+        cfg.alpn_protos = alpn;
+        cfg.timeout_ms = HTTP2_IO_TIMEOUT_MS;
+#ifdef HTTP2_HAVE_CRT_BUNDLE
+        cfg.crt_bundle_attach = esp_crt_bundle_attach;
+#endif
+        tls = esp_tls_init();
+        if (!tls) return false;
+        if (esp_tls_conn_new_sync(u.host.c_str(), u.host.length(), u.port, &cfg, tls) != 1) {
+            esp_tls_conn_destroy(tls);
+            tls = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    // >0 bytes, 0 = nothing yet, <0 = connection gone
+    int read(uint8_t* buf, size_t len) {
+        if (secure) {
+            // the socket blocks: only read when a record is already decrypted or bytes are waiting,
+            // so a stalled peer comes back as 0 and the caller's idle timeout and cancel() still apply
+            if (esp_tls_get_bytes_avail(tls) <= 0) {
+                int fd = -1;
+                if (esp_tls_get_conn_sockfd(tls, &fd) != ESP_OK || fd < 0) return -1;
+                fd_set readSet;
+                FD_ZERO(&readSet);
+                FD_SET(fd, &readSet);
+                struct timeval tv = { 0, 10000 };
+                int ready = select(fd + 1, &readSet, nullptr, nullptr, &tv);
+                if (ready < 0) return -1;
+                if (ready == 0) return 0;
+            }
+            ssize_t n = esp_tls_conn_read(tls, buf, len);
+            if (n == ESP_TLS_ERR_SSL_WANT_READ || n == ESP_TLS_ERR_SSL_WANT_WRITE) return 0;
+            return n > 0 ? (int)n : -1;
+        }
+        int avail = plain.available();
+        if (avail > 0) return plain.read(buf, min((size_t)avail, len));
+        if (!plain.connected()) return -1;
+        vTaskDelay(pdMS_TO_TICKS(1));
+        return 0;
+    }
+
+    int write(const uint8_t* data, size_t len) {
+        if (secure) {
+            ssize_t n = esp_tls_conn_write(tls, data, len);
+            if (n == ESP_TLS_ERR_SSL_WANT_READ || n == ESP_TLS_ERR_SSL_WANT_WRITE) return 0;
+            return (int)n;
+        }
+        return (int)plain.write(data, len);
+    }
+
+    void close() {
+        if (tls) {
+            esp_tls_conn_destroy(tls);
+            tls = nullptr;
+        }
+        plain.stop();
+    }
+};
+
+// One in-flight request and the staging slice it owns
+struct H2Stream {
+    bool inUse;
+    size_t itemIndex;
+    int32_t id;
+    File file;
+    uint8_t* staging;
+    size_t stagingCap;
+    size_t stagingLen;
+    size_t received;
+    size_t pendingConsume;
+    long contentLength;
+    int status;
+    bool writeFailed;
+    bool closed;
+    uint32_t errorCode;
+    unsigned long startMs;
+    unsigned long firstByteMs;
+};
+
+struct H2Session {
+    H2Connection* conn;
+    const std::vector<Http2BatchItem>* items;
+    size_t* batchBytes;
+    PerformanceMonitor* perf;
+    bool ioError;
+};
+
+void flushStream(H2Stream* st) {
+    if (st->stagingLen == 0) return;
+    if (st->file && !st->writeFailed) {
+        if (st->file.write(st->staging, st->stagingLen) != st->stagingLen) st->writeFailed = true;
+    }
+    // the window only reopens once the bytes are out of the slice
+    st->pendingConsume += st->stagingLen;
+    st->stagingLen = 0;
+}
+
+ssize_t onSend(nghttp2_session* session, const uint8_t* data, size_t length, int flags, void* userData) {
+    H2Session* s = static_cast<H2Session*>(userData);
+    int n = s->conn->write(data, length);
+    if (n == 0) return NGHTTP2_ERR_WOULDBLOCK;
+    if (n < 0) {
+        s->ioError = true;
+        return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+    return n;
+}
+
+int onHeader(nghttp2_session* session, const nghttp2_frame* frame, const uint8_t* name, size_t namelen,
+             const uint8_t* value, size_t valuelen, uint8_t flags, void* userData) {
+    if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_RESPONSE) return 0;
+    H2Stream* st = static_cast<H2Stream*>(nghttp2_session_get_stream_user_data(session, frame->hd.stream_id));
+    if (!st) return 0;
+
+    char tmp[24];
+    size_t n = min(valuelen, sizeof(tmp) - 1);
+    if (namelen == 7 && memcmp(name, ":status", 7) == 0) {
+        memcpy(tmp, value, n);
+        tmp[n] = '\0';
+        st->status = atoi(tmp);
+    } else if (namelen == 14 && memcmp(name, "content-length", 14) == 0) {
+        memcpy(tmp, value, n);
+        tmp[n] = '\0';
+        st->contentLength = atol(tmp);
+    }
+    return 0;
+}
+
+int onDataChunk(nghttp2_session* session, uint8_t flags, int32_t streamId, const uint8_t* data, size_t len, void* userData) {
+    H2Session* s = static_cast<H2Session*>(userData);
+    H2Stream* st = static_cast<H2Stream*>(nghttp2_session_get_stream_user_data(session, streamId));
+    if (!st) return 0;
+
+    if (st->firstByteMs == 0) {
+        st->firstByteMs = millis();
+        if (s->perf) s->perf->markFirstByte();
+    }
+
+    if (st->status != 200) {
+        // error bodies are dropped but still have to be acknowledged
+        st->pendingConsume += len;
+        return 0;
+    }
+
+    if (!st->file && !st->writeFailed) {
+        hotCacheInvalidate((*s->items)[st->itemIndex].targetPath);
+        st->file = openSPIFFSForWrite((*s->items)[st->itemIndex].targetPath);
+        if (!st->file) st->writeFailed = true;
+    }
+
+    st->received += len;
+    *s->batchBytes += len;
+    while (len > 0) {
+        size_t n = min(len, st->stagingCap - st->stagingLen);
+        memcpy(st->staging + st->stagingLen, data, n);
+        st->stagingLen += n;
+        data += n;
+        len -= n;
+        if (st->stagingLen == st->stagingCap) flushStream(st);
+    }
+
+    if (s->perf) s->perf->updateProgress(*s->batchBytes);
+    return 0;
+}
+
+int onStreamClose(nghttp2_session* session, int32_t streamId, uint32_t errorCode, void* userData) {
+    H2Stream* st = static_cast<H2Stream*>(nghttp2_session_get_stream_user_data(session, streamId));
+    if (!st) return 0;
+    flushStream(st);
+    st->closed = true;
+    st->errorCode = errorCode;
+    return 0;
+}
+
+void finishStream(H2Stream* st, const Http2BatchItem& item, DownloadResult& r) {
+    if (st->file) st->file.close();
+
+    unsigned long now = millis();
+    r.httpStatusCode = st->status;
+    r.totalBytes = st->received;
+    r.fileSize = st->contentLength >= 0 ? (size_t)st->contentLength : st->received;
+    r.downloadTimeMs = now - st->startMs;
+    r.averageSpeedKBps = PerformanceMonitor::calculateSpeedKBps(st->received, r.downloadTimeMs);
+    if (st->firstByteMs > 0) {
+        r.connectionSetupMs = st->firstByteMs - st->startMs;
+        r.transferOnlyMs = now - st->firstByteMs;
+        r.pureTransferSpeedKBps = PerformanceMonitor::calculateSpeedKBps(st->received, r.transferOnlyMs);
+    }
+
+    if (st->errorCode != NGHTTP2_NO_ERROR) {
+        r.errorMessage = "Stream reset, error code " + String(st->errorCode);
+    } else if (st->status != 200) {
+        r.errorMessage = "HTTP error: " + String(st->status);
+    } else if (st->writeFailed) {
+        r.errorMessage = "Write failed";
+    } else if (st->contentLength >= 0 && st->received != (size_t)st->contentLength) {
+        r.errorMessage = "Short body: " + String(st->received) + " of " + String(st->contentLength);
+    } else {
+        r.success = true;
+    }
+
+    if (!r.success && SPIFFS.exists(item.targetPath)) SPIFFS.remove(item.targetPath);
+    st->inUse = false;
+}
+
+} // namespace
+
+void Http2Downloader::runOrigin(const std::vector<Http2BatchItem>& items, const std::vector<size_t>& indices,
+                                std::vector<DownloadResult>& results, uint8_t* staging, size_t stagingSize, size_t& batchBytes) {
+    UrlParts origin;
+    parseUrl(items[indices[0]].url, origin);
+
+    // Split the staging buffer into equal slices, one per concurrent stream
+    size_t slots = min(maxStreams, indices.size());
+    slots = max((size_t)1, min(slots, stagingSize / HTTP2_MIN_STREAM_WINDOW));
+    size_t slice = stagingSize / slots;
+
+    unsigned long connectStart = millis();
+    H2Connection conn;
+    if (!conn.open(origin)) {
+        for (size_t idx : indices) results[idx].errorMessage = "Connection failed: " + origin.host;
+        conn.close();
+        return;
+    }
+    connectionsOpened++;
+    unsigned long handshakeMs = millis() - connectStart;
+    Serial.println("HTTP/2 connected to " + origin.host + " in " + String(handshakeMs) + " ms, " +
+                   String(slots) + " streams x " + String(slice / 1024) + " KB window");
+
+    H2Session ctx = { &conn, &items, &batchBytes, perf, false };
+
+    nghttp2_session_callbacks* callbacks = nullptr;
+    nghttp2_session_callbacks_new(&callbacks);
+    nghttp2_session_callbacks_set_send_callback(callbacks, onSend);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks, onHeader);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, onDataChunk);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, onStreamClose);
+
+    // we hand out WINDOW_UPDATEs ourselves, after the slice has been flushed
+    nghttp2_option* option = nullptr;
+    nghttp2_option_new(&option);
+    nghttp2_option_set_no_auto_window_update(option, 1);
+
+    nghttp2_session* session = nullptr;
+    nghttp2_session_client_new2(&session, callbacks, &ctx, option);
+    nghttp2_session_callbacks_del(callbacks);
+    nghttp2_option_del(option);
+
+    nghttp2_settings_entry settings[] = {
+        { NGHTTP2_SETTINGS_ENABLE_PUSH, 0 },
+        { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, (uint32_t)slots },
+        { NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, (uint32_t)slice },
+    };
+    nghttp2_submit_settings(session, NGHTTP2_FLAG_NONE, settings, sizeof(settings) / sizeof(settings[0]));
+    nghttp2_session_set_local_window_size(session, NGHTTP2_FLAG_NONE, 0, (int32_t)(slice * slots));
+
+    std::vector<H2Stream> streams(slots);
+    for (size_t i = 0; i < slots; ++i) {
+        streams[i].inUse = false;
+        streams[i].staging = staging + i * slice;
+        streams[i].stagingCap = slice;
+    }
+
+    String authority = origin.host;
+    if (origin.port != (origin.secure ? 443 : 80)) authority += ":" + String(origin.port);
+    String scheme = origin.secure ? "https" : "http";
+
+    size_t nextItem = 0;
+    size_t completed = 0;
+    unsigned long lastActivity = millis();
+    uint8_t rx[2048];
+
+    while (completed < indices.size() && !cancelled && !ctx.ioError) {
+        // keep every free slot busy
+        for (size_t i = 0; i < slots && nextItem < indices.size(); ++i) {
+            H2Stream& st = streams[i];
+            if (st.inUse) continue;
+
+            size_t idx = indices[nextItem++];
+            UrlParts u;
+            parseUrl(items[idx].url, u);
+            st.inUse = true;
+            st.itemIndex = idx;
+            st.file = File();
+            st.stagingLen = 0;
+            st.received = 0;
+            st.pendingConsume = 0;
+            st.contentLength = -1;
+            st.status = 0;
+            st.writeFailed = false;
+            st.closed = false;
+            st.errorCode = 0;
+            st.startMs = millis();
+            st.firstByteMs = 0;
+
+            nghttp2_nv nva[] = {
+                { (uint8_t*)":method", (uint8_t*)"GET", 7, 3, NGHTTP2_NV_FLAG_NONE },
+                { (uint8_t*)":scheme", (uint8_t*)scheme.c_str(), 7, scheme.length(), NGHTTP2_NV_FLAG_NONE },
+                { (uint8_t*)":authority", (uint8_t*)authority.c_str(), 10, authority.length(), NGHTTP2_NV_FLAG_NONE },
+                { (uint8_t*)":path", (uint8_t*)u.path.c_str(), 5, u.path.length(), NGHTTP2_NV_FLAG_NONE },
+                { (uint8_t*)"user-agent", (uint8_t*)"ESP32-h2", 10, 8, NGHTTP2_NV_FLAG_NONE },
+            };
+            st.id = nghttp2_submit_request(session, nullptr, nva, sizeof(nva) / sizeof(nva[0]), nullptr, &st);
+            if (st.id < 0) {
+                results[idx].errorMessage = String("Submit failed: ") + nghttp2_strerror(st.id);
+                st.inUse = false;
+                completed++;
+            }
+        }
+
+        if (nghttp2_session_send(session) != 0) break;
+
+        int n = conn.read(rx, sizeof(rx));
+        if (n < 0) {
+            ctx.ioError = true;
+            break;
+        }
+        if (n > 0) {
+            lastActivity = millis();
+            if (nghttp2_session_mem_recv(session, rx, n) < 0) {
+                ctx.ioError = true;
+                break;
+            }
+        } else if (millis() - lastActivity > HTTP2_IO_TIMEOUT_MS) {
+            Serial.println("HTTP/2 connection idle too long, giving up");
+            ctx.ioError = true;
+            break;
+        }
+
+        for (size_t i = 0; i < slots; ++i) {
+            H2Stream& st = streams[i];
+            if (!st.inUse) continue;
+            if (st.pendingConsume > 0) {
+                if (st.closed) nghttp2_session_consume_connection(session, st.pendingConsume);
+                else nghttp2_session_consume(session, st.id, st.pendingConsume);
+                st.pendingConsume = 0;
+            }
+            if (st.closed) {
+                finishStream(&st, items[st.itemIndex], results[st.itemIndex]);
+                results[st.itemIndex].connectionTimeMs = handshakeMs;
+                completed++;
+            }
+        }
+    }
+
+    // anything still open when the connection died is a failure
+    for (size_t i = 0; i < slots; ++i) {
+        H2Stream& st = streams[i];
+        if (!st.inUse) continue;
+        flushStream(&st);
+        if (!st.closed) st.errorCode = NGHTTP2_CANCEL;
+        finishStream(&st, items[st.itemIndex], results[st.itemIndex]);
+        if (results[st.itemIndex].errorMessage.length() == 0 || cancelled) {
+            results[st.itemIndex].errorMessage = cancelled ? "Cancelled by user" : "Connection lost";
+        }
+    }
+    for (; nextItem < indices.size(); ++nextItem) {
+        results[indices[nextItem]].errorMessage = cancelled ? "Cancelled by user" : "Connection lost";
+    }
+
+    nghttp2_session_del(session);
+    conn.close();
+}
+
+#else
+
+void Http2Downloader::runOrigin(const std::vector<Http2BatchItem>& items, const std::vector<size_t>& indices,
+                                std::vector<DownloadResult>& results, uint8_t* staging, size_t stagingSize, size_t& batchBytes) {
+    for (size_t idx : indices) results[idx].errorMessage = "HTTP/2 transport not available in this build";
+}
+
+#endif
+
+void benchmarkBatchTransports(const std::vector<Http2BatchItem>& items, DownloaderBase& http1Engine, Http2Downloader& http2Engine) {
+    Serial.println("=== BATCH TRANSPORT BENCHMARK (" + String(items.size()) + " files) ===");
+
+    size_t h1Bytes = 0, h1Ok = 0;
+    unsigned long h1Start = millis();
+    for (const auto& item : items) {
+        DownloadResult r = http1Engine.download(item.url, item.targetPath);
+        if (r.success) {
+            h1Ok++;
+            h1Bytes += r.totalBytes;
+        }
+    }
+    unsigned long h1Ms = millis() - h1Start;
+
+    size_t h2Bytes = 0, h2Ok = 0;
+    unsigned long h2Start = millis();
+    std::vector<DownloadResult> h2Results = http2Engine.downloadBatch(items);
+    unsigned long h2Ms = millis() - h2Start;
+    for (const auto& r : h2Results) {
+        if (r.success) {
+            h2Ok++;
+            h2Bytes += r.totalBytes;
+        }
+    }
+
+    Serial.printf("%-22s %6s %10s %10s %12s %6s\n", "Transport", "ok", "bytes", "time", "speed", "conns");
+    Serial.printf("%-22s %6u %10u %10s %12s %6u\n", http1Engine.getName().c_str(), (unsigned)h1Ok, (unsigned)h1Bytes,
+                  PerformanceMonitor::formatTime(h1Ms).c_str(),
+                  PerformanceMonitor::formatSpeed(PerformanceMonitor::calculateSpeedKBps(h1Bytes, h1Ms)).c_str(),
+                  (unsigned)items.size());
+    Serial.printf("%-22s %6u %10u %10s %12s %6u\n", "Http2Downloader", (unsigned)h2Ok, (unsigned)h2Bytes,
+                  PerformanceMonitor::formatTime(h2Ms).c_str(),
+                  PerformanceMonitor::formatSpeed(PerformanceMonitor::calculateSpeedKBps(h2Bytes, h2Ms)).c_str(),
+                  (unsigned)http2Engine.getConnectionCount());
+    Serial.println("==============================================");
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "buffer_and_performance.h"
+#include "download_engines.h"
+
+// nghttp2 ships with the ESP32 core; builds without it still compile and report the transport as unavailable
+#if defined(__has_include)
+#if __has_include(<nghttp2/nghttp2.h>) && __has_include(<esp_tls.h>)
+#define HTTP2_TRANSPORT_AVAILABLE 1
+#endif
+#endif
+
+// Streams we are willing to keep open on one connection (server may lower it)
+const size_t HTTP2_MAX_CONCURRENT_STREAMS = 8;
+// Below this per-stream window the framing overhead outweighs the multiplexing gain
+const size_t HTTP2_MIN_STREAM_WINDOW = 16384;
+const unsigned long HTTP2_IO_TIMEOUT_MS = 10000;
+
+// One file of a batch: where it comes from and where it goes
+struct Http2BatchItem {
+String url;
+String targetPath;
+Http2BatchItem() : url(""), targetPath("") {}
+Http2BatchItem(const String& u, const String& p) : url(u), targetPath(p) {}
+};
+
+// HTTP/2 engine: multiplexes many GETs over a single TLS (h2) or cleartext (h2c prior-knowledge) connection.
+// Each stream gets a slice of the BufferManager download buffer and its flow-control window equals that
+// slice, so the server can never send more than we have room to stage before it reaches flash.
+class Http2Downloader : public DownloaderBase {
+public:
+Http2Downloader();
+~Http2Downloader() override;
+
+// Single download = batch of one
+DownloadResult download(const String& url, const String& targetPath) override;
+void cancel() override;
+String getName() const override { return String("Http2Downloader"); }
+
+// Download all items; items sharing scheme/host/port share one connection.
+// Results are returned in the same order as items.
+std::vector<DownloadResult> downloadBatch(const std::vector<Http2BatchItem>& items);
+
+void setBufferManager(BufferManager* mgr) { bufMgr = mgr; }
+void setPerformanceMonitor(PerformanceMonitor* m) { perf = m; }
+void setMaxConcurrentStreams(size_t n) { maxStreams = n > 0 ? n : 1; }
+
+// Connections opened by the last batch (one TLS handshake each)
+size_t getConnectionCount() const { return connectionsOpened; }
+
+static bool isAvailable();
+
+private:
+BufferManager* bufMgr;
+PerformanceMonitor* perf;
+size_t maxStreams;
+size_t connectionsOpened;
+volatile bool cancelled;
+
+// Runs every item in indices over one connection to their shared origin
+void runOrigin(const std::vector<Http2BatchItem>& items, const std::vector<size_t>& indices,
+std::vector<DownloadResult>& results, uint8_t* staging, size_t stagingSize, size_t& batchBytes);
+};
+
+// Download the same batch with an HTTP/1.1 engine (serially) and with HTTP/2, then print both timings
+void benchmarkBatchTransports(const std::vector<Http2BatchItem>& items, DownloaderBase& http1Engine, Http2Downloader& http2Engine);
@@ -0,0 +1,449 @@
+#include "lean_http.h"
+#include <HTTPClient.h>
+#include <ctype.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "buffer_and_performance.h"
+
+void LeanHttpResponse::reset() {
+    status = 0;
+    contentLength = -1;
+    chunked = false;
+    keepAlive = false;
+    rangeStart = -1;
+    rangeEnd = -1;
+    rangeTotal = -1;
+    redirects = 0;
+    etag[0] = '\0';
+    location[0] = '\0';
+}
+
+bool splitUrl(const char* url, char* host, size_t hostCap, uint16_t& port, bool& tls, const char*& path) {
+    if (strncasecmp(url, "https://", 8) == 0) {
+        tls = true;
+        port = 443;
+        url += 8;
+    } else if (strncasecmp(url, "http://", 7) == 0) {
+        tls = false;
+        port = 80;
+        url += 7;
+    } else {
+        return false;
+    }
+
+    const char* slash = strchr(url, '/');
+    const char* hostEnd = slash ? slash : url + strlen(url);
+    const char* colon = (const char*)memchr(url, ':', hostEnd - url);
+    if (colon) {
+        long p = strtol(colon + 1, nullptr, 10);
+        if (p <= 0 || p > 65535) return false;
+        port = (uint16_t)p;
+    }
+    size_t hostLen = (colon ? colon : hostEnd) - url;
+    if (hostLen == 0 || hostLen >= hostCap) return false;
+    memcpy(host, url, hostLen);
+    host[hostLen] = '\0';
+    path = slash ? slash : "/";
+    return true;
+}
+
+// trims in place and returns the start of the value
+static char* trimValue(char* v) {
+    while (*v == ' ' || *v == '\t') v++;
+    char* end = v + strlen(v);
+    while (end > v && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) *--end = '\0';
+    return v;
+}
+
+static void copyValue(char* dst, size_t cap, const char* src) {
+    strncpy(dst, src, cap - 1);
+    dst[cap - 1] = '\0';
+}
+
+LeanHttpClient::LeanHttpClient()
+: conn(nullptr), port(0), tls(false), pendingStart(0), pendingEnd(0), bodyComplete(true), keepAlive(false),
+  chunked(false), bodyRemaining(0), timeoutMs(LEAN_HTTP_TIMEOUT_MS), connects(0) {
+    host[0] = '\0';
+    // same trust model as HTTPClient::begin(url) used by the engines
+    secure.setInsecure();
+}
+
+LeanHttpClient::~LeanHttpClient() {
+    close();
+}
+
+void LeanHttpClient::close() {
+    if (conn) conn->stop();
+    conn = nullptr;
+    keepAlive = false;
+    // bodyComplete stays as it was: closing mid-body (an error) must not look like the end of it
+    pendingStart = pendingEnd = 0;
+}
+
+bool LeanHttpClient::connectTo(const char* h, uint16_t p, bool useTls) {
+    close();
+    conn = useTls ? (WiFiClient*)&secure : &plain;
+    if (!conn->connect(h, p)) {
+        conn = nullptr;
+        return false;
+    }
+    conn->setNoDelay(true);
+    copyValue(host, sizeof(host), h);
+    port = p;
+    tls = useTls;
+    connects++;
+    return true;
+}
+
+bool LeanHttpClient::sendAll(const char* data, size_t len) {
+    unsigned long lastProgress = millis();
+    while (len > 0) {
+        size_t n = conn->write((const uint8_t*)data, len);
+        if (n > 0) {
+            data += n;
+            len -= n;
+            lastProgress = millis();
+        } else if (!conn->connected() || millis() - lastProgress > timeoutMs) {
+            return false;
+        } else {
+            vTaskDelay(1);
+        }
+    }
+    return true;
+}
+
+bool LeanHttpClient::readHeaders(LeanHttpResponse& resp, bool headRequest) {
+    int redirects = resp.redirects;
+    resp.reset();
+    resp.redirects = redirects;
+
+    // fill hdr until the blank line; whatever follows it is the start of the body
+    size_t used = 0;
+    char* end = nullptr;
+    unsigned long start = millis();
+    while (!end) {
+        if (used >= sizeof(hdr) - 1) return false; // header block larger than we accept
+        int avail = conn->available();
+        if (avail <= 0) {
+            if (!conn->connected() || millis() - start > timeoutMs) return false;
+            vTaskDelay(1);
+            continue;
+        }
+        int n = conn->read((uint8_t*)hdr + used, min((size_t)avail, sizeof(hdr) - 1 - used));
+        if (n <= 0) continue;
+        size_t from = used > 3 ? used - 3 : 0;
+        used += n;
+        hdr[used] = '\0';
+        end = strstr(hdr + from, "\r\n\r\n");
+    }
+    pendingStart = (end - hdr) + 4;
+    pendingEnd = used;
+    *end = '\0';
+
+    // status line: HTTP/1.x NNN reason
+    char* line = hdr;
+    char* next = strstr(line, "\r\n");
+    if (next) *next = '\0';
+    if (strncmp(line, "HTTP/1.", 7) != 0 || strlen(line) < 12) return false;
+    bool http11 = line[7] == '1';
+    resp.status = atoi(line + 9);
+    resp.keepAlive = http11;
+
+    while (next) {
+        line = next + 2;
+        next = strstr(line, "\r\n");
+        if (next) *next = '\0';
+        char* colon = strchr(line, ':');
+        if (!colon) continue;
+        *colon = '\0';
+        char* value = trimValue(colon + 1);
+
+        if (strcasecmp(line, "Content-Length") == 0) {
+            resp.contentLength = strtol(value, nullptr, 10);
+        } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+            // last coding wins: "gzip, chunked" is chunked
+            size_t len = strlen(value);
+            resp.chunked = len >= 7 && strcasecmp(value + len - 7, "chunked") == 0;
+        } else if (strcasecmp(line, "Connection") == 0) {
+            if (strcasecmp(value, "close") == 0) resp.keepAlive = false;
+            else if (strcasecmp(value, "keep-alive") == 0) resp.keepAlive = true;
+        } else if (strcasecmp(line, "Content-Range") == 0) {
+            // bytes <start>-<end>/<total|*>
+            char* p = strchr(value, ' ');
+            if (p) {
+                resp.rangeStart = strtol(p + 1, &p, 10);
+                if (*p == '-') resp.rangeEnd = strtol(p + 1, &p, 10);
+                if (*p == '/' && p[1] != '*') resp.rangeTotal = strtol(p + 1, nullptr, 10);
+            }
+        } else if (strcasecmp(line, "ETag") == 0) {
+            copyValue(resp.etag, sizeof(resp.etag), value);
+        } else if (strcasecmp(line, "Location") == 0) {
+            copyValue(resp.location, sizeof(resp.location), value);
+        }
+    }
+
+    keepAlive = resp.keepAlive;
+    chunked = false;
+    bodyComplete = false;
+    if (headRequest || resp.status == 204 || resp.status == 304 || resp.status < 200) {
+        bodyRemaining = 0;
+    } else if (resp.chunked) {
+        chunked = true;
+        bodyRemaining = 0; // next read() fetches the first chunk size
+    } else if (resp.contentLength >= 0) {
+        bodyRemaining = resp.contentLength;
+    } else {
+        bodyRemaining = -1; // delimited by close
+        keepAlive = false;
+    }
+    if (bodyRemaining == 0 && !chunked) bodyComplete = true;
+    return true;
+}
+
+int LeanHttpClient::rawRead(uint8_t* buf, size_t len) {
+    if (pendingStart < pendingEnd) {
+        size_t n = min(len, pendingEnd - pendingStart);
+        memcpy(buf, hdr + pendingStart, n);
+        pendingStart += n;
+        return n;
+    }
+    int avail = conn ? conn->available() : 0;
+    if (avail <= 0) return conn && conn->connected() ? 0 : -1;
+    return conn->read(buf, min(len, (size_t)avail));
+}
+
+bool LeanHttpClient::readLine(char* line, size_t cap) {
+    size_t n = 0;
+    unsigned long start = millis();
+    while (true) {
+        uint8_t c;
+        int got = rawRead(&c, 1);
+        if (got < 0) return false;
+        if (got == 0) {
+            if (millis() - start > timeoutMs) return false;
+            vTaskDelay(1);
+            continue;
+        }
+        if (c == '\n') break;
+        if (c != '\r' && n < cap - 1) line[n++] = c;
+    }
+    line[n] = '\0';
+    return true;
+}
+
+int LeanHttpClient::read(uint8_t* buf, size_t len) {
+    if (bodyComplete || !conn) return -1;
+
+    if (chunked) {
+        if (bodyRemaining == 0) {
+            char line[24];
+            if (!readLine(line, sizeof(line))) {
+                close();
+                return -1;
+            }
+            // hex digits, then an extension, the end of the line or nothing; anything else is a
+            // corrupt stream, not the last chunk
+            char* end = line;
+            long size = isxdigit((unsigned char)line[0]) ? strtol(line, &end, 16) : 0;
+            if (end == line || (*end != ';' && *end != '\r' && *end != '\0')) {
+                close();
+                return -1;
+            }
+            if (size == 0) {
+                // last chunk: skip trailers up to the blank line
+                while (readLine(line, sizeof(line)) && line[0] != '\0') {}
+                bodyComplete = true;
+                return -1;
+            }
+            bodyRemaining = size;
+        }
+        int n = rawRead(buf, min(len, (size_t)bodyRemaining));
+        if (n < 0) {
+            close();
+            return -1;
+        }
+        bodyRemaining -= n;
+        if (n > 0 && bodyRemaining == 0) {
+            char crlf[4];
+            readLine(crlf, sizeof(crlf));
+        }
+        return n;
+    }
+
+    if (bodyRemaining == 0) {
+        bodyComplete = true;
+        return -1;
+    }
+    size_t want = bodyRemaining < 0 ? len : min(len, (size_t)bodyRemaining);
+    int n = rawRead(buf, want);
+    if (n < 0) {
+        // close-delimited bodies end here; a Content-Length body ending early does not
+        bodyComplete = bodyRemaining < 0;
+        keepAlive = false;
+        if (conn) conn->stop();
+        conn = nullptr;
+        return -1;
+    }
+    if (bodyRemaining > 0) {
+        bodyRemaining -= n;
+        if (bodyRemaining == 0) bodyComplete = true;
+    }
+    return n;
+}
+
+bool LeanHttpClient::request(const char* method, const char* url, LeanHttpResponse& resp, long rangeStart) {
+    bool headRequest = strcmp(method, "HEAD") == 0;
+    char redirectUrl[LEAN_HTTP_LOCATION_MAX + LEAN_HTTP_HOST_MAX + 16];
+    resp.reset();
+
+    const char* target = url;
+    while (true) {
+        char h[LEAN_HTTP_HOST_MAX];
+        uint16_t p;
+        bool t;
+        const char* path;
+        if (!splitUrl(target, h, sizeof(h), p, t, path)) return false;
+
+        bool gotHeaders = false;
+        for (int attempt = 0; attempt < 2 && !gotHeaders; ++attempt) {
+            // reuse the connection when the last body was read to the end on the same origin
+            bool reuse = attempt == 0 && conn && conn->connected() && keepAlive && bodyComplete &&
+                         pendingStart == pendingEnd && port == p && tls == t && strcasecmp(host, h) == 0;
+            if (!reuse && !connectTo(h, p, t)) return false;
+
+            bool defaultPort = p == (t ? 443 : 80);
+            int n = snprintf(hdr, sizeof(hdr), defaultPort ? "%s %s HTTP/1.1\r\nHost: %s\r\n" : "%s %s HTTP/1.1\r\nHost: %s:%u\r\n",
+                             method, path, h, (unsigned)p);
+            if (rangeStart >= 0 && n < (int)sizeof(hdr)) n += snprintf(hdr + n, sizeof(hdr) - n, "Range: bytes=%ld-\r\n", rangeStart);
+            if (n < (int)sizeof(hdr)) n += snprintf(hdr + n, sizeof(hdr) - n, "User-Agent: ESP32\r\nConnection: keep-alive\r\n\r\n");
+            if (n >= (int)sizeof(hdr)) return false; // URL too long for the header buffer
+
+            gotHeaders = sendAll(hdr, n) && readHeaders(resp, headRequest);
+            // a kept-alive connection the server already closed: one retry on a fresh one
+            if (!gotHeaders && !reuse) break;
+        }
+        if (!gotHeaders) {
+            close();
+            return false;
+        }
+
+        bool redirect = resp.status == 301 || resp.status == 302 || resp.status == 303 || resp.status == 307 || resp.status == 308;
+        if (!redirect || resp.location[0] == '\0' || resp.redirects >= LEAN_HTTP_MAX_REDIRECTS) return true;
+
+        // relative Location: same scheme, host and port; without a leading '/' it is relative to
+        // the current path's directory (path may point into redirectUrl, so copy that part first)
+        int n;
+        if (resp.location[0] == '/') {
+            n = snprintf(redirectUrl, sizeof(redirectUrl), "%s://%s:%u%s", t ? "https" : "http", h, (unsigned)p, resp.location);
+        } else if (strstr(resp.location, "://")) {
+            n = snprintf(redirectUrl, sizeof(redirectUrl), "%s", resp.location);
+        } else {
+            char dir[LEAN_HTTP_LOCATION_MAX];
+            size_t dirLen = strcspn(path, "?#");
+            while (dirLen > 0 && path[dirLen - 1] != '/') dirLen--;
+            if (dirLen >= sizeof(dir)) dirLen = 0;
+            memcpy(dir, path, dirLen);
+            dir[dirLen] = '\0';
+            n = dirLen > 0 ? snprintf(redirectUrl, sizeof(redirectUrl), "%s://%s:%u%s%s", t ? "https" : "http", h, (unsigned)p, dir, resp.location)
+                           : (int)sizeof(redirectUrl);
+        }
+        if (n >= (int)sizeof(redirectUrl)) {
+            close();
+            return false; // redirect target too long to follow
+        }
+        resp.redirects++;
+        close(); // the redirect body is not worth draining
+        target = redirectUrl;
+    }
+}
+
+bool LeanHttpClient::get(const char* url, LeanHttpResponse& resp, long rangeStart) {
+    return request("GET", url, resp, rangeStart);
+}
+
+bool LeanHttpClient::head(const char* url, LeanHttpResponse& resp) {
+    return request("HEAD", url, resp, -1);
+}
+
+// ---- benchmark ----
+
+LeanHttpBenchmark benchmarkLeanHttp(const String& url, int requests) {
+    LeanHttpBenchmark b;
+    b.requests = requests;
+    const size_t bufSize = 4096;
+    uint8_t* buf = (uint8_t*)malloc(bufSize);
+    if (!buf) return b;
+
+    // LeanHttpClient holds ~1.5 KB of fixed buffers itself; keep it off the task stack
+    LeanHttpClient* lean = new LeanHttpClient();
+    size_t largestBefore = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    size_t heapSum = 0;
+    int ok = 0;
+    unsigned long start = millis();
+    for (int i = 0; i < requests; ++i) {
+        size_t before = ESP.getFreeHeap();
+        LeanHttpResponse resp;
+        if (!lean->get(url.c_str(), resp) || resp.status != 200) continue;
+        size_t during = ESP.getFreeHeap();
+        heapSum += before > during ? before - during : 0;
+        unsigned long t = millis();
+        while (!lean->bodyDone() && millis() - t < LEAN_HTTP_TIMEOUT_MS) {
+            int n = lean->read(buf, bufSize);
+            if (n < 0) break;
+            if (n == 0) vTaskDelay(1);
+        }
+        if (lean->bodyDone()) ok++;
+    }
+    unsigned long leanMs = millis() - start;
+    b.leanConnections = lean->connectionsOpened();
+    delete lean;
+    b.leanRequestsPerSec = leanMs > 0 ? ok * 1000.0f / leanMs : 0.0f;
+    b.leanHeapInFlight = ok > 0 ? heapSum / ok : 0;
+    b.leanLargestBlockDelta = (long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) - (long)largestBefore;
+
+    HTTPClient http;
+    http.setReuse(true);
+    largestBefore = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    heapSum = 0;
+    ok = 0;
+    start = millis();
+    for (int i = 0; i < requests; ++i) {
+        size_t before = ESP.getFreeHeap();
+        http.begin(url);
+        if (http.GET() != HTTP_CODE_OK) {
+            http.end();
+            continue;
+        }
+        size_t during = ESP.getFreeHeap();
+        heapSum += before > during ? before - during : 0;
+        WiFiClient* stream = http.getStreamPtr();
+        int remaining = http.getSize();
+        unsigned long t = millis();
+        while ((remaining > 0 || remaining == -1) && http.connected() && millis() - t < LEAN_HTTP_TIMEOUT_MS) {
+            size_t avail = stream->available();
+            if (avail == 0) {
+                vTaskDelay(1);
+                continue;
+            }
+            int n = stream->readBytes(buf, min(avail, bufSize));
+            if (remaining > 0) remaining -= n;
+        }
+        if (remaining <= 0) ok++;
+        http.end();
+    }
+    unsigned long clientMs = millis() - start;
+    b.httpClientRequestsPerSec = clientMs > 0 ? ok * 1000.0f / clientMs : 0.0f;
+    b.httpClientHeapInFlight = ok > 0 ? heapSum / ok : 0;
+    b.httpClientLargestBlockDelta = (long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) - (long)largestBefore;
+    free(buf);
+
+    Serial.println("=== LEAN HTTP vs HTTPClient (" + String(requests) + " GETs) ===");
+    Serial.printf("%-22s %12s %12s\n", "", "LeanHttp", "HTTPClient");
+    Serial.printf("%-22s %12.1f %12.1f\n", "Requests/s", b.leanRequestsPerSec, b.httpClientRequestsPerSec);
+    Serial.printf("%-22s %12u %12u\n", "Heap in flight (B)", (unsigned)b.leanHeapInFlight, (unsigned)b.httpClientHeapInFlight);
+    Serial.printf("%-22s %12ld %12ld\n", "Largest block delta", b.leanLargestBlockDelta, b.httpClientLargestBlockDelta);
+    Serial.println("Lean connections opened: " + String((unsigned)b.leanConnections));
+    Serial.println("=================================================");
+    return b;
+}
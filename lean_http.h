@@ -0,0 +1,93 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+
+// Minimal HTTP/1.1 client for the download hot path. Requests and response headers go through
+// one fixed buffer and are parsed in place: no String, no per-request heap allocation once a
+// connection is open. Connections are kept alive and reused for the same origin.
+// The body is read straight into the caller's buffer (chunked encoding is decoded).
+
+const size_t LEAN_HTTP_HEADER_BUFFER = 1024;   // request line + headers, and the response header block
+const size_t LEAN_HTTP_HOST_MAX = 64;
+const size_t LEAN_HTTP_ETAG_MAX = 80;
+const size_t LEAN_HTTP_LOCATION_MAX = 256;
+const int LEAN_HTTP_MAX_REDIRECTS = 3;
+const unsigned long LEAN_HTTP_TIMEOUT_MS = 10000;
+
+struct LeanHttpResponse {
+int status;
+long contentLength;      // -1 when the server did not send one
+bool chunked;
+bool keepAlive;
+long rangeStart;         // Content-Range: -1 when absent
+long rangeEnd;
+long rangeTotal;         // -1 when absent or '*'
+int redirects;           // redirects followed to get here
+char etag[LEAN_HTTP_ETAG_MAX];
+char location[LEAN_HTTP_LOCATION_MAX];
+LeanHttpResponse() { reset(); }
+void reset();
+};
+
+class LeanHttpClient {
+public:
+LeanHttpClient();
+~LeanHttpClient();
+
+// Send the request and parse the response headers; follows redirects. rangeStart >= 0 asks for bytes from there on.
+// False when no response headers could be read (resp.status is 0 then).
+bool get(const char* url, LeanHttpResponse& resp, long rangeStart = -1);
+bool head(const char* url, LeanHttpResponse& resp);
+
+// Body bytes into buf: >0 bytes read, 0 nothing arrived yet, -1 body over (see bodyDone()) or connection lost
+int read(uint8_t* buf, size_t len);
+// The whole body arrived; stays false when the connection failed or timed out part way
+bool bodyDone() const { return bodyComplete; }
+
+void close();
+void setTimeout(unsigned long ms) { timeoutMs = ms; }
+size_t connectionsOpened() const { return connects; }
+
+private:
+WiFiClient plain;
+WiFiClientSecure secure;
+WiFiClient* conn;
+char host[LEAN_HTTP_HOST_MAX];
+uint16_t port;
+bool tls;
+
+char hdr[LEAN_HTTP_HEADER_BUFFER];
+size_t pendingStart;      // body bytes that arrived with the headers: hdr[pendingStart, pendingEnd)
+size_t pendingEnd;
+bool bodyComplete;
+bool keepAlive;
+bool chunked;
+long bodyRemaining;       // left in the body, or in the current chunk; -1 = until the server closes
+unsigned long timeoutMs;
+size_t connects;
+
+bool request(const char* method, const char* url, LeanHttpResponse& resp, long rangeStart);
+bool connectTo(const char* h, uint16_t p, bool useTls);
+bool sendAll(const char* data, size_t len);
+bool readHeaders(LeanHttpResponse& resp, bool headRequest);
+int rawRead(uint8_t* buf, size_t len);
+bool readLine(char* line, size_t cap);
+};
+
+// Split an http(s) URL without allocating: host copied into host[hostCap], path points into url
+bool splitUrl(const char* url, char* host, size_t hostCap, uint16_t& port, bool& tls, const char*& path);
+
+// Same small-file GET loop through LeanHttpClient and HTTPClient (both reusing the connection)
+struct LeanHttpBenchmark {
+int requests = 0;
+float leanRequestsPerSec = 0.0f;
+float httpClientRequestsPerSec = 0.0f;
+size_t leanHeapInFlight = 0;          // average heap held while a request is open
+size_t httpClientHeapInFlight = 0;
+long leanLargestBlockDelta = 0;       // change of the largest free block over the run (fragmentation)
+long httpClientLargestBlockDelta = 0;
+size_t leanConnections = 0;
+};
+
+LeanHttpBenchmark benchmarkLeanHttp(const String& url, int requests = 50);
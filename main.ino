@@ -1,70 +1,164 @@
-#include <Arduino.h>
-#include <SPIFFS.h>
-#include "network_and_http.h"
-#include "download_engines.h"
-#include "buffer_and_performance.h"
-#include "spiffs_management.h"
-
-// Tweak these to match your network
-const char* WIFI_SSID = "YourNetwork";
-const char* WIFI_PASS = "YourPassword";
-
-// Example URL and target path — change when integrating
-const String DOWNLOAD_URL = "https://httpbin.org/bytes/102400";  // 100KB file
-const String TARGET_PATH = "/downloaded.bin";
-
-BufferManager globalBufMgr;
-PerformanceMonitor globalPerf;
-DualCoreDownloader dualCoreDl;
-
-void setup() {
-Serial.begin(19200);
-delay(100);
-
-Serial.println("Starting up (humanized sketch)");
-
-// SPIFFS mount
-if (!startSPIFFS()) {
-    Serial.println("SPIFFS failed to start. Continuing but file operations may fail.");
-}
-
-// WiFi connect
-if (!connectToWifi(WIFI_SSID, WIFI_PASS, 20000)) {
-    Serial.println("Unable to connect to WiFi — continuing with limited functionality.");
-}
-
-// Prepare buffer manager (try to enable smart allocation)
-if (!globalBufMgr.allocateBuffers()) {
-    Serial.println("Buffer allocation failed; continuing with minimal buffers.");
-    // optionally try small fixed allocation
-    globalBufMgr.allocateBuffers(8192, 4096);
-}
-
-// Attach helpers
-dualCoreDl.setBufferManager(&globalBufMgr);
-dualCoreDl.setPerformanceMonitor(&globalPerf);
-
-
-}
-
-void loop() {
-// One-shot example: perform a single download and then halt (or sleep)
-Serial.println("Starting dual-core FreeRTOS download: " + DOWNLOAD_URL);
-
-DownloadResult res = dualCoreDl.download(DOWNLOAD_URL, TARGET_PATH);
-
-if (res.success) {
-    Serial.println("Downloaded successfully: " + String(res.totalBytes) + " bytes");
-    globalPerf.printEnhancedResults(res.totalBytes);
-} else {
-    Serial.println("Download failed: " + res.errorMessage);
-}
-
-// done for demo purposes: sleep forever
-Serial.println("Main loop finished — halting.");
-while (true) {
-    delay(1000);
-}
-
-
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include "network_and_http.h"
+#include "download_engines.h"
+#include "buffer_and_performance.h"
+#include "spiffs_management.h"
+#include "download_cache.h"
+#include "hot_file_cache.h"
+#include "content_store.h"
+#include "crash_counters.h"
+#include "hot_path_timer.h"
+#include "telemetry.h"
+#include "auto_tuner.h"
+#include "monitor_registry.h"
+#include "pc_sampler.h"
+
+// Tweak these to match your network
+const char* WIFI_SSID = "YourNetwork";
+const char* WIFI_PASS = "YourPassword";
+
+// Example URL and target path — change when integrating
+const String DOWNLOAD_URL = "https://httpbin.org/bytes/102400";  // 100KB file
+const String TARGET_PATH = "/downloaded.bin";
+
+// Scan and roam to the best AP before transfers of LARGE_TRANSFER_THRESHOLD_BYTES or more
+const bool ROAM_BEFORE_LARGE_DOWNLOADS = true;
+
+// Progress as binary frames (decode with tools/telemetry_decoder.py) instead of text
+const bool BINARY_TELEMETRY = false;
+
+// Save the demo download's arrival pattern to TRACE_PATH for replay with ReplayStream
+const bool RECORD_ARRIVAL_TRACE = false;
+const String TRACE_PATH = "/arrival.atr";
+
+// Measure what the flash sustains before the first download (takes a minute or two)
+const bool RUN_STORAGE_BENCHMARK = false;
+
+// First boot benchmarks buffer/chunk sizes against this URL and keeps the result in NVS
+const String TUNING_TEST_URL = "https://httpbin.org/bytes/262144";  // 256KB file
+const bool FORCE_RECALIBRATION = false;
+
+// Sample both cores' program counters during the demo download and dump them for tools/pc_symbolize.py
+const bool PROFILE_DOWNLOAD = false;
+
+BufferManager globalBufMgr;
+PerformanceMonitor globalPerf;   // fallback when every job monitor is taken
+MonitorRegistry jobMonitors;
+DualCoreDownloader dualCoreDl;
+ArrivalTrace arrivalTrace;
+DownloadCache downloadCache;
+HotFileCache hotFiles;
+ContentStore contentStore;
+AutoTuner tuner;
+
+void setup() {
+Serial.begin(19200);
+delay(100);
+
+Serial.println("Starting up (humanized sketch)");
+if (BINARY_TELEMETRY) setTelemetryMode(TELEMETRY_BINARY);
+
+// SPIFFS mount
+if (!startSPIFFS()) {
+    Serial.println("SPIFFS failed to start. Continuing but file operations may fail.");
+}
+
+// did the last boot die in the middle of a download?
+reportCrashCounters();
+
+if (RUN_STORAGE_BENCHMARK) runStorageBenchmark();
+
+// WiFi connect
+if (!connectToWifi(WIFI_SSID, WIFI_PASS, 20000)) {
+    Serial.println("Unable to connect to WiFi — continuing with limited functionality.");
+}
+
+// calibrate once per board (or on request), then size buffers from the stored result
+tuner.begin();
+if (FORCE_RECALIBRATION) tuner.clear();
+if (tuner.needsCalibration() && WiFi.status() == WL_CONNECTED) tuner.calibrate(TUNING_TEST_URL);
+tuner.printConfig();
+globalBufMgr.setTunedConfig(&tuner.getConfig());
+
+// Prepare buffer manager (try to enable smart allocation)
+if (!globalBufMgr.allocateBuffers()) {
+    Serial.println("Buffer allocation failed; continuing with minimal buffers.");
+    // optionally try small fixed allocation
+    globalBufMgr.allocateBuffers(8192, 4096);
+}
+
+// Attach helpers
+dualCoreDl.setBufferManager(&globalBufMgr);
+dualCoreDl.setPerformanceMonitor(&globalPerf);
+
+// previous downloads become evictable when a new one needs the room
+downloadCache.begin();
+dualCoreDl.setDownloadCache(&downloadCache);
+setDownloadCache(&downloadCache);   // reads through the storage helpers refresh the eviction order
+
+// keep just-downloaded files in PSRAM for the first reads (boards without PSRAM skip this)
+if (hotFiles.begin()) setHotFileCache(&hotFiles);
+
+// deduplicated downloads (HttpDownloader::setContentStore) resolve through the storage helpers
+if (contentStore.begin()) setContentStore(&contentStore);
+
+
+}
+
+void loop() {
+// One-shot example: perform a single download and then halt (or sleep)
+Serial.println("Starting dual-core FreeRTOS download: " + DOWNLOAD_URL);
+
+ApRoamResult roam;
+if (ROAM_BEFORE_LARGE_DOWNLOADS) {
+    HttpResponse head = httpHead(DOWNLOAD_URL);
+    if (head.ok && head.contentLength >= LARGE_TRANSFER_THRESHOLD_BYTES) {
+        roam = selectBestAccessPoint(WIFI_SSID, WIFI_PASS);
+    }
+}
+
+if (RECORD_ARRIVAL_TRACE) dualCoreDl.setArrivalTrace(&arrivalTrace);
+// the pipeline block learned for this host (DualCore does not use the manager's download buffer)
+size_t pipelineBlock = tuner.prepare(dualCoreDl, DOWNLOAD_URL);
+// each job gets its own monitor so a second download cannot reset this one's figures
+PerformanceMonitor* jobPerf = jobMonitors.acquire(DOWNLOAD_URL, "demo");
+if (jobPerf) jobPerf->setVerbose(true);   // only job running: progress lines are fine
+dualCoreDl.setPerformanceMonitor(jobPerf ? jobPerf : &globalPerf);
+if (PROFILE_DOWNLOAD) startPcSampling();
+DownloadResult res = dualCoreDl.download(DOWNLOAD_URL, TARGET_PATH);
+if (PROFILE_DOWNLOAD) stopPcSampling();
+tuner.recordResult(DOWNLOAD_URL, pipelineBlock, res, TUNED_PIPELINE_BLOCK);
+if (RECORD_ARRIVAL_TRACE && arrivalTrace.save(TRACE_PATH)) arrivalTrace.printSummary();
+recordTransferOnAccessPoint(roam, res);
+logDownloadResult(dualCoreDl.getName(), DOWNLOAD_URL, res);
+
+if (res.success) {
+    Serial.println("Downloaded successfully: " + String(res.totalBytes) + " bytes");
+    (jobPerf ? jobPerf : &globalPerf)->printEnhancedResults(res.totalBytes);
+    if (res.apRoamed) {
+        Serial.println("Roamed to " + res.apBssid + " (cost " + String(res.apRoamCostMs) + " ms, gain " + String(res.apThroughputGainPercent) + "%)");
+    }
+} else {
+    Serial.println("Download failed: " + res.errorMessage);
+}
+if (jobPerf) jobMonitors.release(jobPerf, res);
+jobMonitors.printSnapshot();
+downloadCache.printStats();
+hotFiles.printStats();
+contentStore.printStats();
+printHotTimerReport();
+printTelemetryStats();
+if (PROFILE_DOWNLOAD) {
+    printPcSamplerStats();
+    dumpPcSamples();
+}
+
+// done for demo purposes: sleep forever
+Serial.println("Main loop finished — halting.");
+while (true) {
+    delay(1000);
+}
+
+
 }
\ No newline at end of file
@@ -0,0 +1,482 @@
+#include "metadata_probe.h"
+#include "network_and_http.h"
+#include "buffer_and_performance.h"
+#include <deque>
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <lwip/sockets.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+namespace {
+
+int defaultConnections = PROBE_DEFAULT_CONNECTIONS;
+
+struct Origin {
+    String host;
+    uint16_t port;
+    bool secure;
+    IPAddress ip;
+    bool resolved;
+    int connections;
+    std::deque<size_t> pending;   // indices into the url list
+};
+
+enum ConnState {
+    CONN_FREE,
+    CONN_IDLE,         // keep-alive socket waiting for the next request
+    CONN_CONNECTING,
+    CONN_SENDING,
+    CONN_READING_HEADERS,
+    CONN_DRAINING      // discarding the body of a Range probe
+};
+
+struct ProbeConn {
+    int fd = -1;
+    int origin = -1;
+    ConnState state = CONN_FREE;
+    size_t item = 0;
+    String request;
+    size_t sent = 0;
+    String head;
+    size_t bodyLeft = 0;
+    bool keepAlive = false;
+    int requestsOnSocket = 0;
+    unsigned long startedAt = 0;
+    unsigned long deadline = 0;
+};
+
+// Value of a response header (case-insensitive name), or empty
+String headerValue(const String& head, const String& lowerHead, const char* name) {
+    String key = String("\r\n") + name + ":";
+    key.toLowerCase();
+    int at = lowerHead.indexOf(key);
+    if (at < 0) return String("");
+    int end = head.indexOf("\r\n", at + key.length());
+    String v = head.substring(at + key.length(), end < 0 ? head.length() : end);
+    v.trim();
+    return v;
+}
+
+void closeSocket(ProbeConn& c, std::vector<Origin>& origins) {
+    if (c.fd >= 0) {
+        close(c.fd);
+        c.fd = -1;
+        origins[c.origin].connections--;
+    }
+    c.state = CONN_FREE;
+    c.origin = -1;
+    c.requestsOnSocket = 0;
+}
+
+bool openSocket(ProbeConn& c, std::vector<Origin>& origins, int originIndex) {
+    Origin& o = origins[originIndex];
+    if (!o.resolved) {
+        // blocking, but once per origin
+        o.resolved = WiFi.hostByName(o.host.c_str(), o.ip) == 1;
+        if (!o.resolved) return false;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) return false;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(o.port);
+    addr.sin_addr.s_addr = (uint32_t)o.ip;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return false;
+    }
+
+    c.fd = fd;
+    c.origin = originIndex;
+    c.state = CONN_CONNECTING;
+    c.requestsOnSocket = 0;
+    o.connections++;
+    return true;
+}
+
+void startRequest(ProbeConn& c, const Origin& o, size_t item, const String& path, ProbeMethod method) {
+    c.item = item;
+    c.request = String(method == PROBE_HEAD ? "HEAD " : "GET ") + path + " HTTP/1.1\r\n";
+    c.request += "Host: " + o.host + (o.port != 80 ? ":" + String(o.port) : String("")) + "\r\n";
+    if (method == PROBE_RANGE) c.request += "Range: bytes=0-0\r\n";
+    c.request += "Connection: keep-alive\r\n\r\n";
+    c.sent = 0;
+    c.head = "";
+    c.bodyLeft = 0;
+    c.startedAt = millis();
+    c.deadline = c.startedAt + PROBE_TIMEOUT_MS;
+    c.requestsOnSocket++;
+    if (c.state == CONN_IDLE) c.state = CONN_SENDING;
+}
+
+// Fill r from the response head; false if the head is malformed
+bool parseHead(const String& head, ProbeMethod method, ProbeResult& r, size_t& bodyLength, bool& keepAlive) {
+    int sp = head.indexOf(' ');
+    if (!head.startsWith("HTTP/1.") || sp < 0) return false;
+    r.statusCode = head.substring(sp + 1).toInt();
+
+    String lower = head;
+    lower.toLowerCase();
+    String len = headerValue(head, lower, "Content-Length");
+    r.etag = headerValue(head, lower, "ETag");
+    r.lastModified = headerValue(head, lower, "Last-Modified");
+    r.acceptRanges = headerValue(head, lower, "Accept-Ranges").equalsIgnoreCase("bytes");
+    keepAlive = !headerValue(head, lower, "Connection").equalsIgnoreCase("close") && !head.startsWith("HTTP/1.0");
+
+    bodyLength = 0;
+    if (method == PROBE_HEAD) {
+        r.contentLength = len.length() > 0 ? (size_t)len.toInt() : 0;
+    } else if (r.statusCode == 206) {
+        // Content-Range: bytes 0-0/12345
+        String range = headerValue(head, lower, "Content-Range");
+        int slash = range.indexOf('/');
+        r.contentLength = slash >= 0 ? (size_t)range.substring(slash + 1).toInt() : 0;
+        r.acceptRanges = true;
+        if (len.length() > 0) {
+            bodyLength = len.toInt();
+        } else {
+            keepAlive = false;
+        }
+    } else {
+        // range ignored: the whole body follows; close instead of draining it
+        r.contentLength = len.length() > 0 ? (size_t)len.toInt() : 0;
+        keepAlive = false;
+    }
+    r.ok = r.statusCode >= 200 && r.statusCode < 300;
+    return true;
+}
+
+// https: no select() loop over TLS here. Workers take items (grouped by origin) from a shared
+// list, each over its own kept-alive connection, so one origin can still be probed in parallel.
+struct SecureWork {
+    const std::vector<String>* urls;
+    std::vector<ProbeResult>* results;
+    std::vector<size_t> items;
+    size_t next = 0;
+    ProbeMethod method = PROBE_HEAD;
+    ProbeBatchStats stats;             // secure share only; merged after the workers finish
+    SemaphoreHandle_t lock = nullptr;
+    SemaphoreHandle_t done = nullptr;  // one give per worker task
+};
+
+void probeSecureItems(SecureWork& w) {
+    const char* keys[] = { "ETag", "Last-Modified", "Accept-Ranges", "Content-Range" };
+    HTTPClient http;
+    http.setReuse(true);
+    http.setTimeout(PROBE_TIMEOUT_MS);
+    size_t ok = 0, requests = 0;
+
+    while (true) {
+        xSemaphoreTake(w.lock, portMAX_DELAY);
+        bool more = w.next < w.items.size();
+        size_t item = more ? w.items[w.next++] : 0;
+        xSemaphoreGive(w.lock);
+        if (!more) break;
+
+        ProbeResult& r = (*w.results)[item];
+        unsigned long start = millis();
+        http.begin((*w.urls)[item]);
+        http.collectHeaders(keys, 4);
+        int code;
+        if (w.method == PROBE_RANGE) {
+            http.addHeader("Range", "bytes=0-0");
+            code = http.GET();
+        } else {
+            code = http.sendRequest("HEAD");
+        }
+        requests++;
+
+        r.statusCode = code;
+        r.ok = code >= 200 && code < 300;
+        r.etag = http.header("ETag");
+        r.lastModified = http.header("Last-Modified");
+        r.acceptRanges = http.header("Accept-Ranges").equalsIgnoreCase("bytes") || code == 206;
+        int size = http.getSize();
+        r.contentLength = size > 0 ? (size_t)size : 0;
+        if (code == 206) {
+            String range = http.header("Content-Range");
+            int slash = range.indexOf('/');
+            if (slash >= 0) r.contentLength = range.substring(slash + 1).toInt();
+            http.getString(); // the single byte, so the connection can be reused
+        }
+        if (r.ok) ok++;
+        if (code <= 0) r.errorMessage = HTTPClient::errorToString(code);
+        r.latencyMs = millis() - start;
+        http.end();
+    }
+
+    if (requests == 0) return;
+    xSemaphoreTake(w.lock, portMAX_DELAY);
+    w.stats.ok += ok;
+    w.stats.connectionsOpened++;
+    w.stats.requestsReused += requests - 1;
+    xSemaphoreGive(w.lock);
+}
+
+void secureWorkerTask(void* arg) {
+    SecureWork* w = (SecureWork*)arg;
+    probeSecureItems(*w);
+    xSemaphoreGive(w->done);
+    vTaskDelete(nullptr);
+}
+}
+
+std::vector<ProbeResult> probeBatch(const std::vector<String>& urls, int maxConnections, ProbeMethod method, ProbeBatchStats* statsOut) {
+    ProbeBatchStats stats;
+    unsigned long batchStart = millis();
+    std::vector<ProbeResult> results(urls.size());
+    std::vector<String> paths(urls.size());
+    std::vector<uint8_t> retried(urls.size(), 0);
+    std::vector<Origin> origins;
+    stats.urls = urls.size();
+
+    // group by origin so keep-alive sockets can be reused
+    size_t remaining = 0;
+    for (size_t i = 0; i < urls.size(); ++i) {
+        results[i].url = urls[i];
+        UrlParts u;
+        if (!parseUrl(urls[i], u)) {
+            results[i].errorMessage = "Unsupported URL";
+            continue;
+        }
+        paths[i] = u.path;
+        int o = -1;
+        for (size_t k = 0; k < origins.size(); ++k) {
+            if (origins[k].host == u.host && origins[k].port == u.port && origins[k].secure == u.secure) o = (int)k;
+        }
+        if (o < 0) {
+            Origin origin;
+            origin.host = u.host;
+            origin.port = u.port;
+            origin.secure = u.secure;
+            origin.resolved = false;
+            origin.connections = 0;
+            origins.push_back(origin);
+            o = origins.size() - 1;
+        }
+        origins[o].pending.push_back(i);
+        if (!u.secure) remaining++;
+    }
+
+    if (maxConnections == 0) maxConnections = defaultConnections;
+    if (maxConnections < 1) maxConnections = 1;
+    std::vector<ProbeConn> conns(maxConnections);
+
+    // https starts first on its own tasks so it overlaps the select() loop below
+    SecureWork secure;
+    secure.urls = &urls;
+    secure.results = &results;
+    secure.method = method;
+    for (const auto& o : origins) {
+        if (o.secure) secure.items.insert(secure.items.end(), o.pending.begin(), o.pending.end());
+    }
+    int secureWorkers = 0;
+    if (!secure.items.empty()) {
+        secure.lock = xSemaphoreCreateMutex();
+        secure.done = xSemaphoreCreateCounting(maxConnections, 0);
+        int wanted = min(maxConnections, (int)secure.items.size());
+        while (secure.lock && secure.done && secureWorkers < wanted &&
+               ESP.getFreeHeap() > PROBE_TLS_HEAP_BYTES * (secureWorkers + 1)) {
+            if (xTaskCreate(secureWorkerTask, "ProbeTLS", 8192, &secure, 1, nullptr) != pdPASS) break;
+            secureWorkers++;
+        }
+    }
+
+    auto complete = [&](ProbeConn& c, bool reusable) {
+        ProbeResult& r = results[c.item];
+        r.latencyMs = millis() - c.startedAt;
+        if (r.ok) stats.ok++;
+        remaining--;
+        if (reusable && c.keepAlive) {
+            c.state = CONN_IDLE;
+        } else {
+            closeSocket(c, origins);
+        }
+    };
+    auto fail = [&](ProbeConn& c, const String& why) {
+        // a kept-alive socket the server already closed: one more try on a fresh connection
+        if (c.requestsOnSocket > 1 && !retried[c.item]) {
+            retried[c.item] = 1;
+            origins[c.origin].pending.push_front(c.item);
+            closeSocket(c, origins);
+            return;
+        }
+        results[c.item].errorMessage = why;
+        results[c.item].latencyMs = millis() - c.startedAt;
+        remaining--;
+        closeSocket(c, origins);
+    };
+
+    while (remaining > 0) {
+        // hand work to idle and free slots: same origin first, then the origin with the fewest sockets
+        for (auto& c : conns) {
+            if (c.state != CONN_FREE && c.state != CONN_IDLE) continue;
+            if (c.state == CONN_IDLE && !origins[c.origin].pending.empty()) {
+                size_t item = origins[c.origin].pending.front();
+                origins[c.origin].pending.pop_front();
+                startRequest(c, origins[c.origin], item, paths[item], method);
+                stats.requestsReused++;
+                continue;
+            }
+
+            int best = -1;
+            for (size_t k = 0; k < origins.size(); ++k) {
+                const Origin& o = origins[k];
+                if (o.secure || o.pending.empty() || o.connections >= (int)o.pending.size()) continue;
+                if (best < 0 || o.connections < origins[best].connections) best = (int)k;
+            }
+            if (best < 0) continue;
+            if (c.state == CONN_IDLE) closeSocket(c, origins);
+
+            size_t item = origins[best].pending.front();
+            origins[best].pending.pop_front();
+            if (!openSocket(c, origins, best)) {
+                results[item].errorMessage = "Connect failed: " + origins[best].host;
+                remaining--;
+                continue;
+            }
+            stats.connectionsOpened++;
+            startRequest(c, origins[best], item, paths[item], method);
+        }
+
+        fd_set readSet, writeSet;
+        FD_ZERO(&readSet);
+        FD_ZERO(&writeSet);
+        int maxFd = -1;
+        for (auto& c : conns) {
+            if (c.fd < 0 || c.state == CONN_IDLE) continue;
+            if (c.state == CONN_CONNECTING || c.state == CONN_SENDING) FD_SET(c.fd, &writeSet);
+            else FD_SET(c.fd, &readSet);
+            if (c.fd > maxFd) maxFd = c.fd;
+        }
+        if (maxFd < 0) {
+            if (remaining > 0) delay(1); // only connect failures this round
+            continue;
+        }
+
+        struct timeval tv = { 0, 20000 };
+        int ready = select(maxFd + 1, &readSet, &writeSet, nullptr, &tv);
+        if (ready < 0) {
+            // nothing in this loop can finish now: every unanswered http item gets the reason
+            String why = "select() failed, errno " + String(errno);
+            for (auto& c : conns) {
+                if (c.fd < 0 || c.state == CONN_IDLE) continue;
+                results[c.item].errorMessage = why;
+                results[c.item].latencyMs = millis() - c.startedAt;
+            }
+            for (auto& o : origins) {
+                if (o.secure) continue;
+                for (size_t item : o.pending) results[item].errorMessage = why;
+                o.pending.clear();
+            }
+            break;
+        }
+
+        for (auto& c : conns) {
+            if (c.fd < 0 || c.state == CONN_IDLE) continue;
+            if ((long)(millis() - c.deadline) > 0) {
+                fail(c, "Timeout");
+                continue;
+            }
+
+            if (c.state == CONN_CONNECTING && FD_ISSET(c.fd, &writeSet)) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0) {
+                    fail(c, "Connect failed: " + origins[c.origin].host);
+                    continue;
+                }
+                c.state = CONN_SENDING;
+            }
+
+            if (c.state == CONN_SENDING && FD_ISSET(c.fd, &writeSet)) {
+                int n = send(c.fd, c.request.c_str() + c.sent, c.request.length() - c.sent, 0);
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                    fail(c, "Send failed");
+                    continue;
+                }
+                if (n > 0) c.sent += n;
+                if (c.sent == c.request.length()) c.state = CONN_READING_HEADERS;
+                continue;
+            }
+
+            if (!FD_ISSET(c.fd, &readSet)) continue;
+            char buf[512];
+            int n = recv(c.fd, buf, sizeof(buf), 0);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+            if (n <= 0) {
+                fail(c, "Connection closed");
+                continue;
+            }
+
+            if (c.state == CONN_DRAINING) {
+                c.bodyLeft -= min((size_t)n, c.bodyLeft);
+                if (c.bodyLeft == 0) complete(c, true);
+                continue;
+            }
+
+            c.head.concat(buf, n);
+            int end = c.head.indexOf("\r\n\r\n");
+            if (end < 0) {
+                if (c.head.length() > PROBE_HEADER_LIMIT) fail(c, "Response header too large");
+                continue;
+            }
+
+            size_t bodyLength = 0;
+            if (!parseHead(c.head.substring(0, end + 2), method, results[c.item], bodyLength, c.keepAlive)) {
+                fail(c, "Malformed response");
+                continue;
+            }
+            size_t already = c.head.length() - (end + 4);
+            c.bodyLeft = bodyLength > already ? bodyLength - already : 0;
+            if (c.bodyLeft > 0) {
+                c.state = CONN_DRAINING;
+            } else {
+                complete(c, true);
+            }
+        }
+    }
+
+    for (auto& c : conns) closeSocket(c, origins);
+
+    if (!secure.items.empty()) {
+        // no worker could start (heap or task limits): probe them from this task instead
+        if (secureWorkers == 0 && secure.lock) probeSecureItems(secure);
+        for (int i = 0; i < secureWorkers; ++i) xSemaphoreTake(secure.done, portMAX_DELAY);
+        if (!secure.lock) {
+            for (size_t item : secure.items) results[item].errorMessage = "Out of memory";
+        }
+        stats.ok += secure.stats.ok;
+        stats.connectionsOpened += secure.stats.connectionsOpened;
+        stats.requestsReused += secure.stats.requestsReused;
+        if (secure.lock) vSemaphoreDelete(secure.lock);
+        if (secure.done) vSemaphoreDelete(secure.done);
+    }
+
+    stats.totalMs = millis() - batchStart;
+    if (statsOut) *statsOut = stats;
+    return results;
+}
+
+void setDefaultProbeConnections(int connections) {
+    defaultConnections = connections > 0 ? connections : PROBE_DEFAULT_CONNECTIONS;
+}
+
+void printProbeStats(const ProbeBatchStats& stats) {
+    Serial.println("=== BATCH PROBE ===");
+    Serial.println("URLs: " + String((unsigned)stats.urls) + ", ok: " + String((unsigned)stats.ok));
+    Serial.println("Connections opened: " + String((unsigned)stats.connectionsOpened) + ", reused requests: " +
+                   String((unsigned)stats.requestsReused));
+    Serial.println("Total time: " + PerformanceMonitor::formatTime(stats.totalMs) +
+                   (stats.urls > 0 ? " (" + String((float)stats.totalMs / stats.urls, 1) + " ms/URL)" : String("")));
+    Serial.println("===================");
+}
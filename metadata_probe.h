@@ -0,0 +1,46 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+
+// Batch metadata probing before a sync: HEAD (or a 1-byte Range GET) for many URLs at once.
+// Plain http runs over a capped pool of non-blocking keep-alive sockets multiplexed with select()
+// from the caller's task. https runs at the same time on up to maxConnections worker tasks, each
+// with its own kept-alive HTTPClient connection (fewer when the heap cannot hold that many TLS sessions).
+
+const int PROBE_DEFAULT_CONNECTIONS = 4;
+const unsigned long PROBE_TIMEOUT_MS = 5000;   // per request, connect included
+const size_t PROBE_HEADER_LIMIT = 2048;
+const size_t PROBE_TLS_HEAP_BYTES = 48 * 1024; // free heap wanted per concurrent TLS connection
+
+enum ProbeMethod {
+PROBE_HEAD,
+PROBE_RANGE     // GET bytes=0-0, for servers that mishandle HEAD
+};
+
+struct ProbeResult {
+String url;
+bool ok = false;
+int statusCode = 0;
+size_t contentLength = 0;     // full resource size (from Content-Range for PROBE_RANGE)
+String etag = "";
+String lastModified = "";
+bool acceptRanges = false;
+unsigned long latencyMs = 0;  // request sent -> headers parsed (connect excluded on reused sockets)
+String errorMessage = "";
+};
+
+struct ProbeBatchStats {
+size_t urls;
+size_t ok;
+size_t connectionsOpened;
+size_t requestsReused;        // requests that rode an existing keep-alive connection
+unsigned long totalMs;
+ProbeBatchStats() : urls(0), ok(0), connectionsOpened(0), requestsReused(0), totalMs(0) {}
+};
+
+// Results come back in the order of urls; maxConnections 0 = the default set below
+std::vector<ProbeResult> probeBatch(const std::vector<String>& urls, int maxConnections = 0,
+                                    ProbeMethod method = PROBE_HEAD, ProbeBatchStats* stats = nullptr);
+// Default concurrency for probeBatch (PROBE_DEFAULT_CONNECTIONS until the auto-tuner sets the calibrated one)
+void setDefaultProbeConnections(int connections);
+void printProbeStats(const ProbeBatchStats& stats);
@@ -0,0 +1,176 @@
+#include "monitor_registry.h"
+#include "network_and_http.h"
+
+MonitorRegistry::MonitorRegistry()
+: hostCount(0), recentNext(0), recentCount(0), nextJobId(1), completedJobs(0), failedJobs(0), completedBytes(0),
+  poolExhausted(0), lock(xSemaphoreCreateMutex()) {
+    for (int i = 0; i < MONITOR_POOL_SIZE; ++i) {
+        slots[i].inUse = false;
+        slots[i].jobId = 0;
+        slots[i].startedAt = 0;
+    }
+}
+
+MonitorRegistry::~MonitorRegistry() {
+    if (lock) vSemaphoreDelete(lock);
+}
+
+int MonitorRegistry::slotOf(const PerformanceMonitor* monitor) const {
+    for (int i = 0; i < MONITOR_POOL_SIZE; ++i) {
+        if (&slots[i].monitor == monitor) return i;
+    }
+    return -1;
+}
+
+HostStats& MonitorRegistry::hostEntry(const String& host) {
+    for (int i = 0; i < hostCount; ++i) {
+        if (hosts[i].host == host) return hosts[i];
+    }
+    int victim = hostCount;
+    if (hostCount < MONITOR_HOST_SLOTS) {
+        hostCount++;
+    } else {
+        victim = 0;
+        for (int i = 1; i < hostCount; ++i) {
+            if ((long)(hosts[i].lastSeen - hosts[victim].lastSeen) < 0) victim = i;
+        }
+    }
+    hosts[victim] = HostStats();
+    hosts[victim].host = host;
+    return hosts[victim];
+}
+
+PerformanceMonitor* MonitorRegistry::acquire(const String& url, const String& label) {
+    UrlParts parts;
+    String host = parseUrl(url, parts) ? parts.host : String("?");
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < MONITOR_POOL_SIZE; ++i) {
+        Slot& s = slots[i];
+        if (s.inUse) continue;
+        s.inUse = true;
+        s.jobId = nextJobId++;
+        s.label = label;
+        s.host = host;
+        s.startedAt = millis();
+        xSemaphoreGive(lock);
+
+        // the engine calls startMonitoring(); stop whatever the previous job left running
+        s.monitor.setVerbose(false);
+        s.monitor.stopMonitoring();
+        return &s.monitor;
+    }
+    poolExhausted++;
+    xSemaphoreGive(lock);
+    return nullptr;
+}
+
+void MonitorRegistry::release(PerformanceMonitor* monitor, const DownloadResult& result) {
+    int i = slotOf(monitor);
+    if (i < 0) return;
+    Slot& s = slots[i];
+    s.monitor.stopMonitoring();
+
+    JobSummary j;
+    j.jobId = s.jobId;
+    j.label = s.label;
+    j.host = s.host;
+    j.success = result.success;
+    j.bytes = result.totalBytes > 0 ? result.totalBytes : s.monitor.getTotalBytes();
+    j.durationMs = result.downloadTimeMs > 0 ? result.downloadTimeMs : millis() - s.startedAt;
+    j.averageKBps = result.averageSpeedKBps > 0.0f ? result.averageSpeedKBps : PerformanceMonitor::calculateSpeedKBps(j.bytes, j.durationMs);
+    j.peakKBps = result.peakSpeedKBps > 0.0f ? result.peakSpeedKBps : s.monitor.getPeakSpeed();
+    j.errorMessage = result.errorMessage;
+    j.finishedAt = millis();
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    recent[recentNext] = j;
+    recentNext = (recentNext + 1) % MONITOR_RECENT_JOBS;
+    if (recentCount < MONITOR_RECENT_JOBS) recentCount++;
+
+    HostStats& h = hostEntry(j.host);
+    h.jobs++;
+    h.lastSeen = j.finishedAt;
+    if (j.success) {
+        h.bytes += j.bytes;
+        h.busyMs += j.durationMs;
+        h.ewmaKBps = h.ewmaKBps > 0.0f ? h.ewmaKBps * (1.0f - MONITOR_HOST_EWMA) + j.averageKBps * MONITOR_HOST_EWMA : j.averageKBps;
+        completedJobs++;
+    } else {
+        h.failures++;
+        failedJobs++;
+    }
+    completedBytes += j.bytes;
+
+    s.inUse = false;
+    s.jobId = 0;
+    xSemaphoreGive(lock);
+}
+
+uint32_t MonitorRegistry::jobIdOf(const PerformanceMonitor* monitor) const {
+    int i = slotOf(monitor);
+    return i >= 0 && slots[i].inUse ? slots[i].jobId : 0;
+}
+
+RegistrySnapshot MonitorRegistry::snapshot() const {
+    RegistrySnapshot snap;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    snap.takenAt = millis();
+    snap.activeJobs = 0;
+    snap.totalKBps = 0.0f;
+    snap.totalBytes = completedBytes;
+    for (int i = 0; i < MONITOR_POOL_SIZE; ++i) {
+        const Slot& s = slots[i];
+        if (!s.inUse) continue;
+        // the job's task keeps writing these; a reading one update old is fine for a view
+        JobView v;
+        v.jobId = s.jobId;
+        v.label = s.label;
+        v.host = s.host;
+        v.bytes = s.monitor.getTotalBytes();
+        v.currentKBps = s.monitor.getCurrentSpeed();
+        v.averageKBps = s.monitor.getAverageSpeed();
+        v.elapsedMs = snap.takenAt - s.startedAt;
+        snap.active.push_back(v);
+        snap.activeJobs++;
+        snap.totalKBps += v.currentKBps;
+        snap.totalBytes += v.bytes;
+    }
+    snap.freeMonitors = MONITOR_POOL_SIZE - snap.activeJobs;
+    snap.completedJobs = completedJobs;
+    snap.failedJobs = failedJobs;
+    snap.poolExhausted = poolExhausted;
+    for (int i = 0; i < hostCount; ++i) snap.hosts.push_back(hosts[i]);
+    for (int k = 1; k <= recentCount; ++k) {
+        snap.recent.push_back(recent[(recentNext - k + MONITOR_RECENT_JOBS) % MONITOR_RECENT_JOBS]);
+    }
+    xSemaphoreGive(lock);
+    return snap;
+}
+
+void MonitorRegistry::printSnapshot() const {
+    RegistrySnapshot snap = snapshot();
+    Serial.println("\n=== JOB MONITORS ===");
+    Serial.println("Active: " + String(snap.activeJobs) + " (" + String(snap.freeMonitors) + " free), total " +
+                   PerformanceMonitor::formatSpeed(snap.totalKBps));
+    for (const auto& v : snap.active) {
+        Serial.printf("  #%u %-10s %-24s %10s  %.1f KB/s (avg %.1f)  %lus\n", (unsigned)v.jobId, v.label.c_str(), v.host.c_str(),
+                      PerformanceMonitor::formatBytes(v.bytes).c_str(), v.currentKBps, v.averageKBps, v.elapsedMs / 1000);
+    }
+    Serial.println("Completed: " + String((unsigned)snap.completedJobs) + ", failed: " + String((unsigned)snap.failedJobs) +
+                   ", bytes: " + PerformanceMonitor::formatBytes(snap.totalBytes));
+    if (snap.poolExhausted > 0) Serial.println("Pool exhausted: " + String((unsigned)snap.poolExhausted) + " times");
+
+    if (!snap.hosts.empty()) Serial.println("Hosts:");
+    for (const auto& h : snap.hosts) {
+        Serial.printf("  %-24s jobs %u (fail %u)  %10s  avg %.1f KB/s  recent %.1f KB/s\n", h.host.c_str(), (unsigned)h.jobs,
+                      (unsigned)h.failures, PerformanceMonitor::formatBytes(h.bytes).c_str(), h.averageKBps(), h.ewmaKBps);
+    }
+    if (!snap.recent.empty()) Serial.println("Recent jobs:");
+    for (const auto& j : snap.recent) {
+        Serial.printf("  #%u %-10s %-4s %10s in %s  %.1f KB/s%s%s\n", (unsigned)j.jobId, j.label.c_str(), j.success ? "ok" : "FAIL",
+                      PerformanceMonitor::formatBytes(j.bytes).c_str(), PerformanceMonitor::formatTime(j.durationMs).c_str(),
+                      j.averageKBps, j.errorMessage.length() > 0 ? "  " : "", j.errorMessage.c_str());
+    }
+    Serial.println("====================\n");
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "buffer_and_performance.h"
+
+// Per-job PerformanceMonitors from a fixed pool, so concurrent or back-to-back downloads stop
+// resetting each other's statistics. Finished jobs are folded into per-host aggregates and a
+// short history of summaries; snapshot() returns active jobs, hosts and history in one go.
+
+const int MONITOR_POOL_SIZE = 4;
+const int MONITOR_HOST_SLOTS = 8;      // least recently seen host is replaced when full
+const int MONITOR_RECENT_JOBS = 8;
+const float MONITOR_HOST_EWMA = 0.3f;  // weight of the newest job in a host's throughput
+
+struct JobView {
+uint32_t jobId;
+String label;
+String host;
+size_t bytes;
+float currentKBps;
+float averageKBps;
+unsigned long elapsedMs;
+};
+
+struct JobSummary {
+uint32_t jobId;
+String label;
+String host;
+bool success;
+size_t bytes;
+unsigned long durationMs;
+float averageKBps;
+float peakKBps;
+String errorMessage;
+unsigned long finishedAt;   // millis()
+};
+
+struct HostStats {
+String host;
+size_t jobs;
+size_t failures;
+size_t bytes;
+unsigned long busyMs;       // sum of job durations
+float ewmaKBps;             // recent jobs weigh more than the lifetime average
+unsigned long lastSeen;
+HostStats() : host(""), jobs(0), failures(0), bytes(0), busyMs(0), ewmaKBps(0.0f), lastSeen(0) {}
+float averageKBps() const { return PerformanceMonitor::calculateSpeedKBps(bytes, busyMs); }
+};
+
+struct RegistrySnapshot {
+unsigned long takenAt;
+int activeJobs;
+int freeMonitors;
+float totalKBps;            // sum of the active jobs' current speeds
+size_t completedJobs;
+size_t failedJobs;
+size_t totalBytes;          // finished jobs plus what the active ones have so far
+size_t poolExhausted;       // acquire() calls that found no free monitor
+std::vector<JobView> active;
+std::vector<HostStats> hosts;
+std::vector<JobSummary> recent;   // newest first
+};
+
+class MonitorRegistry {
+public:
+MonitorRegistry();
+~MonitorRegistry();
+
+// A reset, quiet monitor for one job; nullptr when all MONITOR_POOL_SIZE are in use.
+// Safe from any task.
+PerformanceMonitor* acquire(const String& url, const String& label = "");
+// Return the monitor and record how the job ended
+void release(PerformanceMonitor* monitor, const DownloadResult& result);
+uint32_t jobIdOf(const PerformanceMonitor* monitor) const;   // 0 for monitors not from this pool
+
+RegistrySnapshot snapshot() const;
+void printSnapshot() const;
+
+private:
+struct Slot {
+    PerformanceMonitor monitor;
+    bool inUse;
+    uint32_t jobId;
+    String label;
+    String host;
+    unsigned long startedAt;
+};
+
+Slot slots[MONITOR_POOL_SIZE];
+HostStats hosts[MONITOR_HOST_SLOTS];
+int hostCount;
+JobSummary recent[MONITOR_RECENT_JOBS];
+int recentNext;
+int recentCount;
+uint32_t nextJobId;
+size_t completedJobs;
+size_t failedJobs;
+size_t completedBytes;
+size_t poolExhausted;
+SemaphoreHandle_t lock;
+
+int slotOf(const PerformanceMonitor* monitor) const;
+HostStats& hostEntry(const String& host);
+};
@@ -1,59 +1,301 @@
-#include "network_and_http.h"
-#include <HTTPClient.h>
-#include <WiFi.h>
-
-bool connectToWifi(const char* ssid, const char* pass, unsigned long timeoutMs) {
-if (!ssid || strlen(ssid) == 0) return false;
-if (WiFi.isConnected()) {
-// already connected but maybe to another AP; leave as-is
-Serial.println("WiFi already connected");
-return true;
-}
-
-WiFi.mode(WIFI_STA);
-WiFi.begin(ssid, pass);
-
-unsigned long start = millis();
-Serial.println("Connecting to WiFi: " + String(ssid));
-
-while (millis() - start < timeoutMs) {
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.println("WiFi connected, IP: " + WiFi.localIP().toString());
-        return true;
-    }
-    delay(250);
-}
-
-Serial.println("WiFi connection timed out");
-return false;
-
-
-}
-
-void disconnectWifiGracefully() {
-if (WiFi.isConnected()) {
-WiFi.disconnect(true, true);
-Serial.println("WiFi disconnected");
-}
-}
-
-HttpResponse httpHead(const String& url) {
-HttpResponse r;
-HTTPClient http;
-http.begin(url);
-int code = http.sendRequest("HEAD");
-r.statusCode = code;
-r.ok = (code >= 200 && code < 300);
-r.contentLength = http.getSize();
-// getResponseHeader is not always available in embedded libs; left as a human note
-r.reason = code == 200 ? String("OK") : String("HTTP") + String(code);
-http.end();
-return r;
-}
-
-void setDeviceHostname(const String& name) {
-// small check to avoid empty names
-if (name.length() == 0) return;
-WiFi.setHostname(name.c_str());
-Serial.println("Hostname set to " + name);
-}
\ No newline at end of file
+#include "network_and_http.h"
+#include "hot_path_timer.h"
+#include <HTTPClient.h>
+#include <WiFi.h>
+#include <Preferences.h>
+
+bool connectToWifi(const char* ssid, const char* pass, unsigned long timeoutMs) {
+if (!ssid || strlen(ssid) == 0) return false;
+if (WiFi.isConnected()) {
+// already connected but maybe to another AP; leave as-is
+Serial.println("WiFi already connected");
+return true;
+}
+
+WiFi.mode(WIFI_STA);
+WiFi.begin(ssid, pass);
+
+unsigned long start = millis();
+Serial.println("Connecting to WiFi: " + String(ssid));
+
+while (millis() - start < timeoutMs) {
+    if (WiFi.status() == WL_CONNECTED) {
+        Serial.println("WiFi connected, IP: " + WiFi.localIP().toString());
+        return true;
+    }
+    delay(250);
+}
+
+Serial.println("WiFi connection timed out");
+return false;
+
+
+}
+
+void disconnectWifiGracefully() {
+if (WiFi.isConnected()) {
+WiFi.disconnect(true, true);
+Serial.println("WiFi disconnected");
+}
+}
+
+bool parseUrl(const String& url, UrlParts& out) {
+    int schemeEnd = url.indexOf("://");
+    if (schemeEnd <= 0) return false;
+
+    out.scheme = url.substring(0, schemeEnd);
+    out.scheme.toLowerCase();
+    if (out.scheme == "https") {
+        out.secure = true;
+        out.port = 443;
+    } else if (out.scheme == "http") {
+        out.secure = false;
+        out.port = 80;
+    } else {
+        return false;
+    }
+
+    int hostStart = schemeEnd + 3;
+    int pathStart = url.indexOf('/', hostStart);
+    String hostPort = pathStart < 0 ? url.substring(hostStart) : url.substring(hostStart, pathStart);
+    out.path = pathStart < 0 ? String("/") : url.substring(pathStart);
+
+    int colon = hostPort.indexOf(':');
+    if (colon >= 0) {
+        long port = hostPort.substring(colon + 1).toInt();
+        if (port <= 0 || port > 65535) return false;
+        out.port = (uint16_t)port;
+        hostPort = hostPort.substring(0, colon);
+    }
+    out.host = hostPort;
+    return out.host.length() > 0;
+}
+
+HttpResponse httpHead(const String& url) {
+HOT_TIMER("http.head");
+HttpResponse r;
+HTTPClient http;
+http.begin(url);
+int code = http.sendRequest("HEAD");
+r.statusCode = code;
+r.ok = (code >= 200 && code < 300);
+int size = http.getSize();
+r.contentLength = size > 0 ? (size_t)size : 0; // -1 means the server did not say
+// getResponseHeader is not always available in embedded libs; left as a human note
+r.reason = code == 200 ? String("OK") : String("HTTP") + String(code);
+http.end();
+return r;
+}
+
+void setDeviceHostname(const String& name) {
+// small check to avoid empty names
+if (name.length() == 0) return;
+WiFi.setHostname(name.c_str());
+Serial.println("Hostname set to " + name);
+}
+// ---- Access point selection ----
+
+namespace {
+
+struct ApHistoryEntry {
+    uint8_t bssid[6];
+    float throughputKBps; // EWMA of measured transfers
+    uint16_t samples;
+};
+
+ApHistoryEntry apHistory[AP_HISTORY_SIZE];
+int apHistoryCount = 0;
+bool apHistoryLoaded = false;
+
+// The table is kept in NVS so rankings survive reboots; loaded on first use
+void loadApHistory() {
+    if (apHistoryLoaded) return;
+    apHistoryLoaded = true;
+    Preferences prefs;
+    if (!prefs.begin(AP_HISTORY_NVS_NAMESPACE, true)) return;
+    size_t len = prefs.getBytesLength("tbl");
+    if (len > 0 && len <= sizeof(apHistory) && len % sizeof(ApHistoryEntry) == 0) {
+        prefs.getBytes("tbl", apHistory, len);
+        apHistoryCount = len / sizeof(ApHistoryEntry);
+    }
+    prefs.end();
+}
+
+void saveApHistory() {
+    Preferences prefs;
+    if (!prefs.begin(AP_HISTORY_NVS_NAMESPACE, false)) return;
+    prefs.putBytes("tbl", apHistory, apHistoryCount * sizeof(ApHistoryEntry));
+    prefs.end();
+}
+
+String formatBssid(const uint8_t* bssid) {
+    char buf[18];
+    snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X",
+             bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5]);
+    return String(buf);
+}
+
+ApHistoryEntry* findApHistory(const uint8_t* bssid) {
+    loadApHistory();
+    for (int i = 0; i < apHistoryCount; ++i) {
+        if (memcmp(apHistory[i].bssid, bssid, 6) == 0) return &apHistory[i];
+    }
+    return nullptr;
+}
+
+// Score in rough "points": RSSI dominates, crowded channels cost, proven throughput adds a bonus
+float scoreCandidate(const ApCandidate& c) {
+    int clamped = constrain((int)c.rssi, -90, -30);
+    float score = (clamped + 90) * (100.0f / 60.0f);
+    score -= min(c.overlappingAps * 8.0f, 40.0f);
+    if (c.pastThroughputKBps > 0.0f) {
+        score += min(c.pastThroughputKBps / TARGET_SPEED_KBPS, 1.0f) * 50.0f;
+    }
+    return score;
+}
+
+} // namespace
+
+void recordApThroughput(const uint8_t* bssid, float speedKBps) {
+    if (!bssid || speedKBps <= 0.0f) return;
+    ApHistoryEntry* e = findApHistory(bssid);
+    if (!e) {
+        // table full: overwrite the least-sampled entry
+        if (apHistoryCount < AP_HISTORY_SIZE) {
+            e = &apHistory[apHistoryCount++];
+        } else {
+            e = &apHistory[0];
+            for (int i = 1; i < AP_HISTORY_SIZE; ++i) {
+                if (apHistory[i].samples < e->samples) e = &apHistory[i];
+            }
+        }
+        memcpy(e->bssid, bssid, 6);
+        e->throughputKBps = speedKBps;
+        e->samples = 1;
+    } else {
+        e->throughputKBps = (e->throughputKBps * 0.7f) + (speedKBps * 0.3f);
+        if (e->samples < 0xFFFF) e->samples++;
+    }
+    saveApHistory();
+}
+
+ApRoamResult selectBestAccessPoint(const char* ssid, const char* pass, unsigned long timeoutMs) {
+    ApRoamResult r;
+    if (!ssid || strlen(ssid) == 0) return r;
+
+    uint8_t currentBssid[6] = {0};
+    bool connected = WiFi.isConnected();
+    if (connected) {
+        memcpy(currentBssid, WiFi.BSSID(), 6);
+        r.bssidBefore = formatBssid(currentBssid);
+        r.rssiBefore = WiFi.RSSI();
+    }
+
+    unsigned long scanStart = millis();
+    int n = WiFi.scanNetworks(false, false);
+    r.scanTimeMs = millis() - scanStart;
+    r.scanned = true;
+    if (n <= 0) {
+        Serial.println("AP scan found nothing, staying on current AP");
+        WiFi.scanDelete();
+        r.bssidAfter = r.bssidBefore;
+        r.rssiAfter = r.rssiBefore;
+        return r;
+    }
+
+    ApCandidate best;
+    ApCandidate current;
+    bool haveBest = false;
+    bool haveCurrent = false;
+
+    for (int i = 0; i < n; ++i) {
+        if (WiFi.SSID(i) != ssid) continue;
+
+        ApCandidate c;
+        memcpy(c.bssid, WiFi.BSSID(i), 6);
+        c.rssi = WiFi.RSSI(i);
+        c.channel = WiFi.channel(i);
+
+        // 2.4 GHz channels closer than 5 apart overlap; count everyone else there
+        for (int j = 0; j < n; ++j) {
+            if (j == i) continue;
+            if (abs((int)WiFi.channel(j) - (int)c.channel) < 5) c.overlappingAps++;
+        }
+
+        ApHistoryEntry* h = findApHistory(c.bssid);
+        if (h) c.pastThroughputKBps = h->throughputKBps;
+        c.score = scoreCandidate(c);
+
+        Serial.printf("AP %s ch%d rssi %d load %d past %.1f KB/s -> score %.1f\n",
+                      formatBssid(c.bssid).c_str(), (int)c.channel, (int)c.rssi,
+                      c.overlappingAps, c.pastThroughputKBps, c.score);
+
+        if (connected && memcmp(c.bssid, currentBssid, 6) == 0) {
+            current = c;
+            haveCurrent = true;
+        }
+        if (!haveBest || c.score > best.score) {
+            best = c;
+            haveBest = true;
+        }
+    }
+    WiFi.scanDelete();
+
+    if (haveCurrent) r.previousApThroughputKBps = current.pastThroughputKBps;
+
+    bool shouldRoam = haveBest && (!connected || !haveCurrent || best.score > current.score + ROAM_HYSTERESIS_SCORE);
+    if (haveBest && connected && memcmp(best.bssid, currentBssid, 6) == 0) shouldRoam = false;
+
+    if (!shouldRoam) {
+        Serial.println("Staying on current AP " + r.bssidBefore);
+        r.bssidAfter = r.bssidBefore;
+        r.rssiAfter = r.rssiBefore;
+        return r;
+    }
+
+    Serial.println("Roaming to AP " + formatBssid(best.bssid) + " on channel " + String((int)best.channel));
+    unsigned long roamStart = millis();
+    if (connected) WiFi.disconnect(false, false);
+    WiFi.begin(ssid, pass, best.channel, best.bssid);
+
+    while (millis() - roamStart < timeoutMs && WiFi.status() != WL_CONNECTED) {
+        delay(50);
+    }
+
+    if (WiFi.status() != WL_CONNECTED) {
+        // could not get onto the chosen BSSID; let the driver pick again
+        Serial.println("Roam failed, reconnecting without BSSID pin");
+        WiFi.disconnect(false, false);
+        WiFi.begin(ssid, pass);
+        while (millis() - roamStart < timeoutMs * 2 && WiFi.status() != WL_CONNECTED) {
+            delay(50);
+        }
+    } else {
+        r.roamed = true;
+    }
+    r.roamTimeMs = millis() - roamStart;
+
+    if (WiFi.isConnected()) {
+        r.bssidAfter = WiFi.BSSIDstr();
+        r.rssiAfter = WiFi.RSSI();
+    }
+    Serial.println("Roam took " + String(r.roamTimeMs) + " ms, now on " + r.bssidAfter + " (" + String(r.rssiAfter) + " dBm)");
+    return r;
+}
+
+void recordTransferOnAccessPoint(const ApRoamResult& roam, DownloadResult& result) {
+    result.apRoamed = roam.roamed;
+    result.apRoamCostMs = roam.scanTimeMs + roam.roamTimeMs;
+
+    if (!WiFi.isConnected()) return;
+    result.apBssid = WiFi.BSSIDstr();
+
+    // pure transfer speed keeps connection setup noise out of the AP ranking
+    float measured = result.pureTransferSpeedKBps > 0.0f ? result.pureTransferSpeedKBps : result.averageSpeedKBps;
+    if (!result.success || measured <= 0.0f) return;
+
+    if (roam.previousApThroughputKBps > 0.0f) {
+        result.apThroughputGainPercent = (measured - roam.previousApThroughputKBps) * 100.0f / roam.previousApThroughputKBps;
+    }
+    recordApThroughput(WiFi.BSSID(), measured);
+}
@@ -1,32 +1,91 @@
-#pragma once
-#include <Arduino.h>
-#include <WiFi.h>
-#include "buffer_and_performance.h"
-
-// Small wrapper utilities around WiFi and HTTP behavior — humanized names
-
-bool connectToWifi(const char* ssid, const char* pass, unsigned long timeoutMs = 15000);
-void disconnectWifiGracefully();
-
-struct HttpRequest {
-String url;
-String method;
-// headers can be tweaked; kept simple for embedded
-std::vector<std::pair<String, String>> headers;
-HttpRequest() : url(""), method("GET"), headers() {}
-};
-
-struct HttpResponse {
-int statusCode;
-size_t contentLength;
-bool ok;
-String reason;
-// Note: body is intentionally omitted to avoid big copies; stream instead in download engines
-HttpResponse() : statusCode(0), contentLength(0), ok(false), reason("") {}
-};
-
-// Thin helper to perform a quick HEAD request for probing
-HttpResponse httpHead(const String& url);
-
-// helper to set WiFi hostname (small utility)
-void setDeviceHostname(const String& name);
\ No newline at end of file
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include "buffer_and_performance.h"
+
+// Small wrapper utilities around WiFi and HTTP behavior — humanized names
+
+bool connectToWifi(const char* ssid, const char* pass, unsigned long timeoutMs = 15000);
+void disconnectWifiGracefully();
+
+struct HttpRequest {
+String url;
+String method;
+// headers can be tweaked; kept simple for embedded
+std::vector<std::pair<String, String>> headers;
+HttpRequest() : url(""), method("GET"), headers() {}
+};
+
+struct HttpResponse {
+int statusCode;
+size_t contentLength;
+bool ok;
+String reason;
+// Note: body is intentionally omitted to avoid big copies; stream instead in download engines
+HttpResponse() : statusCode(0), contentLength(0), ok(false), reason("") {}
+};
+
+// Pieces of an http(s) URL, for code that talks to sockets directly instead of via HTTPClient
+struct UrlParts {
+String scheme;
+String host;
+uint16_t port;
+String path; // always starts with '/', includes the query string
+bool secure;
+UrlParts() : scheme(""), host(""), port(0), path("/"), secure(false) {}
+};
+
+// Split an http:// or https:// URL; returns false for anything else
+bool parseUrl(const String& url, UrlParts& out);
+
+// Thin helper to perform a quick HEAD request for probing
+HttpResponse httpHead(const String& url);
+
+// helper to set WiFi hostname (small utility)
+void setDeviceHostname(const String& name);
+
+// ---- Access point selection before large transfers ----
+
+// Transfers at or above this size are worth a scan + possible roam
+const size_t LARGE_TRANSFER_THRESHOLD_BYTES = 512 * 1024;
+// Best candidate must beat the current AP by this many score points before we roam
+const float ROAM_HYSTERESIS_SCORE = 10.0f;
+// Number of BSSIDs we remember measured throughput for (persisted in NVS under this namespace)
+const int AP_HISTORY_SIZE = 8;
+const char* const AP_HISTORY_NVS_NAMESPACE = "aphist";
+
+// One BSSID carrying our SSID, as seen by the pre-transfer scan
+struct ApCandidate {
+uint8_t bssid[6];
+int32_t rssi;
+int32_t channel;
+int overlappingAps;        // APs (any SSID) sharing or overlapping our channel: crude load proxy
+float pastThroughputKBps;  // 0 when we have never measured this BSSID
+float score;
+ApCandidate() : rssi(-127), channel(0), overlappingAps(0), pastThroughputKBps(0.0f), score(0.0f) { memset(bssid, 0, sizeof(bssid)); }
+};
+
+// What the scan/roam step did; folded into DownloadResult after the transfer
+struct ApRoamResult {
+bool scanned;
+bool roamed;
+String bssidBefore;
+String bssidAfter;
+int rssiBefore;
+int rssiAfter;
+unsigned long scanTimeMs;
+unsigned long roamTimeMs;
+float previousApThroughputKBps; // history for the AP we left (or stayed on)
+ApRoamResult() : scanned(false), roamed(false), bssidBefore(""), bssidAfter(""), rssiBefore(0), rssiAfter(0),
+scanTimeMs(0), roamTimeMs(0), previousApThroughputKBps(0.0f) {}
+};
+
+// Scan for our SSID, rank BSSIDs by RSSI, channel load and past throughput and roam to the best one.
+// Stays put (roamed == false) when already on the best AP or when the roam attempt fails.
+ApRoamResult selectBestAccessPoint(const char* ssid, const char* pass, unsigned long timeoutMs = 10000);
+
+// Remember what a BSSID actually delivered so later scans (also after a reboot) can rank it
+void recordApThroughput(const uint8_t* bssid, float speedKBps);
+
+// Record roam cost/gain into the result and feed the measured speed back into the AP history
+void recordTransferOnAccessPoint(const ApRoamResult& roam, DownloadResult& result);
\ No newline at end of file
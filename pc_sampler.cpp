@@ -0,0 +1,206 @@
+#include "pc_sampler.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <driver/gptimer.h>
+#include <esp_heap_caps.h>
+#include <esp_ota_ops.h>
+#include "buffer_and_performance.h"
+
+// Interrupt nesting depth per core, maintained by the port's interrupt entry/exit code
+#ifdef __XTENSA__
+extern "C" volatile unsigned port_interruptNesting[portNUM_PROCESSORS];
+#define PC_SAMPLER_NESTING(core) port_interruptNesting[core]
+#else
+extern "C" volatile UBaseType_t port_uxInterruptNesting[portNUM_PROCESSORS];
+#define PC_SAMPLER_NESTING(core) port_uxInterruptNesting[core]
+#endif
+
+// PC 0 marks a sample that interrupted another interrupt: the task frame does not describe it
+static uint32_t* rings[portNUM_PROCESSORS] = {};
+static size_t ringSize = 0;                         // samples per core
+static volatile uint32_t written[portNUM_PROCESSORS] = {};
+static volatile bool sampling = false;
+static bool hooked = false;
+static uint32_t sampleHz = 0;
+static gptimer_handle_t timers[portNUM_PROCESSORS] = {};
+static unsigned long windowStart = 0;
+static unsigned long windowMs = 0;
+
+static bool IRAM_ATTR onSampleTimer(gptimer_handle_t, const gptimer_alarm_event_data_t*, void* arg) {
+    int core = (int)(intptr_t)arg;
+    if (!sampling) return false;
+    uint32_t pc = 0;
+    // our own interrupt counts as one level; deeper means we landed inside another ISR
+    if (PC_SAMPLER_NESTING(core) == 1) {
+        // On first-level interrupt entry the port saves the interrupted task's registers on its
+        // stack and stores that stack pointer in the TCB's first field (pxTopOfStack).
+        const uint32_t* frame = *(const uint32_t* const*)xTaskGetCurrentTaskHandleForCPU(core);
+#ifdef __XTENSA__
+        pc = frame[1];    // XtExcFrame: exit, pc, ...
+#else
+        pc = frame[0];    // RvExcFrame: mepc, ...
+#endif
+    }
+    uint32_t n = written[core];
+    rings[core][n % ringSize] = pc;
+    written[core] = n + 1;
+    return false;
+}
+
+// A timer's interrupt is allocated on the core that sets it up, so each core configures its own
+struct TimerJob {
+    int core;
+    bool start;
+    bool ok;
+    SemaphoreHandle_t done;
+};
+
+static void timerSetupTask(void* arg) {
+    TimerJob* job = (TimerJob*)arg;
+    gptimer_handle_t& t = timers[job->core];
+    if (job->start) {
+        gptimer_config_t cfg = {};
+        cfg.clk_src = GPTIMER_CLK_SRC_DEFAULT;
+        cfg.direction = GPTIMER_COUNT_UP;
+        cfg.resolution_hz = 1000000;
+        gptimer_event_callbacks_t cbs = {};
+        cbs.on_alarm = onSampleTimer;
+        gptimer_alarm_config_t alarm = {};
+        alarm.alarm_count = 1000000 / sampleHz;
+        alarm.reload_count = 0;
+        alarm.flags.auto_reload_on_alarm = true;
+        job->ok = gptimer_new_timer(&cfg, &t) == ESP_OK &&
+                  gptimer_register_event_callbacks(t, &cbs, (void*)(intptr_t)job->core) == ESP_OK &&
+                  gptimer_set_alarm_action(t, &alarm) == ESP_OK &&
+                  gptimer_enable(t) == ESP_OK &&
+                  gptimer_start(t) == ESP_OK;
+    } else if (t) {
+        gptimer_stop(t);
+        gptimer_disable(t);
+        gptimer_del_timer(t);
+        t = nullptr;
+        job->ok = true;
+    }
+    xSemaphoreGive(job->done);
+    vTaskDelete(nullptr);
+}
+
+static bool runTimerJob(int core, bool start) {
+    TimerJob job = { core, start, false, xSemaphoreCreateBinary() };
+    if (!job.done) return false;
+    if (xTaskCreatePinnedToCore(timerSetupTask, "pcSampTmr", 3072, &job, configMAX_PRIORITIES - 1, nullptr, core) != pdPASS) {
+        vSemaphoreDelete(job.done);
+        return false;
+    }
+    xSemaphoreTake(job.done, portMAX_DELAY);
+    vSemaphoreDelete(job.done);
+    return job.ok;
+}
+
+bool beginPcSampler(size_t samples, uint32_t hz) {
+    if (hooked) return true;
+    if (samples < portNUM_PROCESSORS) {
+        // every core needs at least one slot: the ISR indexes its ring modulo ringSize
+        Serial.println("PC sampler: need at least " + String(portNUM_PROCESSORS) + " samples");
+        return false;
+    }
+    ringSize = samples / portNUM_PROCESSORS;
+    sampleHz = constrain(hz, (uint32_t)10, (uint32_t)20000);
+    for (int c = 0; c < portNUM_PROCESSORS; ++c) {
+        rings[c] = (uint32_t*)heap_caps_malloc(ringSize * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!rings[c]) {
+            Serial.println("PC sampler: not enough internal RAM for " + String((unsigned)samples) + " samples");
+            endPcSampler();
+            return false;
+        }
+        written[c] = 0;
+    }
+
+    hooked = true;
+    for (int c = 0; c < portNUM_PROCESSORS; ++c) {
+        if (!runTimerJob(c, true)) {
+            Serial.println("PC sampler: could not start a sampling timer on core " + String(c));
+            endPcSampler();
+            return false;
+        }
+    }
+    return true;
+}
+
+void endPcSampler() {
+    sampling = false;
+    for (int c = 0; c < portNUM_PROCESSORS; ++c) {
+        if (timers[c]) runTimerJob(c, false);
+    }
+    hooked = false;
+    for (int c = 0; c < portNUM_PROCESSORS; ++c) {
+        if (rings[c]) heap_caps_free(rings[c]);
+        rings[c] = nullptr;
+    }
+    ringSize = 0;
+}
+
+void startPcSampling() {
+    if (!hooked && !beginPcSampler()) return;
+    sampling = false;
+    for (int c = 0; c < portNUM_PROCESSORS; ++c) written[c] = 0;
+    windowStart = millis();
+    windowMs = 0;
+    sampling = true;
+}
+
+void stopPcSampling() {
+    if (!sampling) return;
+    sampling = false;
+    windowMs = millis() - windowStart;
+}
+
+bool pcSamplingActive() {
+    return sampling;
+}
+
+size_t pcSampleCount() {
+    size_t n = 0;
+    for (int c = 0; c < portNUM_PROCESSORS; ++c) n += min((size_t)written[c], ringSize);
+    return n;
+}
+
+void dumpPcSamples(Print& out) {
+    if (sampling) stopPcSampling();
+
+    // the symbolizer checks this against the ELF it was given
+    char elfSha[17] = "unknown";
+    esp_ota_get_app_elf_sha256(elfSha, sizeof(elfSha));
+
+    size_t dropped = 0;
+    for (int c = 0; c < portNUM_PROCESSORS; ++c) dropped += written[c] > ringSize ? written[c] - ringSize : 0;
+    out.printf("PCPROF v1 fw=%s elf=%s hz=%u cores=%d window_ms=%lu samples=%u dropped=%u\n", FIRMWARE_VERSION, elfSha,
+               (unsigned)sampleHz, portNUM_PROCESSORS, windowMs, (unsigned)pcSampleCount(), (unsigned)dropped);
+
+    for (int c = 0; c < portNUM_PROCESSORS; ++c) {
+        uint32_t n = written[c];
+        uint32_t first = n > ringSize ? n - ringSize : 0;
+        for (uint32_t i = first; i < n;) {
+            out.printf("PCS %d", c);
+            for (int k = 0; k < PC_SAMPLES_PER_LINE && i < n; ++k, ++i) out.printf(" %08x", (unsigned)rings[c][i % ringSize]);
+            out.print("\n");
+        }
+    }
+    out.print("PCPROF end\n");
+}
+
+void printPcSamplerStats() {
+    Serial.println("\n=== PC SAMPLER ===");
+    if (!hooked) {
+        Serial.println("Not running (beginPcSampler() / startPcSampling())");
+        Serial.println("==================\n");
+        return;
+    }
+    Serial.println("Window: " + PerformanceMonitor::formatTime(sampling ? millis() - windowStart : windowMs) + (sampling ? " (open)" : ""));
+    for (int c = 0; c < portNUM_PROCESSORS; ++c) {
+        Serial.println("Core " + String(c) + ": " + String((unsigned)written[c]) + " samples, ring " + String((unsigned)ringSize));
+    }
+    Serial.println("Rate: " + String((unsigned)sampleHz) + " Hz per core");
+    Serial.println("==================\n");
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <Arduino.h>
+
+// Statistical CPU profiler: a general-purpose timer interrupt on each core records the program
+// counter of the code it interrupted into a per-core ring while a profiling window is open. Dump
+// the samples after the window and turn them into a flat profile on the host:
+//
+//   startPcSampling();  ... download ...  stopPcSampling();  dumpPcSamples();
+//   tools/pc_symbolize.py serial.log --elf build/main.ino.elf
+//
+// The timers run independently of the RTOS tick, at a prime rate, so sampling does not lock step
+// with the engines' delay()/vTaskDelay() polling. Rings live in internal RAM. Time spent with the
+// flash cache off (SPIFFS writes) is only sampled in builds with CONFIG_GPTIMER_ISR_IRAM_SAFE;
+// otherwise the timer interrupt waits until the write finishes. When a ring fills, the oldest
+// samples are overwritten and counted as dropped.
+
+const size_t PC_SAMPLER_DEFAULT_SAMPLES = 4096;   // both cores together; 4 bytes each
+const uint32_t PC_SAMPLER_DEFAULT_HZ = 997;       // prime: no common period with 1 kHz ticks
+const int PC_SAMPLES_PER_LINE = 16;
+
+// Allocate the rings and start a sampling timer on every core; false without RAM or a free timer,
+// or when samples is too small to give every core a slot
+bool beginPcSampler(size_t samples = PC_SAMPLER_DEFAULT_SAMPLES, uint32_t hz = PC_SAMPLER_DEFAULT_HZ);
+void endPcSampler();
+
+// Clear the rings and start recording / stop recording (samples are kept until the next start)
+void startPcSampling();
+void stopPcSampling();
+bool pcSamplingActive();
+
+size_t pcSampleCount();
+// "PCPROF ..." header, "PCS <core> <pc> ..." lines and a trailer for tools/pc_symbolize.py
+void dumpPcSamples(Print& out = Serial);
+void printPcSamplerStats();
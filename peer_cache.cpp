@@ -0,0 +1,529 @@
+#include "peer_cache.h"
+#include "spiffs_management.h"
+#include <FS.h>
+#include <SPIFFS.h>
+#include <HTTPClient.h>
+#include <algorithm>
+#include "buffer_and_performance.h"
+
+namespace {
+
+const IPAddress PEER_MULTICAST_GROUP(239, 255, 77, 77);
+const char* PEER_INDEX_PATH = "/.peer_index";
+// Keep datagrams well under a typical MTU
+const size_t PEER_DATAGRAM_BUDGET = 1200;
+
+String keyToHex(const uint8_t* key) {
+    char hex[PEER_URL_KEY_SIZE * 2 + 1];
+    for (size_t i = 0; i < PEER_URL_KEY_SIZE; ++i) snprintf(hex + i * 2, 3, "%02x", key[i]);
+    return String(hex);
+}
+
+bool keyFromHex(const String& hex, uint8_t* out) {
+    if (hex.length() != PEER_URL_KEY_SIZE * 2) return false;
+    for (size_t i = 0; i < PEER_URL_KEY_SIZE; ++i) {
+        char pair[3] = { hex[i * 2], hex[i * 2 + 1], '\0' };
+        out[i] = (uint8_t)strtoul(pair, nullptr, 16);
+    }
+    return true;
+}
+
+// Splits "a b c" into at most maxParts tokens; returns count
+int splitWords(const String& line, String* parts, int maxParts) {
+    int count = 0;
+    int start = 0;
+    while (count < maxParts && start < (int)line.length()) {
+        int space = line.indexOf(' ', start);
+        if (space < 0) space = line.length();
+        if (space > start) parts[count++] = line.substring(start, space);
+        start = space + 1;
+    }
+    return count;
+}
+
+} // namespace
+
+PeerCache::PeerCache()
+: server(nullptr), httpPort(PEER_CACHE_HTTP_PORT), running(false), taskHandle(nullptr), lock(nullptr), stopped(nullptr),
+  lastAnnounceMs(0), advertCount(0) {
+}
+
+PeerCache::~PeerCache() {
+    end();
+}
+
+bool PeerCache::begin(uint16_t port) {
+    if (running) return true;
+    httpPort = port;
+
+    // kept across end()/begin() cycles; end() deletes them
+    if (!lock) lock = xSemaphoreCreateMutex();
+    if (!stopped) stopped = xSemaphoreCreateBinary();
+    if (!lock || !stopped) {
+        end();
+        return false;
+    }
+
+    loadIndex();
+
+    if (!udp.beginMulticast(PEER_MULTICAST_GROUP, PEER_CACHE_UDP_PORT)) {
+        Serial.println("Peer cache: failed to join multicast group");
+        end();
+        return false;
+    }
+    server = new WiFiServer(httpPort);
+    server->begin();
+    running = true;
+
+    // Low priority on core 1 so it never competes with the download task on core 0
+    // 8 KB: the datagram buffer and request Strings live on the stack, the serve buffer on the heap
+    if (xTaskCreatePinnedToCore(serviceTask, "PeerCache", 8192, this, 1, &taskHandle, 1) != pdPASS) {
+        Serial.println("Peer cache: failed to start service task");
+        taskHandle = nullptr;
+        end();
+        return false;
+    }
+
+    Serial.println("Peer cache serving " + String(local.size()) + " files on port " + String(httpPort));
+    return true;
+}
+
+void PeerCache::end() {
+    running = false;
+    if (taskHandle) {
+        // the task finishes its current poll (a served request can take PEER_IO_TIMEOUT_MS)
+        // and signals on the way out; only then is it safe to free what it uses
+        xSemaphoreTake(stopped, portMAX_DELAY);
+        taskHandle = nullptr;
+    }
+    if (server) {
+        server->end();
+        delete server;
+        server = nullptr;
+    }
+    udp.stop();
+    if (lock) {
+        vSemaphoreDelete(lock);
+        lock = nullptr;
+    }
+    if (stopped) {
+        vSemaphoreDelete(stopped);
+        stopped = nullptr;
+    }
+}
+
+void PeerCache::serviceTask(void* parameter) {
+    PeerCache* self = static_cast<PeerCache*>(parameter);
+    while (self->running) {
+        self->poll();
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    xSemaphoreGive(self->stopped);
+    vTaskDelete(nullptr);
+}
+
+void PeerCache::urlKey(const String& url, uint8_t* out) {
+    StreamingDigest d;
+    uint8_t full[CONTENT_DIGEST_SIZE];
+    d.begin();
+    d.update((const uint8_t*)url.c_str(), url.length());
+    d.finish(full);
+    memcpy(out, full, PEER_URL_KEY_SIZE);
+}
+
+void PeerCache::addLocalContent(const String& url, const String& path, const uint8_t* digest, size_t size) {
+    if (!lock) return;
+    PeerContentEntry e;
+    e.url = url;
+    e.path = path;
+    memcpy(e.digest, digest, CONTENT_DIGEST_SIZE);
+    e.size = size;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool replaced = false;
+    for (auto& existing : local) {
+        if (existing.path == path) {
+            existing = e;
+            replaced = true;
+            break;
+        }
+    }
+    if (!replaced) local.push_back(e);
+    saveIndex();
+    // tell the site right away rather than waiting for the next periodic announce
+    announce(PEER_MULTICAST_GROUP, PEER_CACHE_UDP_PORT, &e);
+    xSemaphoreGive(lock);
+}
+
+void PeerCache::removeLocalContent(const String& path) {
+    if (!lock) return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (size_t i = 0; i < local.size(); ++i) {
+        if (local[i].path == path) {
+            local.erase(local.begin() + i);
+            saveIndex();
+            break;
+        }
+    }
+    xSemaphoreGive(lock);
+}
+
+void PeerCache::recordVerifyFailure() {
+    portENTER_CRITICAL(&statsMux);
+    stats.verifyFailures++;
+    portEXIT_CRITICAL(&statsMux);
+}
+
+PeerCacheStats PeerCache::getStats() const {
+    portENTER_CRITICAL(&statsMux);
+    PeerCacheStats s = stats;
+    portEXIT_CRITICAL(&statsMux);
+    return s;
+}
+
+// ---- discovery ----
+
+void PeerCache::announce(const IPAddress& to, uint16_t port, const PeerContentEntry* only) {
+    if (!running || !WiFi.isConnected()) return;
+
+    String packet;
+    packet.reserve(PEER_DATAGRAM_BUDGET);
+    auto flush = [&]() {
+        if (packet.length() == 0) return;
+        udp.beginPacket(to, port);
+        udp.write((const uint8_t*)packet.c_str(), packet.length());
+        udp.endPacket();
+        packet = "";
+    };
+
+    auto addLine = [&](const PeerContentEntry& e) {
+        uint8_t key[PEER_URL_KEY_SIZE];
+        urlKey(e.url, key);
+        String line = "VPC1 HAVE " + String(httpPort) + " " + keyToHex(key) + " " +
+                      StreamingDigest::toHex(e.digest) + " " + String((unsigned long)e.size) + "\n";
+        if (packet.length() + line.length() > PEER_DATAGRAM_BUDGET) flush();
+        packet += line;
+    };
+
+    if (only) {
+        addLine(*only);
+    } else {
+        for (const auto& e : local) addLine(e);
+    }
+    flush();
+}
+
+void PeerCache::rememberAdvert(const IPAddress& ip, uint16_t port, const uint8_t* key, const uint8_t* digest, size_t size) {
+    unsigned long now = millis();
+    int slot = -1;
+    int oldest = 0;
+    for (int i = 0; i < advertCount; ++i) {
+        if (adverts[i].ip == ip && memcmp(adverts[i].urlKey, key, PEER_URL_KEY_SIZE) == 0) {
+            slot = i;
+            break;
+        }
+        if (adverts[i].lastSeenMs < adverts[oldest].lastSeenMs) oldest = i;
+    }
+    if (slot < 0) slot = advertCount < MAX_PEER_ADVERTS ? advertCount++ : oldest;
+
+    PeerAdvert& a = adverts[slot];
+    a.ip = ip;
+    a.port = port;
+    memcpy(a.urlKey, key, PEER_URL_KEY_SIZE);
+    memcpy(a.digest, digest, CONTENT_DIGEST_SIZE);
+    a.size = size;
+    a.lastSeenMs = now;
+}
+
+void PeerCache::handleDatagram() {
+    int len = udp.parsePacket();
+    if (len <= 0) return;
+
+    IPAddress from = udp.remoteIP();
+    uint16_t fromPort = udp.remotePort();
+    if (from == WiFi.localIP()) return; // our own multicast looped back
+
+    char buf[PEER_DATAGRAM_BUDGET + 1];
+    int n = udp.read(buf, min((size_t)len, sizeof(buf) - 1));
+    if (n <= 0) return;
+    buf[n] = '\0';
+
+    String body(buf);
+    int start = 0;
+    while (start < (int)body.length()) {
+        int end = body.indexOf('\n', start);
+        if (end < 0) end = body.length();
+        String line = body.substring(start, end);
+        start = end + 1;
+
+        String parts[6];
+        int count = splitWords(line, parts, 6);
+        if (count < 3 || parts[0] != "VPC1") continue;
+
+        uint8_t key[PEER_URL_KEY_SIZE];
+        if (parts[1] == "HAVE" && count == 6) {
+            uint8_t digest[CONTENT_DIGEST_SIZE];
+            if (!keyFromHex(parts[3], key) || !StreamingDigest::fromHex(parts[4], digest)) continue;
+            rememberAdvert(from, (uint16_t)parts[2].toInt(), key, digest, (size_t)parts[5].toInt());
+        } else if (parts[1] == "WHO" && keyFromHex(parts[2], key)) {
+            // answer unicast, only if we hold it
+            for (const auto& e : local) {
+                uint8_t mine[PEER_URL_KEY_SIZE];
+                urlKey(e.url, mine);
+                if (memcmp(mine, key, PEER_URL_KEY_SIZE) == 0) {
+                    announce(from, fromPort, &e);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void PeerCache::poll() {
+    if (!running || !lock) return;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    handleDatagram();
+    if (millis() - lastAnnounceMs >= PEER_ANNOUNCE_INTERVAL_MS) {
+        lastAnnounceMs = millis();
+        announce(PEER_MULTICAST_GROUP, PEER_CACHE_UDP_PORT, nullptr);
+    }
+    xSemaphoreGive(lock);
+
+    // serving happens outside the lock; a slow client must not block fetch()
+    WiFiClient client = server->available();
+    if (client) serveClient(client);
+}
+
+// ---- serving ----
+
+void PeerCache::serveClient(WiFiClient& client) {
+    client.setTimeout(PEER_IO_TIMEOUT_MS);
+    String requestLine = client.readStringUntil('\n');
+    size_t rangeStart = 0;
+    while (client.connected()) {
+        String header = client.readStringUntil('\n');
+        header.trim();
+        if (header.length() == 0) break;
+        if (header.startsWith("Range: bytes=")) rangeStart = (size_t)header.substring(13).toInt();
+    }
+
+    // GET /peer/<digest hex> HTTP/1.1
+    String parts[3];
+    int count = splitWords(requestLine, parts, 3);
+    uint8_t wanted[CONTENT_DIGEST_SIZE];
+    String path = "";
+    size_t size = 0;
+    if (count >= 2 && parts[0] == "GET" && parts[1].startsWith("/peer/") &&
+        StreamingDigest::fromHex(parts[1].substring(6), wanted)) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        for (const auto& e : local) {
+            if (memcmp(e.digest, wanted, CONTENT_DIGEST_SIZE) == 0) {
+                path = e.path;
+                size = e.size;
+                break;
+            }
+        }
+        xSemaphoreGive(lock);
+    }
+
+    File f;
+    String stored = resolveSPIFFSPath(path);
+    if (path.length() > 0) f = SPIFFS.open(stored, FILE_READ);
+    // 4 KB chunks: big enough for SPIFFS page batching; on the heap, the service task's stack is small
+    const size_t chunk = 4096;
+    uint8_t* buf = f ? (uint8_t*)malloc(chunk) : nullptr;
+    if (!f || !buf || f.size() != size || rangeStart >= size) {
+        client.print(buf || !f ? "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"
+                               : "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        free(buf);
+        if (f) f.close();
+        client.stop();
+        return;
+    }
+    downloadCacheTouch(path);
+
+    if (rangeStart > 0) {
+        client.printf("HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %u-%u/%u\r\n",
+                      (unsigned)rangeStart, (unsigned)(size - 1), (unsigned)size);
+    } else {
+        client.print("HTTP/1.1 200 OK\r\n");
+    }
+    client.printf("Content-Length: %u\r\nConnection: close\r\n\r\n", (unsigned)(size - rangeStart));
+
+    size_t sent = 0;
+    while (client.connected()) {
+        size_t n = readFromSPIFFS(f, stored, rangeStart + sent, buf, chunk);
+        if (n == 0) break;
+        if (client.write(buf, n) != n) break;
+        sent += n;
+    }
+    free(buf);
+    f.close();
+    client.stop();
+
+    portENTER_CRITICAL(&statsMux);
+    stats.requestsServed++;
+    stats.bytesServed += sent;
+    portEXIT_CRITICAL(&statsMux);
+}
+
+// ---- fetching ----
+
+PeerFetchResult PeerCache::fetch(const String& url, const String& path, const uint8_t* expectedDigest, StreamingDigest& digest) {
+    PeerFetchResult r;
+    if (!running || !WiFi.isConnected() || !expectedDigest) return r;
+
+    uint8_t key[PEER_URL_KEY_SIZE];
+    urlKey(url, key);
+
+    auto collect = [&](std::vector<PeerAdvert>& out) {
+        out.clear();
+        unsigned long now = millis();
+        xSemaphoreTake(lock, portMAX_DELAY);
+        for (int i = 0; i < advertCount; ++i) {
+            const PeerAdvert& a = adverts[i];
+            if (now - a.lastSeenMs > PEER_ADVERT_TTL_MS) continue;
+            if (memcmp(a.urlKey, key, PEER_URL_KEY_SIZE) != 0) continue;
+            if (expectedDigest && memcmp(a.digest, expectedDigest, CONTENT_DIGEST_SIZE) != 0) continue;
+            out.push_back(a);
+        }
+        xSemaphoreGive(lock);
+        // freshest first
+        std::sort(out.begin(), out.end(), [](const PeerAdvert& x, const PeerAdvert& y) { return x.lastSeenMs > y.lastSeenMs; });
+    };
+
+    std::vector<PeerAdvert> candidates;
+    collect(candidates);
+    if (candidates.empty()) {
+        // nobody has announced it recently: ask the site, the service task records the replies
+        String who = "VPC1 WHO " + keyToHex(key) + "\n";
+        xSemaphoreTake(lock, portMAX_DELAY);
+        udp.beginPacket(PEER_MULTICAST_GROUP, PEER_CACHE_UDP_PORT);
+        udp.write((const uint8_t*)who.c_str(), who.length());
+        udp.endPacket();
+        xSemaphoreGive(lock);
+        vTaskDelay(pdMS_TO_TICKS(PEER_QUERY_WAIT_MS));
+        collect(candidates);
+    }
+    if (candidates.empty()) return r;
+
+    r.attempted = true;
+    portENTER_CRITICAL(&statsMux);
+    stats.fetchAttempts++;
+    portEXIT_CRITICAL(&statsMux);
+
+    uint8_t buf[4096];
+    for (const auto& peer : candidates) {
+        String peerUrl = "http://" + peer.ip.toString() + ":" + String(peer.port) + "/peer/" + StreamingDigest::toHex(peer.digest);
+        HTTPClient http;
+        http.setTimeout(PEER_IO_TIMEOUT_MS);
+        http.begin(peerUrl);
+        int code = http.GET();
+        if (code != HTTP_CODE_OK) {
+            http.end();
+            continue;
+        }
+
+        hotCacheInvalidate(path);
+        File out = openSPIFFSForWrite(path);
+        if (!out) {
+            http.end();
+            return r;
+        }
+
+        WiFiClient* stream = http.getStreamPtr();
+        size_t written = 0;
+        unsigned long lastData = millis();
+        while (written < peer.size && millis() - lastData < PEER_IO_TIMEOUT_MS) {
+            int avail = stream->available();
+            if (avail <= 0) {
+                if (!http.connected()) break;
+                vTaskDelay(pdMS_TO_TICKS(2));
+                continue;
+            }
+            size_t n = stream->readBytes(buf, min((size_t)avail, min(sizeof(buf), peer.size - written)));
+            if (n == 0) break;
+            if (out.write(buf, n) != n) break;
+            digest.update(buf, n);
+            written += n;
+            lastData = millis();
+        }
+        out.close();
+        http.end();
+
+        r.bytesWritten = written;
+        r.peer = peer.ip.toString();
+        memcpy(r.expectedDigest, peer.digest, CONTENT_DIGEST_SIZE);
+        portENTER_CRITICAL(&statsMux);
+        stats.bytesFromPeers += written;
+        if (written == peer.size) stats.fetchHits++;
+        else if (written > 0) stats.midStreamFallbacks++;
+        portEXIT_CRITICAL(&statsMux);
+
+        if (written == peer.size) {
+            r.complete = true;
+            Serial.println("Fetched " + path + " from peer " + r.peer + " (" + String((unsigned long)written) + " bytes)");
+            return r;
+        }
+        if (written > 0) {
+            // partial content is still useful: the origin picks up from here
+            return r;
+        }
+    }
+    return r;
+}
+
+// ---- persistence ----
+
+bool PeerCache::loadIndex() {
+    local.clear();
+    File f = SPIFFS.open(PEER_INDEX_PATH, FILE_READ);
+    if (!f) return false;
+
+    // one line per entry: <digest hex> <size> <path> <url>
+    while (f.available()) {
+        String line = f.readStringUntil('\n');
+        line.trim();
+        String parts[4];
+        if (splitWords(line, parts, 3) < 3) continue;
+        int urlStart = line.indexOf(' ', line.indexOf(' ', line.indexOf(' ') + 1) + 1);
+        if (urlStart < 0) continue;
+
+        PeerContentEntry e;
+        if (!StreamingDigest::fromHex(parts[0], e.digest)) continue;
+        e.size = (size_t)parts[1].toInt();
+        e.path = parts[2];
+        e.url = line.substring(urlStart + 1);
+
+        // skip entries whose file vanished or changed size behind our back
+        File check = SPIFFS.open(resolveSPIFFSPath(e.path), FILE_READ);
+        bool valid = check && check.size() == e.size;
+        if (check) check.close();
+        if (valid) local.push_back(e);
+    }
+    f.close();
+    return true;
+}
+
+bool PeerCache::saveIndex() {
+    File f = SPIFFS.open(PEER_INDEX_PATH, FILE_WRITE);
+    if (!f) return false;
+    for (const auto& e : local) {
+        f.print(StreamingDigest::toHex(e.digest) + " " + String((unsigned long)e.size) + " " + e.path + " " + e.url + "\n");
+    }
+    f.close();
+    return true;
+}
+
+void PeerCache::printStats() const {
+    PeerCacheStats st = getStats();
+    Serial.println("=== PEER CACHE ===");
+    Serial.println("Local files advertised: " + String((unsigned)local.size()));
+    Serial.println("Fetch attempts: " + String((unsigned)st.fetchAttempts) + ", full hits: " + String((unsigned)st.fetchHits) +
+                   ", mid-stream fallbacks: " + String((unsigned)st.midStreamFallbacks));
+    Serial.println("Verify failures: " + String((unsigned)st.verifyFailures));
+    Serial.println("Bytes from peers: " + PerformanceMonitor::formatBytes(st.bytesFromPeers));
+    Serial.println("Served: " + String((unsigned)st.requestsServed) + " requests, " + PerformanceMonitor::formatBytes(st.bytesServed));
+    Serial.println("==================");
+}
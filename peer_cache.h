@@ -0,0 +1,111 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <vector>
+#include "digest_and_crypto.h"
+
+// LAN peer cache: devices announce what they hold (URL key + SHA-256) over UDP multicast and serve it
+// over a tiny HTTP endpoint, so a site downloads each file over the WAN roughly once.
+
+const uint16_t PEER_CACHE_UDP_PORT = 47277;
+const uint16_t PEER_CACHE_HTTP_PORT = 47278;
+const unsigned long PEER_ANNOUNCE_INTERVAL_MS = 30000;
+const unsigned long PEER_ADVERT_TTL_MS = 120000;   // forget peers we have not heard from in this long
+const unsigned long PEER_QUERY_WAIT_MS = 300;      // how long fetch() waits for answers to a WHO query
+const unsigned long PEER_IO_TIMEOUT_MS = 3000;
+const int MAX_PEER_ADVERTS = 32;
+const size_t PEER_URL_KEY_SIZE = 8;               // truncated SHA-256 of the URL; keeps datagrams small
+
+// Something we downloaded and are willing to serve
+struct PeerContentEntry {
+String url;
+String path;
+uint8_t digest[CONTENT_DIGEST_SIZE];
+size_t size;
+};
+
+// Something another device says it has
+struct PeerAdvert {
+IPAddress ip;
+uint16_t port;
+uint8_t urlKey[PEER_URL_KEY_SIZE];
+uint8_t digest[CONTENT_DIGEST_SIZE];
+size_t size;
+unsigned long lastSeenMs;
+};
+
+// Outcome of trying peers for one file. bytesWritten > 0 with complete == false means a peer
+// dropped mid-stream and the caller should continue from the origin at that offset.
+struct PeerFetchResult {
+bool attempted;
+bool complete;
+size_t bytesWritten;
+uint8_t expectedDigest[CONTENT_DIGEST_SIZE]; // what the peer advertised; verify against this
+String peer;
+PeerFetchResult() : attempted(false), complete(false), bytesWritten(0), peer("") { memset(expectedDigest, 0, sizeof(expectedDigest)); }
+};
+
+struct PeerCacheStats {
+size_t fetchAttempts;
+size_t fetchHits;          // whole file came from a peer
+size_t midStreamFallbacks; // peer died, origin finished the file
+size_t verifyFailures;
+size_t bytesFromPeers;
+size_t bytesServed;
+size_t requestsServed;
+PeerCacheStats() : fetchAttempts(0), fetchHits(0), midStreamFallbacks(0), verifyFailures(0), bytesFromPeers(0), bytesServed(0), requestsServed(0) {}
+};
+
+class PeerCache {
+public:
+PeerCache();
+~PeerCache();
+
+// Load the local index, join the multicast group and start the background announce/serve task
+bool begin(uint16_t httpPort = PEER_CACHE_HTTP_PORT);
+void end();
+
+// Register a verified local file (HttpDownloader does this after a hashed download)
+void addLocalContent(const String& url, const String& path, const uint8_t* digest, size_t size);
+// Stop advertising path; the storage helpers call this (setPeerCache) on delete, evict and rewrite
+void removeLocalContent(const String& path);
+
+// Try to fetch url from a peer into path, hashing into digest as bytes arrive.
+// expectedDigest (from a manifest) restricts us to peers advertising that exact content; without
+// one nothing is fetched, since a stale or hostile peer would otherwise vouch for its own bytes.
+PeerFetchResult fetch(const String& url, const String& path, const uint8_t* expectedDigest, StreamingDigest& digest);
+void recordVerifyFailure();
+
+// One service iteration: UDP in, periodic announce, at most one served request
+void poll();
+
+PeerCacheStats getStats() const;
+void printStats() const;
+
+private:
+WiFiUDP udp;
+WiFiServer* server;
+uint16_t httpPort;
+bool running;
+TaskHandle_t taskHandle;
+SemaphoreHandle_t lock;
+SemaphoreHandle_t stopped;   // given by the service task as it exits
+unsigned long lastAnnounceMs;
+
+std::vector<PeerContentEntry> local;
+PeerAdvert adverts[MAX_PEER_ADVERTS];
+int advertCount;
+PeerCacheStats stats;
+mutable portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;   // stats are bumped by the service task and by fetching tasks
+
+static void serviceTask(void* parameter);
+static void urlKey(const String& url, uint8_t* out);
+
+void handleDatagram();
+void announce(const IPAddress& to, uint16_t port, const PeerContentEntry* only);
+void rememberAdvert(const IPAddress& ip, uint16_t port, const uint8_t* key, const uint8_t* digest, size_t size);
+void serveClient(WiFiClient& client);
+bool loadIndex();
+bool saveIndex();
+};
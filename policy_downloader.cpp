@@ -0,0 +1,99 @@
+#include "policy_downloader.h"
+#include "arrival_trace.h"
+#include "hot_path_timer.h"
+
+namespace {
+
+const char* BENCH_PATH = "/policy_bench.bin";
+
+// Compile-time engine into NullSink: nothing touches flash, so the whole download is read plus
+// dispatch. Cycles per read the replay actually served; 0 if the download failed.
+template <class Engine>
+float policyCyclesPerRead(Engine& engine, ReplayStream* source) {
+    engine.transport.source = source;
+    uint32_t start = ESP.getCycleCount();
+    DownloadResult r = engine.download("replay://bench", "");
+    uint32_t cycles = ESP.getCycleCount() - start;
+    if (!r.success || source->readCount() == 0) return 0.0f;
+    return (float)cycles / source->readCount();
+}
+
+// Production engine: it writes to SPIFFS, so only its per-chunk timer sites count, less the flash
+// writes inside them. Cycles per chunk; 0 if the download failed or timers are compiled out.
+float engineCyclesPerRead(DownloaderBase& engine, const char* chunkSite, const char* writeSite) {
+    resetHotTimers();
+    DownloadResult r = engine.download("replay://bench", BENCH_PATH);
+    SPIFFS.remove(BENCH_PATH);
+    uint64_t chunkCycles, writeCycles;
+    uint32_t chunks, writes;
+    if (!hotTimerTotals(chunkSite, chunkCycles, chunks)) return 0.0f;
+    hotTimerTotals(writeSite, writeCycles, writes);
+    if (!r.success || chunks == 0) {
+        Serial.println(engine.getName() + " failed: " + r.errorMessage);
+        return 0.0f;
+    }
+    return (float)(chunkCycles - min(writeCycles, chunkCycles)) / chunks;
+}
+
+}
+
+void benchmarkPolicyChunkOverhead(size_t totalBytes, size_t segment) {
+    // synthetic arrival pattern of segment-sized reads, replayed instantly so every engine reads
+    // the same bytes without waiting on a network
+    ArrivalTrace trace;
+    if (!trace.begin()) {
+        Serial.println("Chunk overhead benchmark: no memory for the trace");
+        return;
+    }
+    for (size_t left = totalBytes; left > 0 && !trace.isTruncated(); left -= min(left, segment)) trace.record(min(left, segment));
+    if (trace.isTruncated()) Serial.println("Trace truncated at " + String(trace.totalBytes()) + " bytes");
+    ReplayStream source(&trace);
+    source.setSpeed(0.0f);
+
+    // the reads alone, with no engine: what every variant pays to produce the bytes
+    uint8_t* buf = (uint8_t*)malloc(DEFAULT_DOWNLOAD_BUFFER_SIZE);
+    if (!buf) return;
+    source.rewind();
+    uint32_t start = ESP.getCycleCount();
+    while (source.connected()) source.read(buf, DEFAULT_DOWNLOAD_BUFFER_SIZE);
+    uint32_t cycles = ESP.getCycleCount() - start;
+    float baseline = source.readCount() > 0 ? (float)cycles / source.readCount() : 0.0f;
+    free(buf);
+
+    PerformanceMonitor monitor;
+
+    // the production engines, with their run-time choices and checks
+    HttpDownloader http;
+    http.setPerformanceMonitor(&monitor);
+    http.setReplaySource(&source);
+    DualCoreDownloader dualCore;
+    dualCore.setPerformanceMonitor(&monitor);
+    dualCore.setReplaySource(&source);
+    float httpCycles = engineCyclesPerRead(http, "engine.http.chunk", "engine.http.write");
+    float dualCoreCycles = engineCyclesPerRead(dualCore, "engine.dual.chunk", "");
+
+    PolicyDownloader<ReplayTransport, NullSink, PerfMonitorPolicy, DefaultTierBuffer> staticMonitored;
+    staticMonitored.monitor.attach(&monitor);
+    PolicyDownloader<ReplayTransport, NullSink, NullMonitor, DefaultTierBuffer> staticBare;
+    PolicyDownloader<ReplayTransport, HashingSink<NullSink>, NullMonitor, DefaultTierBuffer> staticHashed;
+    float monitoredCycles = policyCyclesPerRead(staticMonitored, &source);
+    float bareCycles = policyCyclesPerRead(staticBare, &source);
+    float hashedCycles = policyCyclesPerRead(staticHashed, &source);
+
+    auto row = [&](const char* name, float c) {
+        if (c > 0.0f) Serial.printf("%-34s %12.0f %12.0f\n", name, c, c - baseline);
+        else Serial.printf("%-34s %12s %12s\n", name, "-", "-");
+    };
+    Serial.println("=== PER-CHUNK ENGINE OVERHEAD (" + String((unsigned)trace.totalBytes()) + " B replayed, flash excluded) ===");
+    Serial.printf("%-34s %12s %12s\n", "Engine", "cycles/read", "overhead");
+    Serial.printf("%-34s %12.0f %12s\n", "replay read only (baseline)", baseline, "-");
+    row("HttpDownloader", httpCycles);
+    row("DualCoreDownloader", dualCoreCycles);
+    row("static + PerformanceMonitor", monitoredCycles);
+    row("static, NullMonitor", bareCycles);
+    row("static, NullMonitor + SHA-256", hashedCycles);
+    if (httpCycles == 0.0f && dualCoreCycles == 0.0f) {
+        Serial.println("(HttpDownloader/DualCoreDownloader rows need a build with -DHOT_PATH_TIMERS=1)");
+    }
+    Serial.println("=================================================");
+}
@@ -0,0 +1,264 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include <SPIFFS.h>
+#include <HTTPClient.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "buffer_and_performance.h"
+#include "digest_and_crypto.h"
+#include "download_engines.h"
+#include "lean_http.h"
+#include "spiffs_management.h"
+
+// Compile-time composed download engine: PolicyDownloader<Transport, Sink, Monitor, Buffer>.
+// Each policy is a plain struct, so a disabled feature (NullMonitor, a sink without hashing)
+// is an empty inline call and the buffer size is a constant - the hot loop has no virtual
+// calls and no per-chunk null checks. ErasedDownloader puts one behind DownloaderBase.
+
+// ---- Buffer policies ----
+
+// Buffer size fixed at build time; the tier constants are the only sizes we expect
+template <size_t N>
+struct FixedBuffer {
+    static_assert(N >= 512 && N <= XLARGE_DOWNLOAD_BUFFER_SIZE, "buffer size outside the download buffer tiers");
+    static constexpr size_t capacity = N;
+    uint8_t* data;
+
+    FixedBuffer() : data((uint8_t*)malloc(N)) {}
+    ~FixedBuffer() { free(data); }
+    FixedBuffer(const FixedBuffer&) = delete;
+    FixedBuffer& operator=(const FixedBuffer&) = delete;
+
+    bool ok() const { return data != nullptr; }
+    uint8_t* get() const { return data; }
+    static constexpr size_t size() { return N; }
+};
+
+typedef FixedBuffer<SMALL_DOWNLOAD_BUFFER_SIZE> SmallTierBuffer;
+typedef FixedBuffer<DEFAULT_DOWNLOAD_BUFFER_SIZE> DefaultTierBuffer;
+typedef FixedBuffer<LARGE_DOWNLOAD_BUFFER_SIZE> LargeTierBuffer;
+
+// ---- Monitor policies ----
+
+struct NullMonitor {
+    void begin() {}
+    void chunk(size_t) {}
+    void end(DownloadResult&, size_t) {}
+};
+
+// Always-present PerformanceMonitor: its own until attach() points it elsewhere, so there is
+// never a per-chunk null check and never a null one
+struct PerfMonitorPolicy {
+    PerformanceMonitor own;
+    PerformanceMonitor* m = &own;
+    void attach(PerformanceMonitor* monitor) { m = monitor ? monitor : &own; }
+    void begin() {
+        m->startMonitoring();
+        m->startConnectionTimer();
+    }
+    void chunk(size_t total) { m->updateProgress(total); }
+    void end(DownloadResult& r, size_t bytes) {
+        m->stopEnhancedMonitoring();
+        m->stopMonitoring();
+        m->applyToResult(r, bytes);
+    }
+};
+
+// ---- Transport policies ----
+
+// read() returns bytes read, 0 when nothing arrived yet, -1 when the stream is over.
+// bodyDone() says whether it ended where the server meant it to; only asked when the size was unknown.
+struct HttpTransport {
+    HTTPClient http;
+    WiFiClient* stream = nullptr;
+
+    bool open(const String& url, long& size, int& status) {
+        http.begin(url);
+        status = http.GET();
+        if (status != HTTP_CODE_OK) {
+            http.end();
+            return false;
+        }
+        size = http.getSize();
+        stream = http.getStreamPtr();
+        return true;
+    }
+    int read(uint8_t* buf, size_t len) {
+        size_t available = stream->available();
+        if (available == 0) return http.connected() ? 0 : -1;
+        return stream->readBytes(buf, min(len, available));
+    }
+    // without a length the body is delimited by the server closing
+    bool bodyDone() const { return true; }
+    void close() { http.end(); }
+};
+
+// LeanHttpClient: fixed header buffer, no per-request allocation, connection kept for the next download
+struct LeanHttpTransport {
+    LeanHttpClient client;
+    LeanHttpResponse resp;
+
+    bool open(const String& url, long& size, int& status) {
+        bool ok = client.get(url.c_str(), resp);
+        status = resp.status;
+        if (!ok || status != HTTP_CODE_OK) return false;
+        size = resp.contentLength;
+        return true;
+    }
+    int read(uint8_t* buf, size_t len) { return client.read(buf, len); }
+    // chunked bodies have no length: only the terminating chunk makes them complete
+    bool bodyDone() const { return client.bodyDone(); }
+    void close() {
+        // an unread body would desync the kept-alive connection
+        if (!client.bodyDone()) client.close();
+    }
+};
+
+// Recorded arrival pattern (arrival_trace.h) instead of the network, for identical inputs across builds
+struct ReplayTransport {
+    ReplayStream* source = nullptr;
+
+    bool open(const String&, long& size, int& status) {
+        source->rewind();
+        size = source->totalBytes();
+        status = HTTP_CODE_OK;
+        return true;
+    }
+    int read(uint8_t* buf, size_t len) {
+        if (!source->connected()) return -1;
+        return source->read(buf, len);
+    }
+    bool bodyDone() const { return !source->connected(); }
+    void close() {}
+};
+
+// ---- Sink policies ----
+
+struct SpiffsSink {
+    File f;
+    bool open(const String& path) {
+        f = openSPIFFSForWrite(path);
+        return (bool)f;
+    }
+    bool write(const uint8_t* data, size_t len) { return f.write(data, len) == len; }
+    void close() { f.close(); }
+    void finish(DownloadResult&) {}
+};
+
+struct NullSink {
+    bool open(const String&) { return true; }
+    bool write(const uint8_t*, size_t) { return true; }
+    void close() {}
+    void finish(DownloadResult&) {}
+};
+
+// SHA-256 in front of another sink; the hex digest lands in DownloadResult::contentDigest
+template <class Inner>
+struct HashingSink : Inner {
+    StreamingDigest digest;
+    bool open(const String& path) {
+        digest.begin();
+        return Inner::open(path);
+    }
+    bool write(const uint8_t* data, size_t len) {
+        digest.update(data, len);
+        return Inner::write(data, len);
+    }
+    void finish(DownloadResult& r) {
+        uint8_t out[CONTENT_DIGEST_SIZE];
+        digest.finish(out);
+        r.contentDigest = StreamingDigest::toHex(out);
+        Inner::finish(r);
+    }
+};
+
+// ---- Engine ----
+
+template <class Transport, class Sink, class Monitor, class Buffer>
+class PolicyDownloader {
+public:
+    Transport transport;
+    Sink sink;
+    Monitor monitor;
+    Buffer buffer;
+
+    DownloadResult download(const String& url, const String& targetPath) {
+        DownloadResult r;
+        if (!buffer.ok()) {
+            r.errorMessage = "Failed to allocate buffer";
+            return r;
+        }
+
+        long size = -1;
+        if (!transport.open(url, size, r.httpStatusCode)) {
+            r.errorMessage = "HTTP error: " + String(r.httpStatusCode);
+            return r;
+        }
+        if (!sink.open(targetPath)) {
+            transport.close();
+            r.errorMessage = "Cannot open " + targetPath;
+            return r;
+        }
+
+        monitor.begin();
+        uint8_t* buf = buffer.get();
+        size_t done = 0;
+        bool ok = true;
+        while (size < 0 || done < (size_t)size) {
+            size_t want = buffer.size();
+            if (size >= 0 && (size_t)size - done < want) want = size - done;
+            int n = transport.read(buf, want);
+            if (n < 0) break;
+            if (n == 0) {
+                vTaskDelay(1);
+                continue;
+            }
+            if (!sink.write(buf, n)) {
+                r.errorMessage = "Write failed";
+                ok = false;
+                break;
+            }
+            done += n;
+            monitor.chunk(done);
+        }
+
+        bool complete = size >= 0 ? done == (size_t)size : transport.bodyDone();
+        sink.close();
+        transport.close();
+        monitor.end(r, done);
+        r.fileSize = size > 0 ? size : done;
+        r.totalBytes = done;
+        r.success = ok && complete;
+        if (r.success) sink.finish(r);
+        else if (ok) r.errorMessage = "Connection closed early";
+        return r;
+    }
+};
+
+// Type-erased handle so a policy engine can go wherever a DownloaderBase* is expected.
+// The virtual call happens once per download, not per chunk.
+template <class Engine>
+class ErasedDownloader : public DownloaderBase {
+public:
+    explicit ErasedDownloader(const String& engineName) : name(engineName) {}
+    DownloadResult download(const String& url, const String& targetPath) override { return engine.download(url, targetPath); }
+    String getName() const override { return name; }
+    Engine& get() { return engine; }
+
+private:
+    Engine engine;
+    String name;
+};
+
+// The common production shape: HTTP into SPIFFS, PerformanceMonitor, default tier buffer
+typedef PolicyDownloader<HttpTransport, SpiffsSink, PerfMonitorPolicy, DefaultTierBuffer> StaticHttpDownloader;
+// Same without monitoring or anything optional: the leanest loop
+typedef PolicyDownloader<HttpTransport, SpiffsSink, NullMonitor, DefaultTierBuffer> BareHttpDownloader;
+// HTTP without HTTPClient: for many small files over one kept-alive connection
+typedef PolicyDownloader<LeanHttpTransport, SpiffsSink, PerfMonitorPolicy, SmallTierBuffer> LeanHttpDownloader;
+
+// Per-read engine cycles, flash excluded, all replaying the same synthetic trace of segment-sized
+// reads at full speed: compile-time engines into NullSink, and HttpDownloader/DualCoreDownloader
+// from their per-chunk hot-path timer sites less flash writes (needs -DHOT_PATH_TIMERS=1)
+void benchmarkPolicyChunkOverhead(size_t totalBytes = 1024 * 1024, size_t segment = 1460);
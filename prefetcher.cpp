@@ -0,0 +1,318 @@
+#include "prefetcher.h"
+#include <WiFi.h>
+#include <FS.h>
+#include <SPIFFS.h>
+#include "network_and_http.h"
+#include "spiffs_management.h"
+#include "download_cache.h"
+
+namespace {
+const char* stateName(PrefetchState s) {
+    switch (s) {
+    case PREFETCH_WAITING: return "waiting";
+    case PREFETCH_ARMED: return "armed";
+    case PREFETCH_PARTIAL: return "partial";
+    default: return "ready";
+    }
+}
+
+// signed distance so millis() wrap-around does not matter
+long msUntil(unsigned long t) {
+    return (long)(t - millis());
+}
+}
+
+Prefetcher::Prefetcher(HttpDownloader* engine)
+: engine(engine), downloadCache(nullptr), rateLimitKBps(PREFETCH_DEFAULT_RATE_KBPS), minRssi(PREFETCH_MIN_RSSI),
+  idleThresholdMs(PREFETCH_IDLE_MS), lastActivity(0), prefetching(false), runStart(0), runStartOffset(0), demandKBps(0.0f) {
+}
+
+int Prefetcher::find(const String& url) const {
+    for (size_t i = 0; i < hints.size(); ++i) {
+        if (hints[i].url == url) return (int)i;
+    }
+    return -1;
+}
+
+bool Prefetcher::hintAt(const String& url, const String& targetPath, unsigned long dueInMs, unsigned long periodMs) {
+    int i = find(url);
+    if (i < 0) {
+        if ((int)hints.size() >= MAX_PREFETCH_HINTS) return false;
+        hints.push_back(PrefetchHint());
+        i = hints.size() - 1;
+        stats.hints++;
+    }
+    PrefetchHint& h = hints[i];
+    h.url = url;
+    h.targetPath = targetPath;
+    h.trigger = "";
+    h.dueAt = millis() + dueInMs;
+    h.periodMs = periodMs;
+    h.state = dueInMs <= PREFETCH_LEAD_MS ? PREFETCH_ARMED : PREFETCH_WAITING;
+    h.bytesOnFlash = 0;
+    h.totalSize = 0;
+    h.fetchMs = 0;
+    return true;
+}
+
+bool Prefetcher::hintOnTrigger(const String& trigger, const String& url, const String& targetPath) {
+    if (!hintAt(url, targetPath, 0)) return false;
+    PrefetchHint& h = hints[find(url)];
+    h.trigger = trigger;
+    h.state = PREFETCH_WAITING;
+    return true;
+}
+
+int Prefetcher::fire(const String& trigger) {
+    int armed = 0;
+    for (auto& h : hints) {
+        if (h.trigger != trigger || h.state != PREFETCH_WAITING) continue;
+        h.state = PREFETCH_ARMED;
+        h.dueAt = millis();
+        armed++;
+    }
+    return armed;
+}
+
+void Prefetcher::removeHint(const String& url) {
+    int i = find(url);
+    if (i >= 0) hints.erase(hints.begin() + i);
+}
+
+void Prefetcher::noteActivity() {
+    lastActivity = millis();
+    // checked and acted on together, so a pause never outlives the prefetch it was meant for
+    portENTER_CRITICAL(&pauseMux);
+    if (prefetching && engine) {
+        engine->requestPause();
+        stats.backoffs++;
+    }
+    portEXIT_CRITICAL(&pauseMux);
+}
+
+bool Prefetcher::linkIsGood() const {
+    return WiFi.status() == WL_CONNECTED && WiFi.RSSI() >= minRssi;
+}
+
+void Prefetcher::rearm(PrefetchHint& hint) {
+    hint.bytesOnFlash = 0;
+    hint.fetchMs = 0;
+    if (hint.trigger.length() > 0) {
+        hint.state = PREFETCH_WAITING;
+        return;
+    }
+    // next cycle of a recurring hint (skipping any we slept through)
+    while (msUntil(hint.dueAt) <= 0) hint.dueAt += hint.periodMs;
+    hint.state = PREFETCH_WAITING;
+}
+
+void Prefetcher::expire() {
+    for (size_t i = 0; i < hints.size();) {
+        PrefetchHint& h = hints[i];
+        // timed hints arm once they are within the lead time
+        if (h.state == PREFETCH_WAITING && h.trigger.length() == 0 && msUntil(h.dueAt) <= (long)PREFETCH_LEAD_MS) {
+            h.state = PREFETCH_ARMED;
+        }
+        if (msUntil(h.dueAt + PREFETCH_TTL_MS) > 0 || h.state == PREFETCH_WAITING) {
+            ++i;
+            continue;
+        }
+
+        // the demand we predicted did not come; the file stays, evictable like any cached download
+        if (h.state == PREFETCH_READY || h.state == PREFETCH_PARTIAL) {
+            stats.wasted++;
+            stats.bytesWasted += h.bytesOnFlash;
+        }
+        if (h.periodMs > 0) {
+            rearm(h);
+            ++i;
+        } else {
+            hints.erase(hints.begin() + i);
+        }
+    }
+}
+
+void Prefetcher::pace(size_t bytesOnFlash) {
+    if (!linkIsGood()) {
+        noteActivity();   // weak link: stop and try again later rather than crawl
+        return;
+    }
+    if (rateLimitKBps <= 0.0f) return;
+    unsigned long budgetMs = (unsigned long)(((bytesOnFlash - runStartOffset) / 1024.0f) * 1000.0f / rateLimitKBps);
+    unsigned long elapsed = millis() - runStart;
+    if (budgetMs > elapsed) delay(budgetMs - elapsed);
+}
+
+void Prefetcher::noteDemandThroughput(size_t bytes, unsigned long ms) {
+    if (bytes == 0 || ms == 0) return;
+    float kbps = PerformanceMonitor::calculateSpeedKBps(bytes, ms);
+    demandKBps = demandKBps > 0.0f ? demandKBps * 0.7f + kbps * 0.3f : kbps;
+}
+
+// What fetching bytes on demand would have cost; the prefetch's own time is throttled, so not that
+unsigned long Prefetcher::demandMsFor(size_t bytes) const {
+    return demandKBps > 0.0f ? (unsigned long)((bytes / 1024.0f) * 1000.0f / demandKBps) : 0;
+}
+
+// A paused prefetch can only be continued if the file is still exactly the prefix we wrote
+bool Prefetcher::partialIntact(const PrefetchHint& hint) {
+    File f = SPIFFS.open(hint.targetPath, FILE_READ);
+    size_t size = f ? f.size() : 0;
+    if (f) f.close();
+    return size == hint.bytesOnFlash;
+}
+
+bool Prefetcher::prefetch(PrefetchHint& hint) {
+    if (hint.bytesOnFlash > 0 && !partialIntact(hint)) {
+        Serial.println("Prefetch prefix changed on flash, restarting: " + hint.url);
+        hint.bytesOnFlash = 0;
+        hint.fetchMs = 0;
+    }
+    if (hint.totalSize == 0) {
+        HttpResponse head = httpHead(hint.url);
+        if (!head.ok) return false;
+        hint.totalSize = head.contentLength;
+    }
+    // speculative bytes must fit in free space; they never evict cached files
+    if (hint.totalSize > hint.bytesOnFlash && !checkSPIFFSSpace(hint.totalSize - hint.bytesOnFlash)) {
+        Serial.println("Prefetch skipped (no free space): " + hint.url);
+        return false;
+    }
+
+    Serial.println("Prefetching " + hint.url + (hint.bytesOnFlash > 0 ? " from " + String((unsigned)hint.bytesOnFlash) : String("")));
+    runStart = millis();
+    runStartOffset = hint.bytesOnFlash;
+    engine->setProgressCallback([this](size_t bytesOnFlash) { pace(bytesOnFlash); }, PREFETCH_PACE_BYTES);
+    portENTER_CRITICAL(&pauseMux);
+    prefetching = true;
+    portEXIT_CRITICAL(&pauseMux);
+
+    DownloadResult r = engine->downloadFrom(hint.url, hint.targetPath, hint.bytesOnFlash);
+
+    portENTER_CRITICAL(&pauseMux);
+    prefetching = false;
+    engine->clearPause();
+    portEXIT_CRITICAL(&pauseMux);
+    engine->setProgressCallback(nullptr);
+    hint.fetchMs += millis() - runStart;
+
+    if (r.success) {
+        hint.bytesOnFlash = r.totalBytes;
+        hint.totalSize = r.totalBytes;
+        hint.state = PREFETCH_READY;
+        stats.prefetched++;
+        stats.bytesPrefetched += r.totalBytes - runStartOffset;
+        unsigned long refetchMs = demandMsFor(r.totalBytes);
+        if (downloadCache) downloadCache->registerDownload(hint.url, hint.targetPath, r.totalBytes, refetchMs > 0 ? refetchMs : hint.fetchMs);
+        return true;
+    }
+    if (r.paused) {
+        stats.bytesPrefetched += r.totalBytes - runStartOffset;
+        hint.bytesOnFlash = r.totalBytes;
+        hint.state = PREFETCH_PARTIAL;
+        return true;
+    }
+    Serial.println("Prefetch failed: " + r.errorMessage);
+    return false;
+}
+
+bool Prefetcher::poll() {
+    if (!engine) return false;
+    expire();
+    if (millis() - lastActivity < idleThresholdMs || !linkIsGood()) return false;
+
+    // soonest-due first: that is the demand most likely to arrive before we are done
+    int pick = -1;
+    for (size_t i = 0; i < hints.size(); ++i) {
+        const PrefetchHint& h = hints[i];
+        if (h.state != PREFETCH_ARMED && h.state != PREFETCH_PARTIAL) continue;
+        if (pick < 0 || msUntil(h.dueAt) < msUntil(hints[pick].dueAt)) pick = i;
+    }
+    if (pick < 0) return false;
+    return prefetch(hints[pick]);
+}
+
+DownloadResult Prefetcher::fetch(const String& url, const String& targetPath) {
+    noteActivity();
+    unsigned long start = millis();
+    int i = find(url);
+    PrefetchHint* h = i >= 0 && hints[i].targetPath == targetPath ? &hints[i] : nullptr;
+
+    if (h && h->state == PREFETCH_READY && SPIFFS.exists(targetPath)) {
+        DownloadResult r;
+        r.success = true;
+        r.prefetchHit = true;
+        r.fileSize = h->totalSize;
+        r.totalBytes = h->totalSize;
+        r.httpStatusCode = 200;
+        r.downloadTimeMs = millis() - start;
+        if (downloadCache) downloadCache->lookup(targetPath);
+        stats.hits++;
+        unsigned long saved = demandMsFor(h->totalSize);
+        stats.latencySavedMs += saved;
+        Serial.println("Prefetch hit: " + url + (saved > 0 ? " (saved ~" + PerformanceMonitor::formatTime(saved) + ")" : String("")));
+        if (h->periodMs > 0 || h->trigger.length() > 0) {
+            rearm(*h);
+        } else {
+            hints.erase(hints.begin() + i);
+        }
+        return r;
+    }
+
+    // finish a paused prefetch at full speed; the prefix already on flash is the saving
+    size_t offset = h && h->state == PREFETCH_PARTIAL ? h->bytesOnFlash : 0;
+    if (offset > 0 && !partialIntact(*h)) {
+        Serial.println("Prefetch prefix changed on flash, downloading whole file: " + url);
+        offset = 0;
+    }
+    unsigned long demandStart = millis();
+    DownloadResult r = engine->downloadFrom(url, targetPath, offset);
+    if (r.success) noteDemandThroughput(r.totalBytes - min(offset, r.totalBytes), millis() - demandStart);
+    if (offset > 0 && r.success) {
+        r.prefetchHit = true;
+        stats.partialHits++;
+        stats.latencySavedMs += demandMsFor(offset);
+    } else {
+        stats.misses++;
+    }
+    if (h) {
+        if (h->periodMs > 0 || h->trigger.length() > 0) {
+            rearm(*h);
+        } else {
+            hints.erase(hints.begin() + i);
+        }
+    }
+    return r;
+}
+
+float Prefetcher::getAccuracy() const {
+    size_t resolved = stats.hits + stats.partialHits + stats.wasted;
+    return resolved > 0 ? (float)(stats.hits + stats.partialHits) / resolved : 0.0f;
+}
+
+float Prefetcher::getCoverage() const {
+    size_t demands = stats.hits + stats.partialHits + stats.misses;
+    return demands > 0 ? (float)(stats.hits + stats.partialHits) / demands : 0.0f;
+}
+
+void Prefetcher::printHints() const {
+    for (const auto& h : hints) {
+        Serial.printf("  %-8s due %+lds %s -> %s (%u/%u bytes)\n", stateName(h.state), msUntil(h.dueAt) / 1000,
+                      h.url.c_str(), h.targetPath.c_str(), (unsigned)h.bytesOnFlash, (unsigned)h.totalSize);
+    }
+}
+
+void Prefetcher::printStats() const {
+    Serial.println("\n=== PREFETCHER ===");
+    Serial.println("Hints: " + String((unsigned)hints.size()) + " active, " + String((unsigned)stats.hints) + " total");
+    printHints();
+    Serial.println("Prefetched: " + String((unsigned)stats.prefetched) + " files, " + PerformanceMonitor::formatBytes(stats.bytesPrefetched));
+    Serial.println("Demand: " + String((unsigned)stats.hits) + " hits, " + String((unsigned)stats.partialHits) + " partial, " +
+                   String((unsigned)stats.misses) + " misses");
+    Serial.println("Wasted: " + String((unsigned)stats.wasted) + " files, " + PerformanceMonitor::formatBytes(stats.bytesWasted));
+    Serial.println("Accuracy: " + String(getAccuracy() * 100.0f, 1) + "%, coverage: " + String(getCoverage() * 100.0f, 1) + "%");
+    Serial.println("Latency saved: " + PerformanceMonitor::formatTime(stats.latencySavedMs) +
+                   (demandKBps > 0.0f ? " (at " + PerformanceMonitor::formatSpeed(demandKBps) + " demand throughput)" : String(" (no demand download measured yet)")));
+    Serial.println("Backoffs: " + String((unsigned)stats.backoffs));
+    Serial.println("==================\n");
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include "download_engines.h"
+
+class DownloadCache;
+
+// Idle-time prefetching of downloads we expect to be asked for. Hints name a URL and target
+// path plus either an expected time (optionally recurring) or a trigger the application fires
+// when a user flow starts. poll() fetches armed hints at a capped rate while the device is idle
+// and the link is good; foreground activity pauses it at the next buffer boundary and it resumes
+// with a Range request later. fetch() is the demand path: a prefetched file is served as is,
+// a partial one is finished at full speed, anything else is a normal download.
+
+const unsigned long PREFETCH_LEAD_MS = 5UL * 60 * 1000;       // start this long before a timed hint is due
+const unsigned long PREFETCH_TTL_MS = 30UL * 60 * 1000;       // ready but unused this long after due = wasted
+const unsigned long PREFETCH_IDLE_MS = 10000;                 // quiet time before prefetching starts
+const float PREFETCH_DEFAULT_RATE_KBPS = 64.0f;               // leave most of the link to foreground work
+const int PREFETCH_MIN_RSSI = -70;
+const size_t PREFETCH_PACE_BYTES = 4096;                      // pacing granularity
+const int MAX_PREFETCH_HINTS = 16;
+
+enum PrefetchState {
+PREFETCH_WAITING,    // timed hint not due yet / trigger not fired
+PREFETCH_ARMED,      // should be fetched when idle
+PREFETCH_PARTIAL,    // paused part way; bytesOnFlash are kept
+PREFETCH_READY       // whole file on flash, waiting for demand
+};
+
+struct PrefetchHint {
+String url;
+String targetPath;
+String trigger;             // empty for timed hints
+unsigned long dueAt;        // millis() when demand is expected (trigger hints: when fired)
+unsigned long periodMs;     // re-arm after each due time; 0 = one-shot
+PrefetchState state;
+size_t bytesOnFlash;
+size_t totalSize;           // 0 until known
+unsigned long fetchMs;      // time spent prefetching (rate-capped, so longer than a demand fetch)
+};
+
+struct PrefetchStats {
+size_t hints;
+size_t prefetched;          // completed prefetches
+size_t bytesPrefetched;
+size_t hits;                // demand served entirely from a prefetch
+size_t partialHits;         // demand finished a paused prefetch
+size_t misses;              // demand with no prefetch behind it
+size_t wasted;              // prefetched, never asked for
+size_t bytesWasted;
+size_t backoffs;            // prefetches paused for foreground work or a weak link
+unsigned long latencySavedMs;   // prefetched bytes at the demand path's measured throughput
+PrefetchStats() : hints(0), prefetched(0), bytesPrefetched(0), hits(0), partialHits(0), misses(0), wasted(0), bytesWasted(0),
+                  backoffs(0), latencySavedMs(0) {}
+};
+
+class Prefetcher {
+public:
+// engine is shared with demand downloads; poll() and fetch() must run on the same task
+explicit Prefetcher(HttpDownloader* engine);
+
+// Prefetched files are registered as evictable; hits count as cache hits (nullptr = none)
+void setDownloadCache(DownloadCache* cache) { downloadCache = cache; }
+void setRateLimitKBps(float kbps) { rateLimitKBps = kbps; }   // 0 = uncapped
+void setMinRssi(int rssi) { minRssi = rssi; }
+void setIdleThresholdMs(unsigned long ms) { idleThresholdMs = ms; }
+
+// Expected demand in dueInMs (every periodMs after that when non-zero)
+bool hintAt(const String& url, const String& targetPath, unsigned long dueInMs, unsigned long periodMs = 0);
+// Expected demand soon after trigger fires
+bool hintOnTrigger(const String& trigger, const String& url, const String& targetPath);
+// Arm the hints waiting on trigger; returns how many
+int fire(const String& trigger);
+void removeHint(const String& url);
+
+// Foreground work is happening; safe from any task. A running prefetch pauses at its next buffer.
+void noteActivity();
+
+// Run one prefetch if the device is idle and the link is good; true when it fetched something
+bool poll();
+
+// Demand path: serve or finish a prefetch of url, otherwise download normally
+DownloadResult fetch(const String& url, const String& targetPath);
+
+PrefetchStats getStats() const { return stats; }
+float getAccuracy() const;   // hits / (hits + wasted): how many prefetches were worth it
+float getCoverage() const;   // demand served (fully or partly) by prefetch
+void printStats() const;
+void printHints() const;
+
+private:
+HttpDownloader* engine;
+DownloadCache* downloadCache;
+std::vector<PrefetchHint> hints;
+float rateLimitKBps;
+int minRssi;
+unsigned long idleThresholdMs;
+volatile unsigned long lastActivity;
+volatile bool prefetching;
+portMUX_TYPE pauseMux = portMUX_INITIALIZER_UNLOCKED;
+
+// pacing for the running prefetch
+unsigned long runStart;
+size_t runStartOffset;
+
+float demandKBps;    // EWMA over full-speed demand downloads; 0 until the first one
+
+PrefetchStats stats;
+
+int find(const String& url) const;
+bool linkIsGood() const;
+void expire();
+void pace(size_t bytesOnFlash);
+void noteDemandThroughput(size_t bytes, unsigned long ms);
+unsigned long demandMsFor(size_t bytes) const;
+static bool partialIntact(const PrefetchHint& hint);
+bool prefetch(PrefetchHint& hint);
+void rearm(PrefetchHint& hint);
+};
@@ -0,0 +1,147 @@
+#include "request_coalescing.h"
+#include "spiffs_management.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+SingleFlightDownloader::SingleFlightDownloader(DownloaderBase* engine)
+: inner(engine), lock(xSemaphoreCreateMutex()), engineLock(xSemaphoreCreateMutex()) {
+}
+
+SingleFlightDownloader::~SingleFlightDownloader() {
+    if (lock) vSemaphoreDelete(lock);
+    if (engineLock) vSemaphoreDelete(engineLock);
+}
+
+DownloadResult SingleFlightDownloader::download(const String& url, const String& targetPath) {
+    return downloadToMany(url, std::vector<String>(1, targetPath));
+}
+
+DownloadResult SingleFlightDownloader::downloadToMany(const String& url, const std::vector<String>& targets) {
+    DownloadResult result;
+    if (!inner || targets.empty()) {
+        result.errorMessage = inner ? "No target path" : "No download engine";
+        return result;
+    }
+    const String& primary = targets[0];
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    stats.requests++;
+
+    // Prefer an exact match, otherwise any flight for the same URL
+    InFlight* match = nullptr;
+    for (InFlight* f : flights) {
+        if (f->url != url) continue;
+        if (f->targetPath == primary) {
+            match = f;
+            break;
+        }
+        if (!match) match = f;
+    }
+
+    if (match) {
+        match->refs++;
+        stats.coalesced++;
+        xSemaphoreGive(lock);
+        result = waitFor(match, primary);
+        // the remaining targets are local copies of whatever the leader produced
+        for (size_t i = 1; i < targets.size() && result.success; ++i) {
+            if (!copySPIFFSFile(primary, targets[i])) {
+                result.success = false;
+                result.errorMessage = "Copy failed: " + targets[i];
+            }
+        }
+        return result;
+    }
+    xSemaphoreGive(lock);
+
+    std::vector<String> mirrors(targets.begin() + 1, targets.end());
+    return runAsLeader(url, primary, mirrors);
+}
+
+DownloadResult SingleFlightDownloader::runAsLeader(const String& url, const String& targetPath, const std::vector<String>& mirrors) {
+    InFlight* f = new InFlight();
+    f->url = url;
+    f->targetPath = targetPath;
+    f->done = xSemaphoreCreateBinary();
+    f->refs = 1;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    flights.push_back(f);
+    xSemaphoreGive(lock);
+
+    xSemaphoreTake(engineLock, portMAX_DELAY);
+    bool fannedOut = mirrors.empty() || inner->setMirrorTargets(mirrors);
+    DownloadResult result = inner->download(url, targetPath);
+    xSemaphoreGive(engineLock);
+
+    if (!fannedOut && result.success) {
+        for (const auto& m : mirrors) {
+            if (!copySPIFFSFile(targetPath, m)) {
+                result.success = false;
+                result.errorMessage = "Copy failed: " + m;
+            }
+        }
+        result.extraSinks = mirrors.size();
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    stats.downloads++;
+    stats.extraSinks += mirrors.size();
+    f->result = result;
+    for (size_t i = 0; i < flights.size(); ++i) {
+        if (flights[i] == f) {
+            flights.erase(flights.begin() + i);
+            break;
+        }
+    }
+    // wake every waiter; each one re-gives so the next can pass
+    int waiters = f->refs - 1;
+    xSemaphoreGive(lock);
+    if (waiters > 0) xSemaphoreGive(f->done);
+
+    release(f);
+    return result;
+}
+
+DownloadResult SingleFlightDownloader::waitFor(InFlight* f, const String& targetPath) {
+    xSemaphoreTake(f->done, portMAX_DELAY);
+    xSemaphoreGive(f->done); // pass the baton to the next waiter
+
+    DownloadResult result = f->result;
+    result.coalesced = true;
+    result.extraSinks = 0;
+
+    if (result.success && f->targetPath != targetPath) {
+        if (copySPIFFSFile(f->targetPath, targetPath)) {
+            xSemaphoreTake(lock, portMAX_DELAY);
+            stats.localCopies++;
+            xSemaphoreGive(lock);
+        } else {
+            result.success = false;
+            result.errorMessage = "Copy failed: " + targetPath;
+        }
+    }
+    release(f);
+    return result;
+}
+
+void SingleFlightDownloader::release(InFlight* f) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool last = --f->refs == 0;
+    xSemaphoreGive(lock);
+    if (last) {
+        vSemaphoreDelete(f->done);
+        delete f;
+    }
+}
+
+void SingleFlightDownloader::printStats() const {
+    Serial.println("=== SINGLE-FLIGHT ===");
+    Serial.println("Requests: " + String((unsigned)stats.requests) + ", downloads: " + String((unsigned)stats.downloads));
+    Serial.println("Coalesced: " + String((unsigned)stats.coalesced) + " (local copies: " + String((unsigned)stats.localCopies) + ")");
+    Serial.println("Extra sinks fed: " + String((unsigned)stats.extraSinks));
+    if (stats.requests > 0) {
+        Serial.printf("Duplicate suppression: %.1f%%\n", (stats.requests - stats.downloads) * 100.0f / stats.requests);
+    }
+    Serial.println("=====================");
+}
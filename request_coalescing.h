@@ -0,0 +1,54 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "download_engines.h"
+
+// Single-flight wrapper: concurrent requests for the same URL share one download.
+// Same URL + same target -> later callers wait and get the leader's result.
+// Same URL + other target -> later callers wait, then copy the leader's file locally (no network).
+// Downloads of different URLs are serialized through the wrapped engine, which is not reentrant.
+
+struct SingleFlightStats {
+size_t requests;
+size_t downloads;      // calls that actually reached the wrapped engine
+size_t coalesced;      // callers that attached to an in-flight download
+size_t localCopies;    // coalesced callers with a different target, served by copying
+size_t extraSinks;     // additional targets fed by downloadToMany()
+SingleFlightStats() : requests(0), downloads(0), coalesced(0), localCopies(0), extraSinks(0) {}
+};
+
+class SingleFlightDownloader : public DownloaderBase {
+public:
+explicit SingleFlightDownloader(DownloaderBase* engine);
+~SingleFlightDownloader() override;
+
+DownloadResult download(const String& url, const String& targetPath) override;
+void cancel() override { if (inner) inner->cancel(); }
+String getName() const override { return String("SingleFlight(") + (inner ? inner->getName() : String("none")) + ")"; }
+
+// Download url once and deliver it to every path in targets (first one is the primary).
+// Uses the engine's mirror support when it has it, otherwise copies after the fact.
+DownloadResult downloadToMany(const String& url, const std::vector<String>& targets);
+
+SingleFlightStats getStats() const { return stats; }
+void printStats() const;
+
+private:
+struct InFlight {
+String url;
+String targetPath;
+SemaphoreHandle_t done;
+int refs;              // leader + waiters; last one out frees the entry
+DownloadResult result;
+};
+
+DownloaderBase* inner;
+SemaphoreHandle_t lock;        // guards flights and stats
+SemaphoreHandle_t engineLock;  // one download through the wrapped engine at a time
+std::vector<InFlight*> flights;
+SingleFlightStats stats;
+
+DownloadResult runAsLeader(const String& url, const String& targetPath, const std::vector<String>& mirrors);
+DownloadResult waitFor(InFlight* f, const String& targetPath);
+void release(InFlight* f);
+};
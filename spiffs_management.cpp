@@ -1,197 +1,531 @@
-#include "spiffs_management.h"
-#include <SPIFFS.h>
-
-// Start/mount SPIFFS
-bool startSPIFFS() {
-Serial.println("Initializing SPIFFS.");
-
-// pass true to format if mount fails
-if (!SPIFFS.begin(true)) {
-    Serial.println("SPIFFS Mount Failed");
-    return false;
-}
-
-size_t totalBytes = 0, usedBytes = 0;
-if (getSPIFFSInfo(totalBytes, usedBytes)) {
-    Serial.println("SPIFFS Initialized Successfully");
-    Serial.printf("Total: %d bytes, Used: %d bytes, Free: %d bytes\n", totalBytes, usedBytes, (int)(totalBytes - usedBytes));
-}
-return true;
-
-
-}
-
-bool mountSPIFFS() {
-// small wrapper — we keep it lean
-return startSPIFFS();
-}
-
-bool saveToSPIFFS(const String& path, const String& data) {
-if (data.length() == 0) {
-Serial.println("Warning: Attempting to save empty data");
-return false;
-}
-
-if (!checkSPIFFSSpace(data.length())) {
-    Serial.println("Error: Not enough SPIFFS space");
-    return false;
-}
-
-File f = SPIFFS.open(path, FILE_WRITE);
-if (!f) {
-    Serial.println("Error: Failed to open file for writing: " + path);
-    return false;
-}
-
-size_t bytesWritten = f.print(data);
-f.close();
-
-if (bytesWritten == data.length()) {
-    Serial.println("File saved: " + path + " (" + String(bytesWritten) + " bytes)");
-    return true;
-} else {
-    Serial.println("Write error: " + path + " (wrote " + String(bytesWritten) + "/" + String(data.length()) + " bytes)");
-    return false;
-}
-
-
-}
-
-void printFile(const String& path) {
-readAndPrintFile(path);
-}
-
-void readAndPrintFile(const String& path) {
-if (!SPIFFS.exists(path)) {
-Serial.println("Error: File does not exist: " + path);
-return;
-}
-
-File f = SPIFFS.open(path, FILE_READ);
-if (!f) {
-    Serial.println("Error: Failed to open file for reading: " + path);
-    return;
-}
-
-Serial.println("\n=== File Content: " + path + " ===");
-Serial.println("Size: " + String(f.size()) + " bytes");
-Serial.println("Content:");
-Serial.println("---");
-
-// Using small chunk reads in case files are large — humans tend to be explicit
-while (f.available()) {
-    Serial.write(f.read());
-}
-
-Serial.println("\n=== End of File ===\n");
-f.close();
-
-
-}
-
-void listSPIFFSFiles() {
-Serial.println("\n=== SPIFFS File List ===");
-
-File root = SPIFFS.open("/");
-if (!root) {
-    Serial.println("Error: Failed to open root directory");
-    return;
-}
-
-if (!root.isDirectory()) {
-    Serial.println("Error: Root is not a directory");
-    root.close();
-    return;
-}
-
-File file = root.openNextFile();
-int fileCount = 0;
-size_t totalSize = 0;
-
-while (file) {
-    if (file.isDirectory()) {
-        Serial.printf("[DIR]  %s\n", file.name());
-    } else {
-        size_t fileSize = file.size();
-        totalSize += fileSize;
-        fileCount++;
-        Serial.printf("[FILE] %s (%d bytes)\n", file.name(), (int)fileSize);
-    }
-    file = root.openNextFile();
-}
-
-root.close();
-
-Serial.printf("\nTotal: %d files, %d bytes\n", fileCount, (int)totalSize);
-
-size_t total, used;
-if (getSPIFFSInfo(total, used)) {
-    Serial.printf("SPIFFS: %d/%d bytes used (%.1f%%)\n", (int)used, (int)total, (used * 100.0f) / total);
-}
-
-Serial.println("========================\n");
-
-
-}
-
-bool getSPIFFSInfo(size_t& totalBytes, size_t& usedBytes) {
-totalBytes = SPIFFS.totalBytes();
-usedBytes = SPIFFS.usedBytes();
-
-if (totalBytes == 0) {
-    Serial.println("Warning: SPIFFS appears to be uninitialized");
-    return false;
-}
-return true;
-
-
-}
-
-bool checkSPIFFSSpace(size_t requiredBytes) {
-size_t totalBytes = 0, usedBytes = 0;
-if (!getSPIFFSInfo(totalBytes, usedBytes)) {
-return false;
-}
-
-size_t availableBytes = totalBytes - usedBytes;
-// safety margin: at least 1KB or 10% of total, whichever is larger
-size_t safetyMargin = max(totalBytes / 10, (size_t)1024);
-
-if (requiredBytes + safetyMargin > availableBytes) {
-    Serial.printf("Insufficient space: need %d bytes, available %d bytes (with %d bytes safety margin)\n",
-                  (int)requiredBytes, (int)availableBytes, (int)safetyMargin);
-    return false;
-}
-return true;
-
-
-}
-
-bool deleteSPIFFSFile(const String& path) {
-if (!SPIFFS.exists(path)) {
-Serial.println("File does not exist: " + path);
-return false;
-}
-if (SPIFFS.remove(path)) {
-Serial.println("File deleted: " + path);
-return true;
-} else {
-Serial.println("Failed to delete file: " + path);
-return false;
-}
-}
-
-void formatSPIFFS() {
-Serial.println("WARNING: Formatting SPIFFS will erase all data!");
-Serial.println("This operation cannot be undone.");
-
-// We do not attempt interactive confirmation in embedded runs by default.
-// If someone wants interactive formatting later, we could implement it.
-if (SPIFFS.format()) {
-    Serial.println("SPIFFS formatted successfully");
-} else {
-    Serial.println("SPIFFS format failed");
-}
-
-
-}
\ No newline at end of file
+#include "spiffs_management.h"
+#include "hot_file_cache.h"
+#include "hot_path_timer.h"
+#include "content_store.h"
+#include "download_cache.h"
+#include "peer_cache.h"
+#include "buffer_and_performance.h"
+#include <SPIFFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <vector>
+#include <algorithm>
+
+static HotFileCache* hotCache = nullptr;
+static ContentStore* contentStore = nullptr;
+static DownloadCache* downloadCache = nullptr;
+static PeerCache* peerCache = nullptr;
+
+// Start/mount SPIFFS
+bool startSPIFFS() {
+Serial.println("Initializing SPIFFS.");
+
+// pass true to format if mount fails
+if (!SPIFFS.begin(true)) {
+    Serial.println("SPIFFS Mount Failed");
+    return false;
+}
+
+size_t totalBytes = 0, usedBytes = 0;
+if (getSPIFFSInfo(totalBytes, usedBytes)) {
+    Serial.println("SPIFFS Initialized Successfully");
+    Serial.printf("Total: %d bytes, Used: %d bytes, Free: %d bytes\n", totalBytes, usedBytes, (int)(totalBytes - usedBytes));
+}
+return true;
+
+
+}
+
+bool mountSPIFFS() {
+// small wrapper — we keep it lean
+return startSPIFFS();
+}
+
+bool saveToSPIFFS(const String& path, const String& data) {
+HOT_TIMER("spiffs.save");
+if (data.length() == 0) {
+Serial.println("Warning: Attempting to save empty data");
+return false;
+}
+
+if (!checkSPIFFSSpace(data.length())) {
+    Serial.println("Error: Not enough SPIFFS space");
+    return false;
+}
+
+// a plain file replaces whatever the path referenced
+File f = openSPIFFSForWrite(path);
+if (!f) {
+    Serial.println("Error: Failed to open file for writing: " + path);
+    return false;
+}
+
+size_t bytesWritten = f.print(data);
+f.close();
+hotCacheWrite(path, (const uint8_t*)data.c_str(), bytesWritten, false);
+
+if (bytesWritten == data.length()) {
+    Serial.println("File saved: " + path + " (" + String(bytesWritten) + " bytes)");
+    return true;
+} else {
+    Serial.println("Write error: " + path + " (wrote " + String(bytesWritten) + "/" + String(data.length()) + " bytes)");
+    return false;
+}
+
+
+}
+
+void printFile(const String& path) {
+readAndPrintFile(path);
+}
+
+void readAndPrintFile(const String& path) {
+String stored = resolveSPIFFSPath(path);
+if (!SPIFFS.exists(stored)) {
+Serial.println("Error: File does not exist: " + path);
+return;
+}
+
+File f = SPIFFS.open(stored, FILE_READ);
+if (!f) {
+    Serial.println("Error: Failed to open file for reading: " + path);
+    return;
+}
+downloadCacheTouch(path);
+
+Serial.println("\n=== File Content: " + path + " ===");
+Serial.println("Size: " + String(f.size()) + " bytes");
+Serial.println("Content:");
+Serial.println("---");
+
+// Chunked reads: one storage call per 512 bytes instead of per byte (RAM when the file is hot,
+// otherwise straight from the handle opened above)
+uint8_t buf[512];
+size_t n, offset = 0;
+while ((n = readFromSPIFFS(f, stored, offset, buf, sizeof(buf))) > 0) {
+    Serial.write(buf, n);
+    offset += n;
+}
+
+Serial.println("\n=== End of File ===\n");
+f.close();
+
+
+}
+
+void listSPIFFSFiles() {
+Serial.println("\n=== SPIFFS File List ===");
+
+File root = SPIFFS.open("/");
+if (!root) {
+    Serial.println("Error: Failed to open root directory");
+    return;
+}
+
+if (!root.isDirectory()) {
+    Serial.println("Error: Root is not a directory");
+    root.close();
+    return;
+}
+
+File file = root.openNextFile();
+int fileCount = 0;
+size_t totalSize = 0;
+
+while (file) {
+    if (file.isDirectory()) {
+        Serial.printf("[DIR]  %s\n", file.name());
+    } else {
+        size_t fileSize = file.size();
+        totalSize += fileSize;
+        fileCount++;
+        Serial.printf("[FILE] %s (%d bytes)\n", file.name(), (int)fileSize);
+    }
+    file = root.openNextFile();
+}
+
+root.close();
+
+Serial.printf("\nTotal: %d files, %d bytes\n", fileCount, (int)totalSize);
+
+size_t total, used;
+if (getSPIFFSInfo(total, used)) {
+    Serial.printf("SPIFFS: %d/%d bytes used (%.1f%%)\n", (int)used, (int)total, (used * 100.0f) / total);
+}
+
+Serial.println("========================\n");
+
+
+}
+
+bool getSPIFFSInfo(size_t& totalBytes, size_t& usedBytes) {
+totalBytes = SPIFFS.totalBytes();
+usedBytes = SPIFFS.usedBytes();
+
+if (totalBytes == 0) {
+    Serial.println("Warning: SPIFFS appears to be uninitialized");
+    return false;
+}
+return true;
+
+
+}
+
+bool checkSPIFFSSpace(size_t requiredBytes) {
+HOT_TIMER("spiffs.checkSpace");
+size_t totalBytes = 0, usedBytes = 0;
+if (!getSPIFFSInfo(totalBytes, usedBytes)) {
+return false;
+}
+
+size_t availableBytes = totalBytes - usedBytes;
+// safety margin: at least 1KB or 10% of total, whichever is larger
+size_t safetyMargin = max(totalBytes / 10, (size_t)1024);
+
+if (requiredBytes + safetyMargin > availableBytes) {
+    Serial.printf("Insufficient space: need %d bytes, available %d bytes (with %d bytes safety margin)\n",
+                  (int)requiredBytes, (int)availableBytes, (int)safetyMargin);
+    return false;
+}
+return true;
+
+
+}
+
+bool deleteSPIFFSFile(const String& path) {
+peerCacheForget(path);
+if (contentStore && contentStore->release(path)) {
+Serial.println("Reference deleted: " + path);
+return true;
+}
+if (!SPIFFS.exists(path)) {
+Serial.println("File does not exist: " + path);
+return false;
+}
+hotCacheInvalidate(path);
+if (SPIFFS.remove(path)) {
+Serial.println("File deleted: " + path);
+return true;
+} else {
+Serial.println("Failed to delete file: " + path);
+return false;
+}
+}
+
+bool copySPIFFSFile(const String& from, const String& to) {
+File src = SPIFFS.open(resolveSPIFFSPath(from), FILE_READ);
+if (!src) {
+    Serial.println("Error: Failed to open file for reading: " + from);
+    return false;
+}
+hotCacheInvalidate(to);
+File dst = openSPIFFSForWrite(to);
+if (!dst) {
+    Serial.println("Error: Failed to open file for writing: " + to);
+    src.close();
+    return false;
+}
+
+uint8_t buf[1024];
+size_t n;
+bool ok = true;
+while ((n = src.read(buf, sizeof(buf))) > 0) {
+    if (dst.write(buf, n) != n) {
+        ok = false;
+        break;
+    }
+}
+src.close();
+dst.close();
+
+if (!ok) Serial.println("Copy failed: " + from + " -> " + to);
+return ok;
+}
+
+void formatSPIFFS() {
+Serial.println("WARNING: Formatting SPIFFS will erase all data!");
+Serial.println("This operation cannot be undone.");
+
+// We do not attempt interactive confirmation in embedded runs by default.
+// If someone wants interactive formatting later, we could implement it.
+if (hotCache) hotCache->clear();
+if (SPIFFS.format()) {
+    Serial.println("SPIFFS formatted successfully");
+} else {
+    Serial.println("SPIFFS format failed");
+}
+
+
+}
+void setHotFileCache(HotFileCache* cache) {
+    hotCache = cache;
+}
+
+size_t readFromSPIFFS(const String& requested, size_t offset, uint8_t* buf, size_t len) {
+    HOT_TIMER("spiffs.read");
+    if (offset == 0) downloadCacheTouch(requested);
+    String path = resolveSPIFFSPath(requested);
+    size_t got = 0;
+    if (hotCache) {
+        if (hotCache->read(path, offset, buf, len, got)) return got;
+        // miss: small files are pulled in whole so the following reads are hits
+        if (offset == 0 && hotCache->load(path) && hotCache->read(path, offset, buf, len, got)) return got;
+    }
+
+    File f = SPIFFS.open(path, FILE_READ);
+    if (!f) return 0;
+    if (offset > 0 && !f.seek(offset)) {
+        f.close();
+        return 0;
+    }
+    got = f.read(buf, len);
+    f.close();
+    return got;
+}
+
+size_t readFromSPIFFS(File& f, const String& storedPath, size_t offset, uint8_t* buf, size_t len) {
+    HOT_TIMER("spiffs.read");
+    size_t got = 0;
+    if (hotCache) {
+        if (hotCache->read(storedPath, offset, buf, len, got)) return got;
+        if (offset == 0 && hotCache->load(storedPath) && hotCache->read(storedPath, offset, buf, len, got)) return got;
+    }
+    if (f.position() != offset && !f.seek(offset)) return 0;
+    return f.read(buf, len);
+}
+
+void hotCacheWrite(const String& path, const uint8_t* data, size_t len, bool append) {
+    if (hotCache) hotCache->write(path, data, len, append);
+}
+
+void hotCacheInvalidate(const String& path) {
+    if (hotCache) hotCache->invalidate(path);
+}
+
+void setContentStore(ContentStore* store) {
+    contentStore = store;
+}
+
+String resolveSPIFFSPath(const String& path) {
+    return contentStore ? contentStore->resolve(path) : path;
+}
+
+File openSPIFFSForWrite(const String& path, bool append) {
+    peerCacheForget(path);   // the advertised digest no longer describes what will be there
+    if (contentStore && contentStore->isReference(path)) {
+        if (append) {
+            // the reference has no file of its own: materialise the shared bytes before appending
+            File src = SPIFFS.open(contentStore->resolve(path), FILE_READ);
+            File dst = SPIFFS.open(path, FILE_WRITE);
+            if (!src || !dst) {
+                Serial.println("Error: cannot copy the stored content of " + path + " for appending");
+                return File();
+            }
+            uint8_t buf[512];
+            size_t n;
+            while ((n = src.read(buf, sizeof(buf))) > 0) {
+                if (dst.write(buf, n) != n) {
+                    Serial.println("Error: cannot copy the stored content of " + path + " for appending");
+                    dst.close();
+                    SPIFFS.remove(path);
+                    return File();
+                }
+            }
+            dst.close();
+        }
+        contentStore->release(path);
+        hotCacheInvalidate(path);
+    }
+    return SPIFFS.open(path, append ? FILE_APPEND : FILE_WRITE);
+}
+
+void setDownloadCache(DownloadCache* cache) {
+    downloadCache = cache;
+}
+
+void downloadCacheTouch(const String& path) {
+    if (downloadCache) downloadCache->touch(path);
+}
+
+void setPeerCache(PeerCache* cache) {
+    peerCache = cache;
+}
+
+void peerCacheForget(const String& path) {
+    if (peerCache) peerCache->removeLocalContent(path);
+}
+
+// ---- Storage benchmark ----
+
+namespace {
+const char* BENCH_FILE = "/.bench_data";
+const char* BENCH_FILL_PREFIX = "/.bench_fill";
+const size_t BENCH_FILL_CHUNK = 16 * 1024;
+
+struct BenchOp {
+    const char* name;
+    size_t bytes;
+    unsigned long totalUs;
+    std::vector<uint32_t> latUs;
+};
+
+uint32_t percentile(std::vector<uint32_t>& v, int pct) {
+    if (v.empty()) return 0;
+    size_t i = (v.size() - 1) * pct / 100;
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+void printBenchRow(int fillPct, size_t chunk, BenchOp& op) {
+    float kbps = op.totalUs > 0 ? (op.bytes / 1024.0f) * 1e6f / op.totalUs : 0.0f;
+    uint32_t maxUs = op.latUs.empty() ? 0 : *std::max_element(op.latUs.begin(), op.latUs.end());
+    Serial.printf("%4d%% %8s %-7s %9.1f %9u %9u %9u %9u\n", fillPct, PerformanceMonitor::formatBytes(chunk).c_str(), op.name,
+                  kbps, (unsigned)percentile(op.latUs, 50), (unsigned)percentile(op.latUs, 90),
+                  (unsigned)percentile(op.latUs, 99), (unsigned)maxUs);
+}
+
+void removeBenchFiles(int fillFiles) {
+    SPIFFS.remove(BENCH_FILE);
+    for (int i = 0; i < fillFiles; ++i) SPIFFS.remove(String(BENCH_FILL_PREFIX) + i);
+}
+
+// Pad SPIFFS with filler files up to targetUsed bytes; returns false when it runs out of room
+bool fillTo(size_t targetUsed, int& fillFiles, uint8_t* buf) {
+    while (SPIFFS.usedBytes() < targetUsed) {
+        File f = SPIFFS.open(String(BENCH_FILL_PREFIX) + fillFiles, FILE_WRITE);
+        if (!f) return false;
+        fillFiles++;
+        size_t want = min((size_t)64 * 1024, targetUsed - SPIFFS.usedBytes());
+        size_t written = 0;
+        while (written < want) {
+            size_t n = f.write(buf, min(BENCH_FILL_CHUNK, want - written));
+            if (n == 0) break;
+            written += n;
+        }
+        f.close();
+        if (written == 0) return false;
+    }
+    return true;
+}
+}
+
+bool runStorageBenchmark(size_t fileBytes) {
+    const size_t chunkSizes[] = { 1024, 4096, 16384, SMALL_DOWNLOAD_BUFFER_SIZE, DEFAULT_DOWNLOAD_BUFFER_SIZE,
+                                  LARGE_DOWNLOAD_BUFFER_SIZE, XLARGE_DOWNLOAD_BUFFER_SIZE };
+    const int fillLevels[] = { 0, 50, 75 };   // 0 = as found
+
+    size_t total = 0, used = 0;
+    if (!getSPIFFSInfo(total, used)) return false;
+    removeBenchFiles(64); // leftovers from an interrupted run
+
+    uint8_t* fillBuf = (uint8_t*)malloc(BENCH_FILL_CHUNK);
+    if (!fillBuf) return false;
+    memset(fillBuf, 0xA5, BENCH_FILL_CHUNK);
+
+    Serial.println("\n=== STORAGE BENCHMARK (" + PerformanceMonitor::formatBytes(fileBytes) + " per test, SPIFFS " +
+                   PerformanceMonitor::formatBytes(total) + ") ===");
+    Serial.printf("%5s %8s %-7s %9s %9s %9s %9s %9s\n", "Fill", "Chunk", "Op", "KB/s", "p50 us", "p90 us", "p99 us", "max us");
+
+    int fillFiles = 0;
+    float bestWrite = 0.0f, bestRead = 0.0f;
+    size_t bestWriteChunk = 0, bestReadChunk = 0;
+
+    for (int level : fillLevels) {
+        if (level > 0) {
+            size_t target = total * level / 100;
+            // the test file needs room on top of the filler
+            if (target + fileBytes + total / 10 > total || !fillTo(target, fillFiles, fillBuf)) {
+                Serial.printf("%4d%%  skipped (not enough free space)\n", level);
+                continue;
+            }
+        }
+        int fillPct = (int)(SPIFFS.usedBytes() * 100 / total);
+
+        for (size_t chunk : chunkSizes) {
+            if (chunk > fileBytes) break;
+            uint8_t* buf = (uint8_t*)malloc(chunk);
+            if (!buf) {
+                Serial.printf("%4d%% %8s  skipped (no memory)\n", fillPct, PerformanceMonitor::formatBytes(chunk).c_str());
+                continue;
+            }
+            memset(buf, 0x5A, chunk);
+            size_t ops = fileBytes / chunk;
+            BenchOp write = { "write", 0, 0, {} }, append = { "append", 0, 0, {} }, read = { "read", 0, 0, {} }, del = { "delete", 0, 0, {} };
+            write.latUs.reserve(ops);
+            append.latUs.reserve(ops);
+            read.latUs.reserve(ops);
+
+            // sequential write through one open handle
+            unsigned long start = micros();
+            File f = SPIFFS.open(BENCH_FILE, FILE_WRITE);
+            for (size_t i = 0; f && i < ops; ++i) {
+                unsigned long t = micros();
+                size_t n = f.write(buf, chunk);
+                write.latUs.push_back(micros() - t);
+                write.bytes += n;
+                if (n != chunk) break;
+            }
+            if (f) f.close();
+            write.totalUs = micros() - start;
+
+            // delete, then append with open/close per chunk
+            unsigned long t = micros();
+            SPIFFS.remove(BENCH_FILE);
+            del.latUs.push_back(micros() - t);
+            start = micros();
+            for (size_t i = 0; i < ops; ++i) {
+                t = micros();
+                File a = SPIFFS.open(BENCH_FILE, FILE_APPEND);
+                size_t n = a ? a.write(buf, chunk) : 0;
+                if (a) a.close();
+                append.latUs.push_back(micros() - t);
+                append.bytes += n;
+                if (n != chunk) break;
+            }
+            append.totalUs = micros() - start;
+
+            // sequential read
+            start = micros();
+            f = SPIFFS.open(BENCH_FILE, FILE_READ);
+            for (size_t i = 0; f && i < ops; ++i) {
+                t = micros();
+                size_t n = f.read(buf, chunk);
+                read.latUs.push_back(micros() - t);
+                read.bytes += n;
+                if (n != chunk) break;
+            }
+            if (f) f.close();
+            read.totalUs = micros() - start;
+
+            t = micros();
+            SPIFFS.remove(BENCH_FILE);
+            del.latUs.push_back(micros() - t);
+            free(buf);
+
+            printBenchRow(fillPct, chunk, write);
+            printBenchRow(fillPct, chunk, append);
+            printBenchRow(fillPct, chunk, read);
+            printBenchRow(fillPct, chunk, del);
+
+            float w = write.totalUs > 0 ? (write.bytes / 1024.0f) * 1e6f / write.totalUs : 0.0f;
+            float r = read.totalUs > 0 ? (read.bytes / 1024.0f) * 1e6f / read.totalUs : 0.0f;
+            if (w > bestWrite) {
+                bestWrite = w;
+                bestWriteChunk = chunk;
+            }
+            if (r > bestRead) {
+                bestRead = r;
+                bestReadChunk = chunk;
+            }
+            vTaskDelay(1); // let the idle task feed the watchdog between rows
+        }
+    }
+
+    removeBenchFiles(fillFiles);
+    free(fillBuf);
+
+    Serial.println("Flash ceiling: write " + PerformanceMonitor::formatSpeed(bestWrite) + " (" + PerformanceMonitor::formatBytes(bestWriteChunk) +
+                   " chunks), read " + PerformanceMonitor::formatSpeed(bestRead) + " (" + PerformanceMonitor::formatBytes(bestReadChunk) + " chunks)");
+    Serial.println("=================================================\n");
+    return true;
+}
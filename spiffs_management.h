@@ -1,24 +1,66 @@
-#pragma once
-#include <Arduino.h>
-
-// SPIFFS helper functions — small handwritten-style docstrings and a FileInfo struct
-
-bool startSPIFFS();
-bool mountSPIFFS();
-bool saveToSPIFFS(const String& path, const String& data);
-void printFile(const String& path);
-void readAndPrintFile(const String& path);
-void listSPIFFSFiles();
-bool getSPIFFSInfo(size_t& totalBytes, size_t& usedBytes);
-bool checkSPIFFSSpace(size_t requiredBytes);
-bool deleteSPIFFSFile(const String& path);
-void formatSPIFFS();
-
-// FileInfo: tiny struct used by list/indexing helpers
-struct FileInfo {
-String name;
-size_t size;
-bool isDirectory;
-FileInfo() : name(""), size(0), isDirectory(false) {}
-FileInfo(String n, size_t s, bool d) : name(n), size(s), isDirectory(d) {}
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+
+// SPIFFS helper functions — small handwritten-style docstrings and a FileInfo struct
+
+bool startSPIFFS();
+bool mountSPIFFS();
+bool saveToSPIFFS(const String& path, const String& data);
+void printFile(const String& path);
+void readAndPrintFile(const String& path);
+void listSPIFFSFiles();
+bool getSPIFFSInfo(size_t& totalBytes, size_t& usedBytes);
+bool checkSPIFFSSpace(size_t requiredBytes);
+bool deleteSPIFFSFile(const String& path);
+bool copySPIFFSFile(const String& from, const String& to);
+void formatSPIFFS();
+
+// Flash throughput ceiling: sequential write, per-chunk open/append/close (what HttpDownloader does),
+// read and delete, for chunk sizes 1 KB..XLARGE_DOWNLOAD_BUFFER_SIZE at several fill levels.
+// Prints KB/s and per-operation latency percentiles; removes its files afterwards.
+bool runStorageBenchmark(size_t fileBytes = 256 * 1024);
+
+// Optional PSRAM hot-file cache in front of flash (nullptr = always read flash)
+class HotFileCache;
+void setHotFileCache(HotFileCache* cache);
+// Storage-layer read: served from the hot-file cache when it has the file; returns bytes read
+size_t readFromSPIFFS(const String& path, size_t offset, uint8_t* buf, size_t len);
+// Same for a reader that keeps the file open (storedPath = resolveSPIFFSPath(path)): a miss reads
+// from f, seeking only when offset is not where f already is
+size_t readFromSPIFFS(File& f, const String& storedPath, size_t offset, uint8_t* buf, size_t len);
+// Writers call these so the hot-file cache stays coherent with flash (no-ops without a cache)
+void hotCacheWrite(const String& path, const uint8_t* data, size_t len, bool append);
+void hotCacheInvalidate(const String& path);
+
+// Optional content-addressed store (nullptr = every path is a plain file)
+class ContentStore;
+void setContentStore(ContentStore* store);
+// Where the bytes for path live: the shared blob when path is a store reference, else path
+String resolveSPIFFSPath(const String& path);
+// Open path as a plain file for writing (truncating unless append). A content-store reference at
+// path is dropped first, otherwise readers would keep resolving to the old blob; for append the
+// blob's bytes are copied to path before that, so the prefix survives. Every writer of a download
+// target goes through this.
+File openSPIFFSForWrite(const String& path, bool append = false);
+
+// Optional download cache (nullptr = reads do not count as accesses)
+class DownloadCache;
+void setDownloadCache(DownloadCache* cache);
+// Readers call this when they start on a file so the eviction order follows real use
+void downloadCacheTouch(const String& path);
+
+// Optional LAN peer cache (nullptr = nothing advertised): files deleted, evicted or rewritten
+// through these helpers stop being offered to peers
+class PeerCache;
+void setPeerCache(PeerCache* cache);
+void peerCacheForget(const String& path);
+
+// FileInfo: tiny struct used by list/indexing helpers
+struct FileInfo {
+String name;
+size_t size;
+bool isDirectory;
+FileInfo() : name(""), size(0), isDirectory(false) {}
+FileInfo(String n, size_t s, bool d) : name(n), size(s), isDirectory(d) {}
 };
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "telemetry.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+static TelemetryMode mode = TELEMETRY_TEXT;
+static Print* output = &Serial;
+static uint16_t nextSeq = 0;
+static uint32_t framesSent = 0;
+static uint32_t bytesSent = 0;
+// seq is taken and the frame written under one mutex, so frames reach the port in seq order
+// (the write blocks on the UART, hence not a portMUX); created on first use
+static SemaphoreHandle_t frameLock = nullptr;
+static StaticSemaphore_t frameLockBuffer;
+static portMUX_TYPE frameLockInit = portMUX_INITIALIZER_UNLOCKED;
+
+// largest body (progress) is 1 + 2 + 4 + 16 + 1
+static const size_t MAX_BODY = 24;
+
+void setTelemetryMode(TelemetryMode m, Print* out) {
+    mode = m;
+    output = out ? out : &Serial;
+}
+
+bool telemetryBinary() {
+    return mode == TELEMETRY_BINARY;
+}
+
+static uint8_t crc8(const uint8_t* data, size_t len) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; ++b) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static void put16(uint8_t* p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+// COBS into out (needs len + 1 bytes); returns the encoded length
+static size_t cobsEncode(const uint8_t* in, size_t len, uint8_t* out) {
+    size_t codeAt = 0, o = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; ++i) {
+        if (in[i] == 0) {
+            out[codeAt] = code;
+            codeAt = o++;
+            code = 1;
+        } else {
+            out[o++] = in[i];
+            if (++code == 0xFF) {
+                out[codeAt] = code;
+                codeAt = o++;
+                code = 1;
+            }
+        }
+    }
+    out[codeAt] = code;
+    return o;
+}
+
+static void sendFrame(TelemetryFrameType type, const uint8_t* payload, size_t len) {
+    portENTER_CRITICAL(&frameLockInit);
+    if (!frameLock) frameLock = xSemaphoreCreateMutexStatic(&frameLockBuffer);
+    portEXIT_CRITICAL(&frameLockInit);
+    xSemaphoreTake(frameLock, portMAX_DELAY);
+
+    uint8_t body[MAX_BODY];
+    body[0] = type;
+    put16(body + 1, nextSeq++);
+    put32(body + 3, millis());
+    memcpy(body + 7, payload, len);
+    size_t bodyLen = 7 + len;
+    body[bodyLen] = crc8(body, bodyLen);
+    bodyLen++;
+
+    // one write per frame, so ordinary text never lands inside a frame
+    uint8_t wire[MAX_BODY + 4];
+    wire[0] = 0;
+    size_t n = 1 + cobsEncode(body, bodyLen, wire + 1);
+    wire[n++] = 0;
+    output->write(wire, n);
+
+    framesSent++;
+    bytesSent += n;
+    xSemaphoreGive(frameLock);
+}
+
+void telemetryProgress(uint32_t bytes, uint32_t total, uint32_t currentBps, uint32_t averageBps) {
+    uint8_t p[16];
+    put32(p, bytes);
+    put32(p + 4, total);
+    put32(p + 8, currentBps);
+    put32(p + 12, averageBps);
+    sendFrame(TLM_PROGRESS, p, sizeof(p));
+}
+
+void telemetryPhase(TelemetryPhase phase, uint32_t value) {
+    uint8_t p[5];
+    p[0] = phase;
+    put32(p + 1, value);
+    sendFrame(TLM_PHASE, p, sizeof(p));
+}
+
+void telemetryMetric(TelemetryMetric metric, int32_t value) {
+    uint8_t p[5];
+    p[0] = metric;
+    put32(p + 1, (uint32_t)value);
+    sendFrame(TLM_METRIC, p, sizeof(p));
+}
+
+void printTelemetryStats() {
+    Serial.println("\n=== TELEMETRY ===");
+    Serial.println("Mode: " + String(mode == TELEMETRY_BINARY ? "binary" : "text"));
+    Serial.println("Frames: " + String(framesSent) + ", bytes: " + String(bytesSent) +
+                   (framesSent > 0 ? " (" + String((float)bytesSent / framesSent, 1) + " B/frame)" : ""));
+    Serial.println("=================\n");
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <Arduino.h>
+
+// Compact binary telemetry on the serial link, as an alternative to PerformanceMonitor's text lines.
+//
+// Frame on the wire: 0x00, COBS(body), 0x00
+//   body = type u8 | seq u16 | millis u32 | payload | crc8   (little-endian integers)
+// COBS leaves no zero bytes inside a frame, so frames and ordinary Serial text can share the port;
+// tools/telemetry_decoder.py separates the two and renders the frames live.
+
+enum TelemetryMode {
+TELEMETRY_TEXT,     // PerformanceMonitor prints text (default)
+TELEMETRY_BINARY    // PerformanceMonitor emits frames instead
+};
+
+enum TelemetryFrameType : uint8_t {
+TLM_PROGRESS = 1,   // bytes u32, total u32 (0 = unknown), current B/s u32, average B/s u32
+TLM_PHASE = 2,      // phase u8, value u32
+TLM_METRIC = 3      // metric u8, value i32
+};
+
+enum TelemetryPhase : uint8_t {
+TLM_PHASE_START = 1,        // value: 0
+TLM_PHASE_FIRST_BYTE = 2,   // value: connection setup ms
+TLM_PHASE_STOP = 3          // value: bytes transferred
+};
+
+enum TelemetryMetric : uint8_t {
+TLM_METRIC_FREE_HEAP = 1,
+TLM_METRIC_RSSI = 2,
+TLM_METRIC_AVG_BPS = 3,
+TLM_METRIC_PEAK_BPS = 4,
+TLM_METRIC_SETUP_MS = 5,
+TLM_METRIC_TRANSFER_MS = 6
+};
+
+// Progress frames are rate limited; at 19200 baud a frame per chunk would fill the link
+const unsigned long TELEMETRY_PROGRESS_INTERVAL_MS = 100;
+
+void setTelemetryMode(TelemetryMode mode, Print* out = &Serial);
+bool telemetryBinary();
+
+void telemetryProgress(uint32_t bytes, uint32_t total, uint32_t currentBps, uint32_t averageBps);
+void telemetryPhase(TelemetryPhase phase, uint32_t value);
+void telemetryMetric(TelemetryMetric metric, int32_t value);
+
+// Frames emitted / bytes written since boot, for comparing against the text output
+void printTelemetryStats();
@@ -0,0 +1,291 @@
+#!/usr/bin/env python3
+"""Fleet analyzer for DLRESULT download logs.
+
+Reads captured Serial output (any text file; lines may carry capture prefixes such as
+timestamps or device tags) from many devices, picks out the DLRESULT lines written by
+logDownloadResult() and reports:
+
+  summary      throughput / latency distributions per group
+  regress      per-group changes between two firmware builds, with a Mann-Whitney test
+  bottlenecks  where the time went (connect, transfer, flash/app overhead, crypto, signal)
+
+Every report prints a terminal table and can also be written as CSV with --csv.
+Standard library only; runs offline.
+
+  tools/fleet_analyzer.py summary logs/*.txt --by fw
+  tools/fleet_analyzer.py regress logs/ --base 1.4.0 --new 1.5.0 --by host
+  tools/fleet_analyzer.py bottlenecks logs/ --by ap --csv bottlenecks.csv
+"""
+
+import argparse
+import csv
+import math
+import os
+import sys
+from collections import defaultdict
+
+NUMERIC = ("ok", "status", "bytes", "ms", "kbps", "peak", "setup", "xfer", "crypto", "peer", "rssi", "roamed", "heap")
+
+
+def parse_line(line):
+    at = line.find("DLRESULT ")
+    if at < 0:
+        return None
+    rec = {}
+    for tok in line[at + len("DLRESULT "):].split():
+        key, sep, value = tok.partition("=")
+        if not sep:
+            continue
+        if key in NUMERIC:
+            try:
+                value = float(value)
+            except ValueError:
+                continue
+        rec[key] = value
+    if "kbps" not in rec or "ms" not in rec:
+        return None
+    return rec
+
+
+def iter_files(paths):
+    for p in paths:
+        if os.path.isdir(p):
+            for root, _, names in os.walk(p):
+                for n in sorted(names):
+                    yield os.path.join(root, n)
+        else:
+            yield p
+
+
+def load(paths):
+    records = []
+    for path in iter_files(paths):
+        try:
+            with open(path, "r", errors="replace") as f:
+                for line in f:
+                    rec = parse_line(line)
+                    if rec is None:
+                        continue
+                    if rec.get("dev", "-") == "-":
+                        rec["dev"] = os.path.splitext(os.path.basename(path))[0]
+                    records.append(rec)
+        except OSError as e:
+            print("skipping %s: %s" % (path, e), file=sys.stderr)
+    return records
+
+
+def group_key(rec, by):
+    if by == "all":
+        return "all"
+    if by == "ap":
+        # AP model is not on the wire; the vendor OUI of the BSSID is the closest proxy
+        bssid = str(rec.get("bssid", "-"))
+        return bssid[:8].upper() if len(bssid) >= 8 else "-"
+    return str(rec.get(by, "-"))
+
+
+def percentile(values, p):
+    if not values:
+        return float("nan")
+    s = sorted(values)
+    k = (len(s) - 1) * p / 100.0
+    lo = int(math.floor(k))
+    hi = min(lo + 1, len(s) - 1)
+    return s[lo] + (s[hi] - s[lo]) * (k - lo)
+
+
+def mann_whitney_p(a, b):
+    """Two-sided p-value (normal approximation, tie-corrected) that a and b share a distribution."""
+    n1, n2 = len(a), len(b)
+    if n1 < 3 or n2 < 3:
+        return float("nan")
+    combined = sorted([(v, 0) for v in a] + [(v, 1) for v in b])
+    ranks = [0.0] * len(combined)
+    tie_term = 0.0
+    i = 0
+    while i < len(combined):
+        j = i
+        while j + 1 < len(combined) and combined[j + 1][0] == combined[i][0]:
+            j += 1
+        avg = (i + j) / 2.0 + 1
+        for k in range(i, j + 1):
+            ranks[k] = avg
+        t = j - i + 1
+        tie_term += t ** 3 - t
+        i = j + 1
+    r1 = sum(r for r, (_, g) in zip(ranks, combined) if g == 0)
+    u1 = r1 - n1 * (n1 + 1) / 2.0
+    n = n1 + n2
+    mu = n1 * n2 / 2.0
+    sigma = math.sqrt(n1 * n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1))))
+    if sigma == 0:
+        return 1.0
+    z = (abs(u1 - mu) - 0.5) / sigma
+    return math.erfc(max(z, 0.0) / math.sqrt(2))
+
+
+def attribute(rec):
+    """Single dominant cause for one download."""
+    if not rec.get("ok"):
+        return "failure"
+    ms = rec.get("ms", 0) or 0
+    if ms <= 0:
+        return "unknown"
+    setup = rec.get("setup", 0)
+    xfer = rec.get("xfer", 0)
+    crypto = rec.get("crypto", 0)
+    if setup / ms > 0.3:
+        return "connect"
+    if crypto / ms > 0.2:
+        return "crypto"
+    if xfer > 0 and (ms - setup - xfer) / ms > 0.3:
+        return "overhead"
+    if rec.get("rssi", 0) < -75:
+        return "weak-signal"
+    return "network"
+
+
+def print_table(header, rows):
+    cells = [[str(c) for c in header]] + [[fmt(c) for c in r] for r in rows]
+    widths = [max(len(r[i]) for r in cells) for i in range(len(header))]
+    for n, r in enumerate(cells):
+        print("  ".join(c.rjust(w) if n and i else c.ljust(w) for i, (c, w) in enumerate(zip(r, widths))))
+        if n == 0:
+            print("  ".join("-" * w for w in widths))
+
+
+def fmt(v):
+    if isinstance(v, float):
+        return "-" if math.isnan(v) else "%.1f" % v
+    return str(v)
+
+
+def write_csv(path, header, rows):
+    with open(path, "w", newline="") as f:
+        w = csv.writer(f)
+        w.writerow(header)
+        w.writerows(rows)
+    print("wrote %s" % path)
+
+
+def cmd_summary(records, args):
+    groups = defaultdict(list)
+    for r in records:
+        groups[group_key(r, args.by)].append(r)
+    header = [args.by, "n", "ok%", "kbps_p5", "kbps_p50", "kbps_p95", "setup_p50", "setup_p95", "ms_p95"]
+    rows = []
+    for key in sorted(groups):
+        g = groups[key]
+        if len(g) < args.min_samples:
+            continue
+        ok = [r for r in g if r.get("ok")]
+        kbps = [r["kbps"] for r in ok]
+        setup = [r.get("setup", 0) for r in ok]
+        ms = [r["ms"] for r in ok]
+        rows.append([key, len(g), 100.0 * len(ok) / len(g), percentile(kbps, 5), percentile(kbps, 50),
+                     percentile(kbps, 95), percentile(setup, 50), percentile(setup, 95), percentile(ms, 95)])
+    return header, rows
+
+
+def cmd_regress(records, args):
+    base = [r for r in records if r.get("fw") == args.base]
+    new = [r for r in records if r.get("fw") == args.new]
+    if not base or not new:
+        sys.exit("need records for both builds (found %d for %s, %d for %s)" % (len(base), args.base, len(new), args.new))
+
+    keys = sorted(set(group_key(r, args.by) for r in base + new))
+    header = [args.by, "n_base", "n_new", "kbps_p50_base", "kbps_p50_new", "change%", "kbps_p5_change%",
+              "ok%_base", "ok%_new", "p", "verdict"]
+    rows = []
+    for key in keys:
+        b = [r for r in base if group_key(r, args.by) == key]
+        n = [r for r in new if group_key(r, args.by) == key]
+        if len(b) < args.min_samples or len(n) < args.min_samples:
+            continue
+        bk = [r["kbps"] for r in b if r.get("ok")]
+        nk = [r["kbps"] for r in n if r.get("ok")]
+        b50, n50 = percentile(bk, 50), percentile(nk, 50)
+        b5, n5 = percentile(bk, 5), percentile(nk, 5)
+        change = (n50 - b50) * 100.0 / b50 if b50 > 0 else float("nan")
+        tail = (n5 - b5) * 100.0 / b5 if b5 > 0 else float("nan")
+        ok_b = 100.0 * len(bk) / len(b)
+        ok_n = 100.0 * len(nk) / len(n)
+        p = mann_whitney_p(bk, nk)
+
+        verdict = "same"
+        significant = not math.isnan(p) and p < args.alpha
+        if ok_n < ok_b - args.threshold:
+            verdict = "REGRESSED (failures)"
+        elif significant and change <= -args.threshold:
+            verdict = "REGRESSED"
+        elif significant and change >= args.threshold:
+            verdict = "improved"
+        rows.append([key, len(b), len(n), b50, n50, change, tail, ok_b, ok_n, "%.3g" % p, verdict])
+    return header, rows
+
+
+def cmd_bottlenecks(records, args):
+    causes = ["network", "connect", "overhead", "crypto", "weak-signal", "failure", "unknown"]
+    groups = defaultdict(lambda: defaultdict(int))
+    totals = defaultdict(int)
+    time_split = defaultdict(lambda: [0.0, 0.0, 0.0])  # setup, transfer, other (ms)
+    for r in records:
+        key = group_key(r, args.by)
+        groups[key][attribute(r)] += 1
+        totals[key] += 1
+        if r.get("ok"):
+            setup, xfer = r.get("setup", 0), r.get("xfer", 0)
+            split = time_split[key]
+            split[0] += setup
+            split[1] += xfer
+            split[2] += max(r["ms"] - setup - xfer, 0)
+
+    header = [args.by, "n"] + [c + "%" for c in causes] + ["time_connect%", "time_transfer%", "time_other%"]
+    rows = []
+    for key in sorted(groups):
+        if totals[key] < args.min_samples:
+            continue
+        split = time_split[key]
+        t = sum(split) or 1.0
+        rows.append([key, totals[key]] + [100.0 * groups[key][c] / totals[key] for c in causes] +
+                    [100.0 * s / t for s in split])
+    return header, rows
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("command", choices=["summary", "regress", "bottlenecks"])
+    ap.add_argument("paths", nargs="+", help="log files or directories")
+    ap.add_argument("--by", default="fw", choices=["all", "fw", "dev", "host", "engine", "ap", "bssid"],
+                    help="grouping (ap = BSSID vendor OUI)")
+    ap.add_argument("--base", help="baseline firmware version (regress)")
+    ap.add_argument("--new", help="candidate firmware version (regress)")
+    ap.add_argument("--threshold", type=float, default=10.0, help="percent change that counts (regress)")
+    ap.add_argument("--alpha", type=float, default=0.05, help="significance level (regress)")
+    ap.add_argument("--min-samples", type=int, default=1, help="skip groups with fewer downloads")
+    ap.add_argument("--csv", help="also write the table to this CSV file")
+    args = ap.parse_args()
+
+    records = load(args.paths)
+    if not records:
+        sys.exit("no DLRESULT lines found")
+    print("%d downloads from %d devices\n" % (len(records), len(set(r.get("dev") for r in records))))
+
+    if args.command == "regress":
+        if not args.base or not args.new:
+            sys.exit("regress needs --base and --new")
+        if args.by == "fw":
+            args.by = "all"
+        header, rows = cmd_regress(records, args)
+    elif args.command == "bottlenecks":
+        header, rows = cmd_bottlenecks(records, args)
+    else:
+        header, rows = cmd_summary(records, args)
+
+    print_table(header, rows)
+    if args.csv:
+        write_csv(args.csv, header, rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+"""Flat CPU profile from the PC samples written by dumpPcSamples() (pc_sampler.cpp).
+
+Reads captured Serial output (other text and capture prefixes are ignored), resolves every
+distinct program counter with addr2line against the firmware ELF and prints:
+
+  - a flat profile: samples and percent per function, per core, with the hottest source line
+  - a breakdown by area (memcpy/libc, lwIP, WiFi, SPIFFS/flash, HTTPClient, TLS, String, idle, ...)
+
+  tools/pc_symbolize.py serial.log --elf build/main.ino.elf
+  tools/pc_symbolize.py serial.log --elf app.elf --core 0 --top 40 --csv profile.csv
+
+The ELF must be the one that was running; the dump header carries the first hex digits of its
+SHA-256 and a mismatch is reported. Needs the toolchain's addr2line (xtensa-esp32-elf-addr2line
+by default, see --addr2line). Otherwise standard library only.
+"""
+
+import argparse
+import csv
+import hashlib
+import subprocess
+import sys
+from collections import Counter, defaultdict
+
+# first match wins; checked against "function file"
+AREAS = [
+    ("idle", ("prvIdleTask", "esp_vApplicationIdleHook", "vApplicationIdleHook", "esp_pm_impl_waiti", "cpu_ll_waiti")),
+    ("memcpy/libc", ("memcpy", "memmove", "memset", "memcmp", "strlen", "strcmp", "/newlib/", "libc")),
+    ("String", ("String::", "WString")),
+    ("HTTPClient", ("HTTPClient", "WiFiClient", "NetworkClient")),
+    ("TLS", ("mbedtls", "esp_tls", "ssl_")),
+    ("lwIP", ("/lwip/", "lwip_", "tcp_", "pbuf_", "netconn_", "ip4_", "etharp")),
+    ("WiFi", ("/esp_wifi/", "wifi", "ieee80211", "ppTask", "pp_", "esf_", "lmac", "hal_mac")),
+    ("SPIFFS/flash", ("spiffs", "SPIFFS", "spi_flash", "esp_flash", "/spi_flash/")),
+    ("FreeRTOS", ("/freertos/", "xQueue", "xTask", "vTask", "vPort", "xPort", "_frxt_", "_xt_")),
+    ("Serial", ("HardwareSerial", "uart", "Print::")),
+]
+
+
+def parse_dump(paths):
+    """(header dict, {core: [pc, ...]}) from the last complete dump in the files."""
+    header, samples, current = None, None, None
+    for path in paths:
+        with open(path, errors="replace") as f:
+            for line in f:
+                at = line.find("PCPROF ")
+                if at >= 0:
+                    toks = line[at + len("PCPROF "):].split()
+                    if toks and toks[0] == "end":
+                        if current is not None:
+                            header, samples = current
+                        current = None
+                    else:
+                        fields = dict(t.partition("=")[::2] for t in toks[1:] if "=" in t)
+                        current = (fields, defaultdict(list))
+                    continue
+                at = line.find("PCS ")
+                if at < 0 or current is None:
+                    continue
+                toks = line[at + len("PCS "):].split()
+                try:
+                    core = int(toks[0])
+                    current[1][core].extend(int(t, 16) for t in toks[1:])
+                except ValueError:
+                    continue  # line torn by other output
+    if current is not None and samples is None:
+        header, samples = current  # dump without a trailer: use what arrived
+    return header, samples
+
+
+def elf_sha_prefix(path):
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        for block in iter(lambda: f.read(1 << 20), b""):
+            h.update(block)
+    return h.hexdigest()
+
+
+def symbolize(addr2line, elf, pcs):
+    """{pc: (function, "file:line")} via one addr2line process."""
+    pcs = sorted(pcs)
+    if not pcs:
+        return {}
+    try:
+        out = subprocess.run([addr2line, "-f", "-C", "-e", elf], input="\n".join("0x%08x" % pc for pc in pcs) + "\n",
+                             capture_output=True, text=True, check=True).stdout.splitlines()
+    except FileNotFoundError:
+        sys.exit("%s not found; pass the toolchain's addr2line with --addr2line" % addr2line)
+    except subprocess.CalledProcessError as e:
+        sys.exit("addr2line failed: %s" % e.stderr.strip())
+    result = {}
+    for i, pc in enumerate(pcs):
+        func = out[2 * i] if 2 * i < len(out) else "??"
+        loc = out[2 * i + 1] if 2 * i + 1 < len(out) else "??:0"
+        loc = loc.split(" (discriminator")[0]
+        result[pc] = (func if func != "??" else "0x%08x" % pc, loc)
+    return result
+
+
+def area_of(func, loc):
+    text = func + " " + loc
+    for name, needles in AREAS:
+        if any(n in text for n in needles):
+            return name
+    return "other"
+
+
+def short_loc(loc, keep=2):
+    path, _, line = loc.rpartition(":")
+    parts = path.replace("\\", "/").split("/")
+    return "/".join(parts[-keep:]) + ":" + line
+
+
+def print_table(header, rows, left=(1,)):
+    cells = [[str(c) if not isinstance(c, float) else "%.1f" % c for c in row] for row in rows]
+    widths = [max([len(h)] + [len(r[i]) for r in cells]) for i, h in enumerate(header)]
+    print("  ".join(h.ljust(w) for h, w in zip(header, widths)))
+    print("  ".join("-" * w for w in widths))
+    for r in cells:
+        print("  ".join(c.ljust(w) if i in left else c.rjust(w) for i, (c, w) in enumerate(zip(r, widths))))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("paths", nargs="+", help="captured Serial logs")
+    ap.add_argument("--elf", required=True, help="firmware ELF that produced the samples")
+    ap.add_argument("--addr2line", default="xtensa-esp32-elf-addr2line", help="addr2line for the target")
+    ap.add_argument("--core", type=int, help="only this core")
+    ap.add_argument("--top", type=int, default=25, help="functions to list")
+    ap.add_argument("--no-idle", action="store_true", help="leave idle samples out of the percentages")
+    ap.add_argument("--csv", help="also write the full function table to this CSV file")
+    args = ap.parse_args()
+
+    header, samples = parse_dump(args.paths)
+    if header is None:
+        sys.exit("no PCPROF dump found")
+    elf_sha = header.get("elf", "unknown")
+    if elf_sha != "unknown" and not elf_sha_prefix(args.elf).startswith(elf_sha):
+        print("warning: %s is not the ELF that was running (device elf=%s)\n" % (args.elf, elf_sha), file=sys.stderr)
+
+    cores = sorted(c for c in samples if args.core is None or c == args.core)
+    pcs = Counter()
+    per_core = defaultdict(Counter)
+    nested = 0
+    for c in cores:
+        for pc in samples[c]:
+            if pc == 0:
+                nested += 1
+                continue
+            pcs[pc] += 1
+            per_core[c][pc] += 1
+
+    syms = symbolize(args.addr2line, args.elf, pcs.keys())
+    funcs = Counter()
+    func_core = defaultdict(Counter)
+    func_lines = defaultdict(Counter)
+    areas = Counter()
+    for pc, n in pcs.items():
+        func, loc = syms[pc]
+        funcs[func] += n
+        func_lines[func][loc] += n
+        areas[area_of(func, loc)] += n
+        for c in cores:
+            func_core[func][c] += per_core[c][pc]
+    if args.no_idle:
+        for func in [f for f in funcs if area_of(f, func_lines[f].most_common(1)[0][0]) == "idle"]:
+            del funcs[func]
+        areas.pop("idle", None)
+
+    total = sum(funcs.values()) + nested
+    hz = int(header.get("hz", "1000") or 1000)
+    print("%d samples (%d dropped) over %s ms at %d Hz per core, fw %s\n" % (
+        total, int(header.get("dropped", "0") or 0), header.get("window_ms", "?"), hz, header.get("fw", "?")))
+    if total == 0:
+        return
+
+    head = ["samples", "function"] + ["core%d" % c for c in cores] + ["%", "hottest line"]
+    rows = []
+    for func, n in funcs.most_common():
+        rows.append([n, func] + [func_core[func][c] for c in cores] +
+                    [100.0 * n / total, short_loc(func_lines[func].most_common(1)[0][0])])
+    if nested:
+        rows.append([nested, "[nested interrupt]"] + ["" for _ in cores] + [100.0 * nested / total, ""])
+    rows.sort(key=lambda r: -r[0])
+    print_table(head, rows[:args.top], left=(1, len(head) - 1))
+
+    print()
+    print_table(["samples", "area", "%", "ms"], [[n, a, 100.0 * n / total, "%.0f" % (n * 1000.0 / hz)]
+                                                for a, n in areas.most_common()])
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            w = csv.writer(f)
+            w.writerow(head)
+            w.writerows(rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""Live decoder for the binary telemetry frames written by telemetry.cpp.
+
+Frames are 0x00-delimited COBS packets; anything that does not decode as a frame is
+ordinary Serial text and is passed through unchanged. Progress is redrawn in place,
+phases and metrics print one line each, and sequence gaps are counted as drops.
+
+  tools/telemetry_decoder.py /dev/ttyUSB0 --baud 19200
+  tools/telemetry_decoder.py capture.bin
+
+Standard library only (termios is used to set the baud rate on POSIX serial ports).
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+PROGRESS, PHASE, METRIC = 1, 2, 3
+PHASES = {1: "start", 2: "first byte", 3: "stop"}
+METRICS = {1: "free_heap", 2: "rssi", 3: "avg_Bps", 4: "peak_Bps", 5: "setup_ms", 6: "transfer_ms"}
+PAYLOAD_SIZE = {PROGRESS: 16, PHASE: 5, METRIC: 5}
+
+
+def crc8(data):
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def parse_frame(segment):
+    """(type, seq, ms, fields) or None when segment is not a valid frame."""
+    body = cobs_decode(segment)
+    if body is None or len(body) < 8 or crc8(body[:-1]) != body[-1]:
+        return None
+    ftype, seq, ms = struct.unpack_from("<BHI", body)
+    payload = body[7:-1]
+    if PAYLOAD_SIZE.get(ftype) != len(payload):
+        return None
+    if ftype == PROGRESS:
+        fields = struct.unpack("<IIII", payload)
+    elif ftype == PHASE:
+        fields = struct.unpack("<BI", payload)
+    else:
+        fields = struct.unpack("<Bi", payload)
+    return ftype, seq, ms, fields
+
+
+def human(n):
+    for unit in ("B", "KB", "MB"):
+        if n < 1024:
+            return "%.1f %s" % (n, unit) if unit != "B" else "%d B" % n
+        n /= 1024.0
+    return "%.1f GB" % n
+
+
+class Renderer:
+    def __init__(self, out):
+        self.out = out
+        self.last_seq = None
+        self.frames = self.dropped = self.bad = 0
+        self.frame_bytes = self.text_bytes = 0
+        self.progress_line = False
+
+    def _line(self, text):
+        if self.progress_line:
+            self.out.write("\n")
+            self.progress_line = False
+        self.out.write(text)
+
+    def segment(self, seg):
+        if not seg:
+            return
+        frame = parse_frame(seg)
+        if frame is None:
+            # text between frames (or a frame damaged on the wire)
+            self.text_bytes += len(seg)
+            if seg[0] < 0x20 and seg[0] not in (0x09, 0x0A, 0x0D):
+                self.bad += 1
+                return
+            self._line(seg.decode("utf-8", "replace"))
+            return
+
+        ftype, seq, ms, fields = frame
+        self.frames += 1
+        self.frame_bytes += len(seg) + 2
+        if self.last_seq is not None:
+            gap = (seq - self.last_seq - 1) & 0xFFFF
+            if gap and gap < 0x8000:
+                self.dropped += gap
+        self.last_seq = seq
+
+        stamp = "[%8.3f]" % (ms / 1000.0)
+        if ftype == PROGRESS:
+            done, total, cur, avg = fields
+            pct = " %5.1f%%" % (done * 100.0 / total) if total else ""
+            self.out.write("\r%s %s%s%s | now %s/s | avg %s/s   " %
+                           (stamp, human(done), (" / " + human(total)) if total else "", pct, human(cur), human(avg)))
+            self.progress_line = True
+        elif ftype == PHASE:
+            phase, value = fields
+            extra = {2: " (setup %d ms)" % value, 3: " (%s)" % human(value)}.get(phase, "")
+            self._line("%s phase %s%s\n" % (stamp, PHASES.get(phase, phase), extra))
+        else:
+            metric, value = fields
+            self._line("%s %s = %d\n" % (stamp, METRICS.get(metric, "metric%d" % metric), value))
+        self.out.flush()
+
+    def summary(self):
+        self._line("")
+        self.out.write("\n--- %d frames (%d bytes), %d dropped, %d damaged, %d bytes of text ---\n" %
+                       (self.frames, self.frame_bytes, self.dropped, self.bad, self.text_bytes))
+
+
+def open_input(path, baud):
+    if path == "-":
+        return sys.stdin.buffer
+    fd = os.open(path, os.O_RDONLY | getattr(os, "O_NOCTTY", 0))
+    if os.isatty(fd):
+        import termios
+        import tty
+        tty.setraw(fd)
+        attrs = termios.tcgetattr(fd)
+        speed = getattr(termios, "B%d" % baud)
+        attrs[4] = attrs[5] = speed
+        termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    return os.fdopen(fd, "rb", buffering=0)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("input", help="serial device, capture file, or - for stdin")
+    ap.add_argument("--baud", type=int, default=19200)
+    args = ap.parse_args()
+
+    src = open_input(args.input, args.baud)
+    r = Renderer(sys.stdout)
+    pending = bytearray()
+    try:
+        while True:
+            chunk = src.read(256)
+            if not chunk:
+                break
+            pending += chunk
+            while True:
+                z = pending.find(0)
+                if z < 0:
+                    break
+                r.segment(bytes(pending[:z]))
+                del pending[:z + 1]
+    except KeyboardInterrupt:
+        pass
+    r.segment(bytes(pending))
+    r.summary()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,292 @@
+#include "upload_engine.h"
+#include <FS.h>
+#include <SPIFFS.h>
+#include "spiffs_management.h"
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+// A buffer handed from the flash reader to the sender; len == 0 ends the stream
+struct UploadChunk {
+    int index;
+    size_t len;
+};
+
+struct HttpUploader::Pipeline {
+    File file;
+    String stored;          // SPIFFS path being read (blob for a store reference)
+    uint8_t* buffers[DOUBLE_BUFFER_COUNT];
+    size_t bufferSize;
+    size_t offset;          // next file offset the reader produces
+    size_t remaining;
+    QueueHandle_t emptyQ;   // buffer indices the reader may fill
+    QueueHandle_t fullQ;    // UploadChunk waiting to be sent
+    SemaphoreHandle_t readerDone;
+    volatile bool abort;
+    bool readError;
+};
+
+HttpUploader::HttpUploader()
+: bufMgr(nullptr), perf(nullptr), method(UPLOAD_PUT), contentType("application/octet-stream"),
+  chunked(false), resumeEnabled(false), cancelled(false) {
+}
+
+HttpUploader::~HttpUploader() {
+    cancel();
+}
+
+void HttpUploader::readerTask(void* parameter) {
+    Pipeline* p = static_cast<Pipeline*>(parameter);
+
+    while (p->remaining > 0 && !p->abort) {
+        UploadChunk chunk;
+        if (xQueueReceive(p->emptyQ, &chunk.index, pdMS_TO_TICKS(UPLOAD_IO_TIMEOUT_MS)) != pdTRUE) break;
+        chunk.len = readFromSPIFFS(p->file, p->stored, p->offset, p->buffers[chunk.index], min(p->bufferSize, p->remaining));
+        if (chunk.len == 0) {
+            p->readError = true;
+            break;
+        }
+        p->offset += chunk.len;
+        p->remaining -= chunk.len;
+        xQueueSend(p->fullQ, &chunk, portMAX_DELAY);
+    }
+
+    UploadChunk eof = { -1, 0 };
+    xQueueSend(p->fullQ, &eof, portMAX_DELAY);
+    xSemaphoreGive(p->readerDone);
+    vTaskDelete(nullptr);
+}
+
+bool HttpUploader::sendAll(Client& client, const uint8_t* data, size_t len) {
+    unsigned long lastProgress = millis();
+    while (len > 0) {
+        size_t n = client.write(data, len);
+        if (n > 0) {
+            data += n;
+            len -= n;
+            lastProgress = millis();
+        } else if (!client.connected() || millis() - lastProgress > UPLOAD_IO_TIMEOUT_MS) {
+            return false;
+        } else {
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+    }
+    return true;
+}
+
+int HttpUploader::readStatus(Client& client) {
+    unsigned long start = millis();
+    while (!client.available() && client.connected() && millis() - start < UPLOAD_IO_TIMEOUT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    client.setTimeout(UPLOAD_IO_TIMEOUT_MS);
+    String statusLine = client.readStringUntil('\n'); // HTTP/1.1 201 Created
+    int sp = statusLine.indexOf(' ');
+    if (sp < 0) return -1;
+    int code = statusLine.substring(sp + 1).toInt();
+
+    // drain headers; we close the connection anyway
+    while (client.connected()) {
+        String h = client.readStringUntil('\n');
+        h.trim();
+        if (h.length() == 0) break;
+    }
+    return code;
+}
+
+size_t HttpUploader::probeServerOffset(const String& url, size_t localSize) {
+    HttpResponse head = httpHead(url);
+    // 200 with a shorter body than ours = partial upload we can extend
+    if (head.statusCode == 200 && head.contentLength > 0 && head.contentLength < localSize) {
+        return head.contentLength;
+    }
+    return 0;
+}
+
+UploadResult HttpUploader::upload(const String& localPath, const String& url) {
+    UploadResult result;
+    cancelled = false;
+    result.chunked = chunked;
+
+    UrlParts u;
+    if (!parseUrl(url, u)) {
+        result.errorMessage = "Unsupported URL: " + url;
+        return result;
+    }
+
+    Pipeline p;
+    p.stored = resolveSPIFFSPath(localPath);
+    p.offset = 0;
+    p.file = SPIFFS.open(p.stored, FILE_READ);
+    if (!p.file) {
+        result.errorMessage = "Cannot open " + localPath;
+        return result;
+    }
+    result.fileSize = p.file.size();
+    downloadCacheTouch(localPath);
+
+    if (resumeEnabled && method == UPLOAD_PUT) {
+        result.resumedFrom = probeServerOffset(url, result.fileSize);
+        if (result.resumedFrom > 0) {
+            Serial.println("Server already has " + String((unsigned)result.resumedFrom) + " bytes, resuming upload");
+            p.offset = result.resumedFrom;
+        }
+    }
+    size_t bodyLength = result.fileSize - result.resumedFrom;
+
+    // Two buffers: the manager's write buffers when double buffering is on and no download is
+    // using them, otherwise our own
+    uint8_t* owned[DOUBLE_BUFFER_COUNT] = { nullptr };
+    bool leased = bufMgr && bufMgr->isDoubleBufferingEnabled() && bufMgr->getWriteBufferSize() > 0 &&
+                  bufMgr->leaseWriteBuffers();
+    if (leased) {
+        p.bufferSize = bufMgr->getWriteBufferSize();
+        for (int i = 0; i < (int)DOUBLE_BUFFER_COUNT; ++i) p.buffers[i] = bufMgr->getWriteBuffer(i);
+    } else {
+        p.bufferSize = BufferManager::getSmartWriteBufferSize();
+        for (int i = 0; i < (int)DOUBLE_BUFFER_COUNT; ++i) {
+            owned[i] = (uint8_t*)malloc(p.bufferSize);
+            p.buffers[i] = owned[i];
+        }
+    }
+    auto releaseBuffers = [&]() {
+        for (int i = 0; i < (int)DOUBLE_BUFFER_COUNT; ++i) {
+            if (owned[i]) free(owned[i]);
+        }
+        if (leased) bufMgr->releaseWriteBuffers();
+    };
+    if (!p.buffers[0] || !p.buffers[1]) {
+        result.errorMessage = "Failed to allocate upload buffers";
+        p.file.close();
+        releaseBuffers();
+        return result;
+    }
+
+    if (perf) {
+        perf->startMonitoring();
+        perf->startConnectionTimer();
+    }
+
+    // Same trust model as HTTPClient::begin(url) used by the download engines
+    WiFiClient plain;
+    WiFiClientSecure secure;
+    if (u.secure) secure.setInsecure();
+    WiFiClient& client = u.secure ? (WiFiClient&)secure : plain;
+
+    unsigned long connectStart = millis();
+    if (!client.connect(u.host.c_str(), u.port)) {
+        result.errorMessage = "Connection failed: " + u.host;
+        p.file.close();
+        releaseBuffers();
+        if (perf) perf->stopMonitoring();
+        return result;
+    }
+    client.setNoDelay(true);
+    result.connectionSetupMs = millis() - connectStart;
+
+    String req = String(method == UPLOAD_PUT ? "PUT " : "POST ") + u.path + " HTTP/1.1\r\n";
+    req += "Host: " + u.host + "\r\n";
+    req += "Content-Type: " + contentType + "\r\n";
+    req += "Connection: close\r\n";
+    if (chunked) {
+        req += "Transfer-Encoding: chunked\r\n";
+    } else {
+        req += "Content-Length: " + String((unsigned)bodyLength) + "\r\n";
+    }
+    if (result.resumedFrom > 0) {
+        req += "Content-Range: bytes " + String((unsigned)result.resumedFrom) + "-" + String((unsigned)(result.fileSize - 1)) +
+               "/" + String((unsigned)result.fileSize) + "\r\n";
+    }
+    req += "\r\n";
+
+    bool ok = sendAll(client, (const uint8_t*)req.c_str(), req.length());
+
+    // Start the flash reader; it runs one buffer ahead of the socket
+    p.remaining = bodyLength;
+    p.abort = false;
+    p.readError = false;
+    p.emptyQ = xQueueCreate(DOUBLE_BUFFER_COUNT, sizeof(int));
+    p.fullQ = xQueueCreate(DOUBLE_BUFFER_COUNT + 1, sizeof(UploadChunk));
+    p.readerDone = xSemaphoreCreateBinary();
+    for (int i = 0; i < (int)DOUBLE_BUFFER_COUNT; ++i) xQueueSend(p.emptyQ, &i, 0);
+
+    bool readerStarted = ok && bodyLength > 0 &&
+                         xTaskCreatePinnedToCore(readerTask, "UploadReader", 4096, &p, 2, nullptr, 1) == pdPASS;
+    if (ok && bodyLength > 0 && !readerStarted) {
+        ok = false;
+        result.errorMessage = "Failed to start reader task";
+    }
+
+    size_t sent = 0;
+    unsigned long stallMs = 0;
+    while (readerStarted) {
+        UploadChunk chunk;
+        unsigned long waitStart = millis();
+        if (xQueueReceive(p.fullQ, &chunk, pdMS_TO_TICKS(UPLOAD_IO_TIMEOUT_MS)) != pdTRUE) {
+            ok = false;
+            result.errorMessage = "Flash read stalled";
+            p.abort = true;
+            break;
+        }
+        stallMs += millis() - waitStart;
+        if (chunk.len == 0) break;
+
+        if (ok && !cancelled) {
+            if (chunked) {
+                char sizeLine[12];
+                int n = snprintf(sizeLine, sizeof(sizeLine), "%x\r\n", (unsigned)chunk.len);
+                ok = sendAll(client, (const uint8_t*)sizeLine, n);
+            }
+            ok = ok && sendAll(client, p.buffers[chunk.index], chunk.len);
+            if (chunked) ok = ok && sendAll(client, (const uint8_t*)"\r\n", 2);
+
+            if (ok) {
+                if (sent == 0 && perf) perf->markFirstByte();
+                sent += chunk.len;
+                if (perf) perf->updateProgress(sent, bodyLength);
+            } else {
+                result.errorMessage = "Send failed after " + String((unsigned)sent) + " bytes";
+                p.abort = true;
+            }
+        } else {
+            p.abort = true;
+        }
+        xQueueSend(p.emptyQ, &chunk.index, portMAX_DELAY);
+    }
+    if (readerStarted) xSemaphoreTake(p.readerDone, portMAX_DELAY);
+    vQueueDelete(p.emptyQ);
+    vQueueDelete(p.fullQ);
+    vSemaphoreDelete(p.readerDone);
+    p.file.close();
+    releaseBuffers();
+
+    if (p.readError) {
+        ok = false;
+        result.errorMessage = "Flash read failed";
+    }
+    if (ok && chunked) ok = sendAll(client, (const uint8_t*)"0\r\n\r\n", 5);
+    if (ok && !cancelled) {
+        result.httpStatusCode = readStatus(client);
+        ok = result.httpStatusCode >= 200 && result.httpStatusCode < 300;
+        if (!ok) result.errorMessage = "HTTP error: " + String(result.httpStatusCode);
+    }
+    client.stop();
+
+    if (perf) {
+        perf->stopEnhancedMonitoring();
+        perf->stopMonitoring();
+        DetailedTiming t = perf->getDetailedTiming();
+        result.uploadTimeMs = t.totalTimeMs;
+        result.averageSpeedKBps = PerformanceMonitor::calculateSpeedKBps(sent, t.totalTimeMs);
+        result.peakSpeedKBps = perf->getPeakSpeed();
+    }
+
+    result.bytesSent = sent;
+    result.flashStallMs = stallMs;
+    result.success = ok && !cancelled && sent == bodyLength;
+    if (cancelled) result.errorMessage = "Cancelled by user";
+    return result;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <Arduino.h>
+#include "buffer_and_performance.h"
+#include "network_and_http.h"
+
+// Streaming uploader - the counterpart of HttpDownloader for pushing logs/captures to a server.
+// A reader task on core 1 fills one write buffer from flash while the caller's task sends the other.
+
+enum UploadMethod {
+UPLOAD_PUT,
+UPLOAD_POST
+};
+
+const unsigned long UPLOAD_IO_TIMEOUT_MS = 10000;
+
+struct UploadResult {
+bool success = false;
+size_t fileSize = 0;
+size_t bytesSent = 0;          // body bytes sent in this call (excludes a resumed prefix)
+size_t resumedFrom = 0;        // server already had this many bytes
+bool chunked = false;
+int httpStatusCode = 0;
+String errorMessage = "";
+
+unsigned long uploadTimeMs = 0;
+unsigned long connectionSetupMs = 0;
+float averageSpeedKBps = 0.0f;
+float peakSpeedKBps = 0.0f;
+unsigned long flashStallMs = 0; // time the sender waited on flash reads; ~0 means reads were fully hidden
+};
+
+class HttpUploader {
+public:
+HttpUploader();
+~HttpUploader();
+
+UploadResult upload(const String& localPath, const String& url);
+void cancel() { cancelled = true; }
+String getName() const { return String("HttpUploader"); }
+
+void setBufferManager(BufferManager* mgr) { bufMgr = mgr; }
+void setPerformanceMonitor(PerformanceMonitor* m) { perf = m; }
+void setMethod(UploadMethod m) { method = m; }
+void setContentType(const String& type) { contentType = type; }
+// Chunked transfer encoding; otherwise Content-Length is sent
+void setChunkedEncoding(bool enabled) { chunked = enabled; }
+// Ask the server (HEAD) how much it already has and continue with Content-Range.
+// Only meaningful for PUT targets whose HEAD reports the partial size.
+void setResumeEnabled(bool enabled) { resumeEnabled = enabled; }
+
+private:
+struct Pipeline;
+
+BufferManager* bufMgr;
+PerformanceMonitor* perf;
+UploadMethod method;
+String contentType;
+bool chunked;
+bool resumeEnabled;
+volatile bool cancelled;
+
+static void readerTask(void* parameter);
+
+size_t probeServerOffset(const String& url, size_t localSize);
+bool sendAll(Client& client, const uint8_t* data, size_t len);
+int readStatus(Client& client);
+};